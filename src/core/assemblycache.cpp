@@ -0,0 +1,82 @@
+#include "assemblycache.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+
+AssemblyCache::AssemblyCache(QString cacheDirectory)
+{
+    this->cacheDirectory = cacheDirectory;
+}
+
+bool AssemblyCache::assemble(Machine &machine, QString sourceCode)
+{
+    QString key = getKey(machine, sourceCode);
+
+    if (load(machine, key))
+        return true;
+
+    machine.assemble(sourceCode);
+
+    if (machine.getBuildSuccessful())
+        store(machine, key); // Failed builds are not cached, so their errors are always reported
+
+    return false;
+}
+
+bool AssemblyCache::load(Machine &machine, QString key)
+{
+    QFile entryFile(getEntryPath(key)); // Implicitly closed and unmapped
+
+    if (!entryFile.open(QFile::ReadOnly) || entryFile.size() == 0)
+        return false;
+
+    uchar *data = entryFile.map(0, entryFile.size());
+
+    if (data == nullptr)
+        return false;
+
+    return machine.loadAssembledImage(data, entryFile.size());
+}
+
+bool AssemblyCache::store(Machine &machine, QString key)
+{
+    QByteArray image = machine.saveAssembledImage();
+
+    if (image.isEmpty() || !QDir().mkpath(cacheDirectory))
+        return false;
+
+    // Written to a temporary file and renamed, so concurrent readers never map a partial entry
+    QSaveFile entryFile(getEntryPath(key));
+
+    if (!entryFile.open(QFile::WriteOnly))
+        return false;
+
+    entryFile.write(image);
+    return entryFile.commit();
+}
+
+QString AssemblyCache::getKey(const Machine &machine, QString sourceCode) const
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+
+    hash.addData(QByteArray::number(Machine::ASSEMBLER_VERSION));
+    hash.addData("\n", 1);
+    hash.addData(machine.getIdentifier().toLatin1());
+    hash.addData("\n", 1);
+    hash.addData(QByteArray(machine.isPeepholeOptimizationEnabled() ? "peephole\n" : "\n"));
+    hash.addData(sourceCode.toUtf8());
+
+    return QString::fromLatin1(hash.result().toHex());
+}
+
+QString AssemblyCache::getEntryPath(QString key) const
+{
+    return QDir(cacheDirectory).filePath(key + ".hasm");
+}
+
+QString AssemblyCache::getCacheDirectory() const
+{
+    return cacheDirectory;
+}
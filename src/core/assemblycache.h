@@ -0,0 +1,36 @@
+#ifndef ASSEMBLYCACHE_H
+#define ASSEMBLYCACHE_H
+
+#include <QString>
+
+#include "machine.h"
+
+/// Content-addressed, on-disk cache of successful builds.
+///
+/// Entries are keyed by a hash of the source text, the machine identifier,
+/// the optimizer setting and Machine::ASSEMBLER_VERSION, and hold the image written by
+/// Machine::saveAssembledImage. Cache hits are memory-mapped and restored
+/// without running the assembler.
+class AssemblyCache
+{
+public:
+    explicit AssemblyCache(QString cacheDirectory);
+
+    /// Loads the build from the cache or assembles (and caches) it.
+    /// Returns true on a cache hit.
+    bool assemble(Machine &machine, QString sourceCode);
+
+    /// Restores a cached build into the machine. Returns false on a miss.
+    bool load(Machine &machine, QString key);
+    /// Stores the machine's last successful build under the given key.
+    bool store(Machine &machine, QString key);
+
+    QString getKey(const Machine &machine, QString sourceCode) const;
+    QString getEntryPath(QString key) const;
+    QString getCacheDirectory() const;
+
+private:
+    QString cacheDirectory;
+};
+
+#endif // ASSEMBLYCACHE_H
@@ -0,0 +1,402 @@
+#include "controlflowgraph.h"
+
+#include <QSet>
+#include <algorithm>
+#include <climits>
+
+ControlFlowGraph::ControlFlowGraph(Machine &machine, int entryAddress) :
+    machine(machine)
+{
+    this->entryAddress = machine.address(entryAddress);
+
+    findInstructions(this->entryAddress);
+    buildBlocks();
+    findLoops();
+}
+
+
+
+//////////////////////////////////////////////////
+// Getters
+//////////////////////////////////////////////////
+
+const QVector<ControlFlowGraph::BasicBlock>& ControlFlowGraph::getBlocks() const
+{
+    return blocks;
+}
+
+const QVector<ControlFlowGraph::Loop>& ControlFlowGraph::getLoops() const
+{
+    return loops;
+}
+
+int ControlFlowGraph::getBlockAt(int address) const
+{
+    return blockAtAddress.value(address, -1);
+}
+
+int ControlFlowGraph::getEdgeAccessCount(const BasicBlock &block, const Edge &edge) const
+{
+    return (edge.taken) ? block.takenAccessCount : block.accessCount;
+}
+
+
+
+//////////////////////////////////////////////////
+// Construction
+//////////////////////////////////////////////////
+
+// Recursive descent: follows every statically known successor, marking block leaders
+void ControlFlowGraph::findInstructions(int entryAddress)
+{
+    QVector<int> pending;
+    pending.append(entryAddress);
+    isLeader.insert(entryAddress, true);
+
+    while (!pending.isEmpty())
+    {
+        int address = pending.takeLast();
+
+        if (instructions.contains(address) || instructions.size() >= machine.getMemorySize())
+            continue;
+
+        DecodedInstruction decoded = machine.decodeInstructionAt(address);
+        bool unknownTarget;
+        QVector<Target> targets = getSuccessors(address, decoded, unknownTarget);
+
+        instructions.insert(address, decoded);
+        instructionTargets.insert(address, targets);
+        hasUnknownTarget.insert(address, unknownTarget);
+
+        foreach (Target target, targets)
+        {
+            if (!isFallThroughOnly(address))
+                isLeader.insert(target.address, true);
+
+            pending.append(target.address);
+        }
+    }
+}
+
+void ControlFlowGraph::buildBlocks()
+{
+    QList<int> leaders = isLeader.keys();
+    std::sort(leaders.begin(), leaders.end());
+
+    foreach (int leader, leaders)
+    {
+        if (!instructions.contains(leader))
+            continue;
+
+        BasicBlock block;
+        block.start = leader;
+        block.hasUnknownSuccessor = false;
+
+        blockAtAddress.insert(leader, blocks.size());
+        blocks.append(block);
+    }
+
+    for (int i = 0; i < blocks.size(); i++)
+    {
+        BasicBlock &block = blocks[i];
+        QVector<Target> targets;
+        int address = block.start;
+
+        // Follow fall-through instructions until a branch or the next leader
+        while (block.instructionAddresses.size() < machine.getMemorySize())
+        {
+            block.instructionAddresses.append(address);
+
+            if (!isFallThroughOnly(address))
+            {
+                targets = instructionTargets.value(address);
+                block.hasUnknownSuccessor = hasUnknownTarget.value(address);
+                break;
+            }
+
+            int nextAddress = instructionTargets.value(address).first().address;
+
+            if (isLeader.contains(nextAddress))
+            {
+                Target fallThrough = {nextAddress, false};
+                targets.append(fallThrough);
+                break;
+            }
+
+            address = nextAddress;
+        }
+
+        foreach (Target target, targets)
+        {
+            if (!blockAtAddress.contains(target.address)) // Search stopped before decoding it
+            {
+                block.hasUnknownSuccessor = true;
+                continue;
+            }
+
+            Edge edge = {blockAtAddress.value(target.address), target.taken};
+            block.successors.append(edge);
+        }
+
+        // Static costs
+        block.instructionCount = block.instructionAddresses.size();
+        block.accessCount = 0;
+        block.takenAccessCount = 0;
+
+        for (int j = 0; j < block.instructionAddresses.size(); j++)
+        {
+            const DecodedInstruction &decoded = instructions[block.instructionAddresses[j]];
+            bool isLast = (j == block.instructionAddresses.size() - 1);
+
+            block.accessCount      += machine.getStaticAccessCount(decoded, false);
+            block.takenAccessCount += machine.getStaticAccessCount(decoded, isLast);
+        }
+    }
+}
+
+void ControlFlowGraph::findLoops()
+{
+    if (blocks.isEmpty())
+        return;
+
+    // Iterative DFS from the entry block: back edges point to blocks still on the stack
+    QVector<int> state(blocks.size(), 0); // 0: unvisited, 1: on stack, 2: done
+    QVector<int> postorder;
+    QVector<QPair<int, int>> stack; // Block, next successor to visit
+    QHash<int, QVector<int>> latchesOfHeader;
+    QVector<QVector<int>> predecessors(blocks.size());
+
+    for (int i = 0; i < blocks.size(); i++)
+    {
+        foreach (Edge edge, blocks[i].successors)
+            predecessors[edge.block].append(i);
+    }
+
+    stack.append(qMakePair(getBlockAt(entryAddress), 0));
+    state[stack.last().first] = 1;
+
+    while (!stack.isEmpty())
+    {
+        int block = stack.last().first;
+        int successorIndex = stack.last().second;
+
+        if (successorIndex >= blocks[block].successors.size())
+        {
+            state[block] = 2;
+            postorder.append(block);
+            stack.removeLast();
+            continue;
+        }
+
+        stack.last().second++;
+        int successor = blocks[block].successors[successorIndex].block;
+
+        if (state[successor] == 0)
+        {
+            state[successor] = 1;
+            stack.append(qMakePair(successor, 0));
+        }
+        else if (state[successor] == 1 && !latchesOfHeader[successor].contains(block))
+        {
+            latchesOfHeader[successor].append(block);
+        }
+    }
+
+    QVector<int> reversePostorder = postorder;
+    std::reverse(reversePostorder.begin(), reversePostorder.end());
+
+    // Natural loop bodies: blocks that reach a latch without passing through the header
+    QList<int> headers = latchesOfHeader.keys();
+    std::sort(headers.begin(), headers.end());
+
+    foreach (int header, headers)
+    {
+        Loop loop;
+        loop.header = header;
+
+        QSet<int> body;
+        body.insert(header);
+        QVector<int> pending = latchesOfHeader.value(header);
+
+        while (!pending.isEmpty())
+        {
+            int block = pending.takeLast();
+
+            if (body.contains(block))
+                continue;
+
+            body.insert(block);
+            pending += predecessors[block];
+        }
+
+        foreach (int block, reversePostorder)
+        {
+            if (body.contains(block))
+                loop.blocks.append(block);
+        }
+
+        calculateIterationCost(loop, reversePostorder);
+        loops.append(loop);
+    }
+}
+
+// Shortest and longest paths from the header back to it, over the loop's forward edges
+void ControlFlowGraph::calculateIterationCost(Loop &loop, const QVector<int> &reversePostorder)
+{
+    QHash<int, int> order;
+    for (int i = 0; i < reversePostorder.size(); i++)
+        order.insert(reversePostorder[i], i);
+
+    QHash<int, int> minAccesses, maxAccesses, minInstructions, maxInstructions;
+    minAccesses[loop.header] = maxAccesses[loop.header] = 0;
+    minInstructions[loop.header] = maxInstructions[loop.header] = 0;
+
+    loop.minAccesses = loop.minInstructions = INT_MAX;
+    loop.maxAccesses = loop.maxInstructions = 0;
+
+    foreach (int block, loop.blocks) // In reverse postorder, so predecessors come first
+    {
+        if (!minAccesses.contains(block))
+            continue;
+
+        foreach (Edge edge, blocks[block].successors)
+        {
+            int accesses = getEdgeAccessCount(blocks[block], edge);
+            int instructionCount = blocks[block].instructionCount;
+
+            if (edge.block == loop.header)
+            {
+                loop.minAccesses     = qMin(loop.minAccesses,     minAccesses[block] + accesses);
+                loop.maxAccesses     = qMax(loop.maxAccesses,     maxAccesses[block] + accesses);
+                loop.minInstructions = qMin(loop.minInstructions, minInstructions[block] + instructionCount);
+                loop.maxInstructions = qMax(loop.maxInstructions, maxInstructions[block] + instructionCount);
+            }
+            else if (loop.blocks.contains(edge.block) && order.value(edge.block) > order.value(block)) // Skip inner loops' back edges
+            {
+                if (!minAccesses.contains(edge.block))
+                {
+                    minAccesses[edge.block] = minInstructions[edge.block] = INT_MAX;
+                    maxAccesses[edge.block] = maxInstructions[edge.block] = 0;
+                }
+
+                minAccesses[edge.block]     = qMin(minAccesses[edge.block],     minAccesses[block] + accesses);
+                maxAccesses[edge.block]     = qMax(maxAccesses[edge.block],     maxAccesses[block] + accesses);
+                minInstructions[edge.block] = qMin(minInstructions[edge.block], minInstructions[block] + instructionCount);
+                maxInstructions[edge.block] = qMax(maxInstructions[edge.block], maxInstructions[block] + instructionCount);
+            }
+        }
+    }
+
+    if (loop.minAccesses == INT_MAX) // Shouldn't happen, every loop has a latch
+        loop.minAccesses = loop.minInstructions = 0;
+}
+
+
+
+//////////////////////////////////////////////////
+// Instruction semantics
+//////////////////////////////////////////////////
+
+QVector<ControlFlowGraph::Target> ControlFlowGraph::getSuccessors(int address, const DecodedInstruction &decoded, bool &unknownTarget)
+{
+    QVector<Target> targets;
+    int nextAddress = machine.address(address + decoded.size);
+    Target next = {nextAddress, false};
+
+    unknownTarget = false;
+
+    if (decoded.instruction == nullptr) // Executed as NOP
+    {
+        targets.append(next);
+        return targets;
+    }
+
+    bool isDirect    = (decoded.addressingModeCode == AddressingMode::DIRECT);
+    bool isImmediate = (decoded.addressingModeCode == AddressingMode::IMMEDIATE); // Immediate jumps are ignored
+    Target jump = {machine.address(decoded.argument), true};
+
+    switch (decoded.instruction->getInstructionCode())
+    {
+    case Instruction::HLT:
+    case Instruction::VOLTA_HLT:
+        break;
+
+    case Instruction::JMP:
+        if (isImmediate)
+            targets.append(next);
+        else if (isDirect)
+            targets.append(jump);
+        else
+            unknownTarget = true;
+        break;
+
+    case Instruction::JN: case Instruction::JP: case Instruction::JV: case Instruction::JNV:
+    case Instruction::JZ: case Instruction::JNZ: case Instruction::JC: case Instruction::JNC:
+    case Instruction::JB: case Instruction::JNB:
+        targets.append(next);
+        if (isDirect)
+            targets.append(jump);
+        else if (!isImmediate)
+            unknownTarget = true;
+        break;
+
+    case Instruction::JSR: // Return address is stored at the target, execution starts after it
+        jump.address = machine.address(decoded.argument + 1);
+        if (isDirect)
+            targets.append(jump);
+        else if (!isImmediate)
+            unknownTarget = true;
+
+        next.taken = !isImmediate; // Assumes the subroutine returns
+        targets.append(next);
+        break;
+
+    case Instruction::REG_IF:
+        targets.append(jump);
+        jump.address = machine.address(decoded.secondArgument);
+        targets.append(jump);
+        break;
+
+    case Instruction::VOLTA_JMP:
+    case Instruction::VOLTA_JSR:
+        if (decoded.addressingModeCode == AddressingMode::INDEXED_BY_PC)
+            jump.address = machine.address(decoded.argument + nextAddress);
+
+        if (isDirect || decoded.addressingModeCode == AddressingMode::INDEXED_BY_PC)
+            targets.append(jump);
+        else
+            unknownTarget = true;
+
+        if (decoded.instruction->getInstructionCode() == Instruction::VOLTA_JSR)
+        {
+            next.taken = true; // Assumes the subroutine returns
+            targets.append(next);
+        }
+        break;
+
+    case Instruction::VOLTA_RTS:
+        unknownTarget = true;
+        break;
+
+    case Instruction::VOLTA_SZ:  case Instruction::VOLTA_SNZ: case Instruction::VOLTA_SPL:
+    case Instruction::VOLTA_SMI: case Instruction::VOLTA_SPZ: case Instruction::VOLTA_SMZ:
+    case Instruction::VOLTA_SEQ: case Instruction::VOLTA_SNE: case Instruction::VOLTA_SGR:
+    case Instruction::VOLTA_SLS: case Instruction::VOLTA_SGE: case Instruction::VOLTA_SLE:
+        targets.append(next);
+        jump.address = machine.address(nextAddress + machine.decodeInstructionAt(nextAddress).size); // Skips next instruction
+        targets.append(jump);
+        break;
+
+    default:
+        targets.append(next);
+        break;
+    }
+
+    return targets;
+}
+
+bool ControlFlowGraph::isFallThroughOnly(int address) const
+{
+    const QVector<Target> &targets = instructionTargets[address];
+    return !hasUnknownTarget.value(address) && targets.size() == 1 && !targets.first().taken;
+}
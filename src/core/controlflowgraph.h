@@ -0,0 +1,80 @@
+#ifndef CONTROLFLOWGRAPH_H
+#define CONTROLFLOWGRAPH_H
+
+#include <QHash>
+#include <QVector>
+
+#include "machine.h"
+
+/// Basic blocks of the program in the machine's memory, found by recursive descent from an
+/// entry address, annotated with static instruction and memory access counts.
+///
+/// Access counts follow Machine::getStaticAccessCount, so they match what the simulation adds
+/// to accessCount when executing the same path. Each natural loop (found through DFS back
+/// edges) gets its per-iteration cost, as a range when its body has more than one path;
+/// inner loops are counted as a single pass.
+class ControlFlowGraph
+{
+public:
+    struct Edge
+    {
+        int block;
+        bool taken; // Reached by taking the last instruction's branch (not falling through)
+    };
+
+    struct BasicBlock
+    {
+        int start; // Address of the first instruction
+        QVector<int> instructionAddresses;
+        QVector<Edge> successors;
+        bool hasUnknownSuccessor; // Indirect jump, subroutine return
+        int instructionCount;
+        int accessCount; // Falling through the last instruction
+        int takenAccessCount; // Taking the last instruction's branch
+    };
+
+    struct Loop
+    {
+        int header; // Block index
+        QVector<int> blocks; // Header included
+        int minInstructions, maxInstructions; // Per iteration
+        int minAccesses, maxAccesses;
+    };
+
+    explicit ControlFlowGraph(Machine &machine, int entryAddress = 0);
+
+    const QVector<BasicBlock>& getBlocks() const;
+    const QVector<Loop>& getLoops() const;
+    int getBlockAt(int address) const; // -1 if no block starts at the address
+    int getEdgeAccessCount(const BasicBlock &block, const Edge &edge) const;
+
+private:
+    struct Target
+    {
+        int address;
+        bool taken;
+    };
+
+    void findInstructions(int entryAddress);
+    void buildBlocks();
+    void findLoops();
+    void calculateIterationCost(Loop &loop, const QVector<int> &reversePostorder);
+
+    QVector<Target> getSuccessors(int address, const DecodedInstruction &decoded, bool &unknownTarget);
+    bool isFallThroughOnly(int address) const;
+
+    Machine &machine;
+    int entryAddress;
+
+    // Reached instructions
+    QHash<int, DecodedInstruction> instructions;
+    QHash<int, QVector<Target>> instructionTargets;
+    QHash<int, bool> hasUnknownTarget;
+    QHash<int, bool> isLeader;
+
+    QVector<BasicBlock> blocks;
+    QHash<int, int> blockAtAddress;
+    QVector<Loop> loops;
+};
+
+#endif // CONTROLFLOWGRAPH_H
@@ -0,0 +1,230 @@
+#include "disassembler.h"
+
+#include <QSet>
+#include <QStringList>
+#include <QTextStream>
+
+Disassembler::Disassembler(Machine &machine, int entryAddress) :
+    machine(machine),
+    entryAddress(machine.address(entryAddress)),
+    graph(machine, entryAddress)
+{
+    code.fill(false, machine.getMemorySize());
+    instructionStart.fill(false, machine.getMemorySize());
+
+    foreach (const ControlFlowGraph::BasicBlock &block, graph.getBlocks())
+    {
+        foreach (int address, block.instructionAddresses)
+        {
+            instructionStart[address] = true;
+
+            int size = machine.decodeInstructionAt(address).size;
+            for (int i = 0; i < size; i++)
+                code[machine.address(address + i)] = true;
+        }
+    }
+}
+
+
+
+//////////////////////////////////////////////////
+// Output
+//////////////////////////////////////////////////
+
+QString Disassembler::generateListing()
+{
+    QString listing;
+    QTextStream stream(&listing);
+
+    stream << "; Desmontagem " << machine.getIdentifier() << " a partir do endereço " << entryAddress << "\n";
+    stream << "; Bytes não alcançados a partir do início são exibidos como dados\n";
+    stream << ";\n";
+    stream << "; End.  Bytes         Código\n";
+
+    int memorySize = machine.getMemorySize();
+    int address = 0;
+
+    while (address < memorySize)
+    {
+        QString bytesString, codeString;
+        int length = 1;
+
+        int blockIndex = graph.getBlockAt(address);
+        if (blockIndex >= 0)
+            stream << ";\n" << describeBlock(blockIndex) << "\n";
+
+        if (instructionStart[address])
+        {
+            int size = machine.decodeInstructionAt(address).size;
+
+            // Stop at the next instruction start if a jump lands inside this one
+            while (length < size && address + length < memorySize && !instructionStart[address + length])
+                length++;
+
+            bytesString = formatBytes(address, size);
+            codeString = formatInstructionAt(address);
+
+            if (length < size && address + length < memorySize)
+                codeString += " ; sobreposta";
+        }
+        else
+        {
+            int value = machine.getMemoryValue(address);
+
+            // Runs of unreached zeros (usually unused memory)
+            while (value == 0 && address + length < memorySize && !code[address + length] && machine.getMemoryValue(address + length) == 0)
+                length++;
+
+            bytesString = formatBytes(address, length);
+            codeString = (length > 1) ? QString("DAB [%1]").arg(length) : QString("DB %1").arg(value);
+        }
+
+        QString row = QString("%1  %2  %3").arg(address, 5).arg(bytesString, -12).arg(codeString);
+        while (row.endsWith(' '))
+            row.chop(1);
+
+        stream << row << "\n";
+        address += length;
+    }
+
+    stream.flush();
+    return listing;
+}
+
+QString Disassembler::generateDot(QString graphName)
+{
+    const QVector<ControlFlowGraph::BasicBlock> &blocks = graph.getBlocks();
+
+    QSet<int> loopHeaders;
+    foreach (const ControlFlowGraph::Loop &loop, graph.getLoops())
+        loopHeaders.insert(loop.header);
+
+    QString dot;
+    QTextStream stream(&dot);
+
+    graphName.replace("\\", "\\\\").replace("\"", "\\\"");
+
+    stream << "digraph \"" << graphName << "\"\n";
+    stream << "{\n";
+    stream << "    node [shape=box, fontname=\"monospace\"];\n";
+
+    bool hasUnknownSuccessor = false;
+
+    for (int i = 0; i < blocks.size(); i++)
+    {
+        QString label;
+        foreach (int address, blocks[i].instructionAddresses)
+            label += QString("%1: %2\\l").arg(address).arg(formatInstructionAt(address));
+
+        QString attributes;
+        if (blocks[i].start == entryAddress)
+            attributes += ", style=bold";
+        if (loopHeaders.contains(i))
+            attributes += ", peripheries=2";
+
+        stream << QString("    b%1 [label=\"%2\"%3];\n").arg(i).arg(label).arg(attributes);
+        hasUnknownSuccessor = hasUnknownSuccessor || blocks[i].hasUnknownSuccessor;
+    }
+
+    if (hasUnknownSuccessor)
+        stream << "    desconhecido [shape=ellipse, label=\"?\"];\n";
+
+    for (int i = 0; i < blocks.size(); i++)
+    {
+        foreach (ControlFlowGraph::Edge edge, blocks[i].successors)
+            stream << QString("    b%1 -> b%2%3;\n").arg(i).arg(edge.block).arg(edge.taken ? " [style=dashed]" : "");
+
+        if (blocks[i].hasUnknownSuccessor) // Indirect jump, subroutine return
+            stream << QString("    b%1 -> desconhecido [style=dotted];\n").arg(i);
+    }
+
+    stream << "}\n";
+    stream.flush();
+    return dot;
+}
+
+
+
+//////////////////////////////////////////////////
+// Instructions
+//////////////////////////////////////////////////
+
+bool Disassembler::isCode(int address) const
+{
+    return code[machine.address(address)];
+}
+
+bool Disassembler::isInstructionStart(int address) const
+{
+    return instructionStart[machine.address(address)];
+}
+
+QString Disassembler::formatInstructionAt(int address)
+{
+    DecodedInstruction decoded = machine.decodeInstructionAt(address);
+    Instruction *instruction = decoded.instruction;
+
+    if (instruction == nullptr) // Executed as NOP
+        return QString("DB %1").arg(machine.getMemoryValue(address));
+
+    QStringList parts;
+    parts.append(instruction->getMnemonic().toUpper());
+
+    foreach (QString argument, instruction->getArguments())
+    {
+        if (argument == "r")
+        {
+            parts.append((decoded.registerId != -1) ? machine.getRegisterName(decoded.registerId) : "?");
+        }
+        else if (argument == "a" || argument == "a0")
+        {
+            QString argumentString = QString::number(decoded.argument);
+            QString addressingModePattern = machine.getAddressingModePattern(decoded.addressingModeCode);
+
+            if (addressingModePattern != AddressingMode::NO_PATTERN)
+                argumentString = addressingModePattern.replace("(.*)", argumentString).toUpper();
+
+            parts.append(argumentString);
+        }
+        else if (argument == "a1")
+        {
+            parts.append(QString::number(decoded.secondArgument));
+        }
+    }
+
+    return parts.join(" ");
+}
+
+QString Disassembler::formatBytes(int address, int size)
+{
+    QStringList bytes;
+
+    for (int i = 0; i < qMin(size, 4); i++)
+        bytes.append(QString("%1").arg(machine.getMemoryValue(address + i), 2, 16, QChar('0')).toUpper());
+    if (size > 4)
+        bytes.append("...");
+
+    return bytes.join(" ");
+}
+
+QString Disassembler::describeBlock(int blockIndex)
+{
+    const ControlFlowGraph::BasicBlock &block = graph.getBlocks()[blockIndex];
+    QString description = QString("; Bloco %1: %2 instruções").arg(blockIndex).arg(block.instructionCount);
+
+    QStringList successors;
+    foreach (ControlFlowGraph::Edge edge, block.successors)
+        successors.append(QString::number(edge.block));
+    if (block.hasUnknownSuccessor)
+        successors.append("?");
+
+    description += (successors.isEmpty()) ? ", fim" : ", segue para " + successors.join(", ");
+
+    foreach (const ControlFlowGraph::Loop &loop, graph.getLoops())
+    {
+        if (loop.header == blockIndex)
+            description += QString(" (início de laço com %1 blocos)").arg(loop.blocks.size());
+    }
+
+    return description;
+}
@@ -0,0 +1,39 @@
+#ifndef DISASSEMBLER_H
+#define DISASSEMBLER_H
+
+#include <QString>
+#include <QVector>
+
+#include "controlflowgraph.h"
+#include "machine.h"
+
+/// Recursive-descent disassembly of the machine's memory, as loaded from a .mem file.
+///
+/// Only bytes reached by following control flow from the entry address (ControlFlowGraph,
+/// with each machine's jump, skip and JSR semantics) are shown as instructions; the rest is
+/// shown as data, with runs of zeros collapsed into a single DAB. Instructions overlapping a
+/// jump target are listed up to it, so both decodings appear.
+class Disassembler
+{
+public:
+    explicit Disassembler(Machine &machine, int entryAddress = 0);
+
+    QString generateListing();
+    QString generateDot(QString graphName = "hidra");
+
+    bool isCode(int address) const; // Byte of an instruction reached from the entry address
+    bool isInstructionStart(int address) const;
+    QString formatInstructionAt(int address); // Mnemonic, register and argument values
+
+private:
+    QString formatBytes(int address, int size);
+    QString describeBlock(int blockIndex);
+
+    Machine &machine;
+    int entryAddress;
+    ControlFlowGraph graph;
+    QVector<bool> code;
+    QVector<bool> instructionStart;
+};
+
+#endif // DISASSEMBLER_H
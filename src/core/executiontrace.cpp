@@ -0,0 +1,277 @@
+#include "executiontrace.h"
+
+ExecutionTrace::ExecutionTrace(int keyframeInterval, int maximumLength, qint64 maximumMemoryUsage) :
+    keyframeInterval(qMax(keyframeInterval, 1)),
+    maximumLength(maximumLength),
+    maximumMemoryUsage(maximumMemoryUsage)
+{
+    clear();
+}
+
+void ExecutionTrace::clear()
+{
+    keyframes.clear();
+    changeEnd.clear();
+    accesses.clear();
+    changes.clear();
+    currentState.clear();
+
+    keyframeMemoryUsage = 0;
+    firstInstructionCount = 0;
+    currentIndex = 0;
+    recording = false;
+    truncated = false;
+}
+
+
+
+//////////////////////////////////////////////////
+// Recording
+//////////////////////////////////////////////////
+
+void ExecutionTrace::resume(Machine &machine)
+{
+    if (currentState.isEmpty() || getComparableState(machine) != currentState)
+        start(machine); // Changed since it was left at a recorded state
+    else
+        truncate(currentIndex);
+
+    captureValues(machine);
+    currentState.clear(); // Unknown until finished
+
+    recording = true;
+    machine.setWriteLogEnabled(true);
+}
+
+void ExecutionTrace::recordStep(Machine &machine)
+{
+    if (!recording)
+        return;
+
+    if (getLength() >= maximumLength || getMemoryUsage() >= maximumMemoryUsage)
+    {
+        truncated = true;
+        recording = false;
+        machine.setWriteLogEnabled(false);
+        return;
+    }
+
+    foreach (int address, machine.getWriteLog())
+        addChange(MemoryChange, address, machine.getMemoryValue(address));
+    machine.clearWriteLog();
+
+    for (int id = 0; id < registers.size(); id++)
+    {
+        int value = machine.getRegisterValue(id);
+        if (value != registers[id])
+        {
+            addChange(RegisterChange, id, value);
+            registers[id] = value;
+        }
+    }
+
+    for (int id = 0; id < flags.size(); id++)
+    {
+        int value = machine.getFlagValue(id);
+        if (value != flags[id])
+        {
+            addChange(FlagChange, id, value);
+            flags[id] = value;
+        }
+    }
+
+    for (int address = 0; address < stack.size(); address++)
+    {
+        int value = machine.getStackValue(address);
+        if (value != stack[address])
+        {
+            addChange(StackChange, address, value);
+            stack[address] = value;
+        }
+    }
+
+    // Counters, stored as the step's increments
+    qint64 stepInstructions = machine.getInstructionCount() - instructionCount;
+    qint64 stepAccesses = machine.getAccessCount() - accessCount;
+
+    if (stepInstructions != 1) // Stopped by an error
+        addChange(CounterChange, 0, (int)stepInstructions);
+
+    if (stepAccesses < 0 || stepAccesses > 255)
+        addChange(CounterChange, 1, (int)stepAccesses);
+
+    accesses.append((stepAccesses >= 0 && stepAccesses <= 255) ? stepAccesses : 0);
+    instructionCount = machine.getInstructionCount();
+    accessCount = machine.getAccessCount();
+
+    changeEnd.append(changes.size());
+    currentIndex = getLength();
+
+    if (currentIndex % keyframeInterval == 0)
+        addKeyframe(machine);
+}
+
+void ExecutionTrace::finish(Machine &machine)
+{
+    machine.setWriteLogEnabled(false);
+    recording = false;
+
+    if (!truncated) // Otherwise the machine is past the recording
+        currentState = getComparableState(machine);
+}
+
+void ExecutionTrace::start(Machine &machine)
+{
+    clear();
+
+    firstInstructionCount = machine.getInstructionCount();
+    addKeyframe(machine);
+}
+
+void ExecutionTrace::truncate(int length)
+{
+    keyframes.resize(length / keyframeInterval + 1);
+    changeEnd.resize(length);
+
+    keyframeMemoryUsage = 0;
+    foreach (const QByteArray &checkpoint, keyframes)
+        keyframeMemoryUsage += checkpoint.size();
+
+    accesses.resize(length);
+    changes.resize((length > 0) ? changeEnd[length - 1] : 0);
+
+    currentIndex = length;
+    truncated = false;
+}
+
+void ExecutionTrace::captureValues(Machine &machine)
+{
+    registers.resize(machine.getNumberOfRegisters());
+    for (int id = 0; id < registers.size(); id++)
+        registers[id] = machine.getRegisterValue(id);
+
+    flags.resize(machine.getNumberOfFlags());
+    for (int id = 0; id < flags.size(); id++)
+        flags[id] = machine.getFlagValue(id);
+
+    stack.resize(machine.getStackSize());
+    for (int address = 0; address < stack.size(); address++)
+        stack[address] = machine.getStackValue(address);
+
+    instructionCount = machine.getInstructionCount();
+    accessCount = machine.getAccessCount();
+}
+
+void ExecutionTrace::addKeyframe(Machine &machine)
+{
+    keyframes.append(machine.saveCheckpoint());
+    keyframeMemoryUsage += keyframes.last().size();
+}
+
+void ExecutionTrace::addChange(ChangeKind kind, int index, int value)
+{
+    Change change = {((quint32)kind << 24) | (quint32)index, value};
+    changes.append(change);
+}
+
+
+
+//////////////////////////////////////////////////
+// Playback
+//////////////////////////////////////////////////
+
+bool ExecutionTrace::seek(Machine &machine, int index)
+{
+    if (index < 0 || index > getLength() || keyframes.isEmpty())
+        return false;
+
+    // Nearest keyframe at or before the index
+    int keyframe = index / keyframeInterval;
+    const QByteArray &checkpoint = keyframes[keyframe];
+    int breakpoint = machine.getBreakpoint(); // Not part of the recording
+
+    if (machine.loadCheckpoint((const uchar *)checkpoint.constData(), checkpoint.size()) != FileErrorCode::noError)
+        return false;
+
+    machine.setBreakpoint(breakpoint);
+
+    // Replay the changes up to the index
+    qint64 seekInstructionCount = machine.getInstructionCount();
+    qint64 seekAccessCount = machine.getAccessCount();
+
+    for (int step = keyframe * keyframeInterval; step < index; step++)
+    {
+        seekInstructionCount++;
+        seekAccessCount += accesses[step];
+
+        for (int i = (step > 0) ? changeEnd[step - 1] : 0; i < (int)changeEnd[step]; i++)
+        {
+            int target = changes[i].target & 0xFFFFFF;
+            int value = changes[i].value;
+
+            switch (changes[i].target >> 24)
+            {
+            case MemoryChange:   machine.setMemoryValue(target, value);   break;
+            case RegisterChange: machine.setRegisterValue(target, value); break;
+            case FlagChange:     machine.setFlagValue(target, value);     break;
+            case StackChange:    machine.setStackValue(target, value);    break;
+            case CounterChange:
+                if (target == 0)
+                    seekInstructionCount += value - 1; // Replaces the implied increment
+                else
+                    seekAccessCount += value; // Recorded as 0 in accesses
+                break;
+            }
+        }
+    }
+
+    machine.setCounters(seekInstructionCount, seekAccessCount);
+    machine.setRunning(false);
+
+    currentIndex = index;
+    currentState = getComparableState(machine);
+    return true;
+}
+
+
+
+//////////////////////////////////////////////////
+// Getters
+//////////////////////////////////////////////////
+
+int ExecutionTrace::getLength() const
+{
+    return changeEnd.size();
+}
+
+int ExecutionTrace::getCurrentIndex() const
+{
+    return currentIndex;
+}
+
+qint64 ExecutionTrace::getFirstInstructionCount() const
+{
+    return firstInstructionCount;
+}
+
+bool ExecutionTrace::isTruncated() const
+{
+    return truncated;
+}
+
+qint64 ExecutionTrace::getMemoryUsage() const
+{
+    return (qint64)changes.capacity() * sizeof(Change)
+         + (qint64)changeEnd.capacity() * sizeof(quint32)
+         + accesses.capacity()
+         + keyframeMemoryUsage;
+}
+
+QByteArray ExecutionTrace::getComparableState(Machine &machine)
+{
+    QByteArray state = machine.saveMemoryImage(true, false);
+    qint64 counters[2] = {machine.getInstructionCount(), machine.getAccessCount()};
+
+    state.append(reinterpret_cast<const char *>(counters), sizeof(counters));
+    return state;
+}
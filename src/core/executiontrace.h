@@ -0,0 +1,85 @@
+#ifndef EXECUTIONTRACE_H
+#define EXECUTIONTRACE_H
+
+#include <QByteArray>
+#include <QVector>
+
+#include "machine.h"
+
+/// Execution recorded instruction by instruction, so the machine can be shown at any point of it.
+///
+/// Every keyframeInterval instructions the recording keeps a full checkpoint; in between, each
+/// instruction stores only what it changed (written bytes, registers, flags, stack, counters).
+/// Seeking loads the checkpoint at or before the target and replays at most keyframeInterval
+/// instructions' changes, without executing anything.
+///
+/// Recording stops once it reaches maximumLength instructions or uses maximumMemoryUsage bytes.
+///
+/// A recording continues across runs and steps as long as the machine is left at a recorded state
+/// (its end or the last sought instruction); anything else (builds, edits, reset) starts a new one.
+class ExecutionTrace
+{
+public:
+    explicit ExecutionTrace(int keyframeInterval = DEFAULT_KEYFRAME_INTERVAL, int maximumLength = DEFAULT_MAXIMUM_LENGTH,
+                            qint64 maximumMemoryUsage = DEFAULT_MAXIMUM_MEMORY_USAGE);
+
+    void resume(Machine &machine); // Before executing, discards the instructions after the current one
+    void recordStep(Machine &machine); // After each Machine::step
+    void finish(Machine &machine); // After executing
+    void clear();
+
+    bool seek(Machine &machine, int index); // Restores the state after index instructions, false if not recorded
+
+    int getLength() const; // Instructions recorded
+    int getCurrentIndex() const; // Where the machine was left
+    qint64 getFirstInstructionCount() const; // Machine's instruction counter at index 0
+    bool isTruncated() const; // Maximum length or memory usage reached, later instructions weren't recorded
+    qint64 getMemoryUsage() const; // Bytes
+
+    static const int DEFAULT_KEYFRAME_INTERVAL = 1024;
+    static const int DEFAULT_MAXIMUM_LENGTH = 1 << 22;
+    static const qint64 DEFAULT_MAXIMUM_MEMORY_USAGE = 64 * 1024 * 1024; // Bytes
+
+private:
+    enum ChangeKind
+    {
+        MemoryChange,
+        RegisterChange,
+        FlagChange,
+        StackChange,
+        CounterChange // Instructions (0) or accesses (1) counted by the step, only when not implied by it
+    };
+
+    struct Change
+    {
+        quint32 target; // Kind in the top byte, address or id below
+        qint32 value;
+    };
+
+    void start(Machine &machine);
+    void truncate(int length);
+    void captureValues(Machine &machine); // Values later instructions are compared to
+    void addKeyframe(Machine &machine);
+    void addChange(ChangeKind kind, int index, int value);
+
+    static QByteArray getComparableState(Machine &machine); // Memory, registers, flags, stack and counters
+
+    int keyframeInterval, maximumLength;
+    qint64 maximumMemoryUsage;
+    qint64 keyframeMemoryUsage; // Bytes in keyframes, so getMemoryUsage doesn't visit them
+    qint64 firstInstructionCount;
+    int currentIndex;
+    bool recording, truncated;
+    QByteArray currentState; // Comparable state at currentIndex, when the machine was left there
+
+    QVector<QByteArray> keyframes; // Checkpoint after each multiple of keyframeInterval instructions
+    QVector<quint32> changeEnd; // Per instruction, end of its changes (they start at the previous end)
+    QVector<quint8> accesses; // Per instruction, memory accesses made (larger counts use a CounterChange)
+    QVector<Change> changes;
+
+    // Values after the last recorded instruction
+    QVector<int> registers, flags, stack;
+    qint64 instructionCount, accessCount;
+};
+
+#endif // EXECUTIONTRACE_H
@@ -0,0 +1,246 @@
+#include "expressionevaluator.h"
+
+#include "machine.h"
+
+// Intermediate results are kept within this range to avoid overflow
+static const qint64 MAX_MAGNITUDE = 0x7FFFFFFF;
+
+ExpressionEvaluator::ExpressionEvaluator(const QHash<QString, int> &labels, int currentAddress) :
+    labels(labels)
+{
+    this->currentAddress = currentAddress;
+    this->position = 0;
+}
+
+int ExpressionEvaluator::evaluate(QString expression)
+{
+    this->expression = expression;
+    this->position = 0;
+
+    qint64 value = parseBinary(0);
+
+    skipWhitespace();
+    if (position != this->expression.length()) // Trailing characters
+        throw Machine::invalidArgument;
+
+    return (int)value;
+}
+
+// Precedence climbing: consumes operators with precedence >= minimumPrecedence (all left-associative)
+qint64 ExpressionEvaluator::parseBinary(int minimumPrecedence)
+{
+    qint64 left = parseUnary();
+
+    Operator op;
+    int precedence, length;
+
+    while (peekOperator(op, precedence, length) && precedence >= minimumPrecedence)
+    {
+        position += length;
+        qint64 right = parseBinary(precedence + 1);
+        left = applyOperator(op, left, right);
+    }
+
+    return left;
+}
+
+qint64 ExpressionEvaluator::parseUnary()
+{
+    skipWhitespace();
+
+    if (peek() == '-')
+    {
+        position++;
+        return -parseUnary();
+    }
+    else if (peek() == '+')
+    {
+        position++;
+        return parseUnary();
+    }
+    else if (peek() == '~')
+    {
+        position++;
+        return ~parseUnary();
+    }
+
+    return parsePrimary();
+}
+
+qint64 ExpressionEvaluator::parsePrimary()
+{
+    skipWhitespace();
+    QChar character = peek();
+
+    // Parenthesized expression
+    if (character == '(')
+    {
+        position++;
+        qint64 value = parseBinary(0);
+        expect(')');
+        return value;
+    }
+
+    // Current location
+    if (character == '$')
+    {
+        position++;
+        return currentAddress;
+    }
+
+    // Decimal value
+    if (character.isDigit())
+    {
+        int start = position;
+
+        while (peek().isDigit())
+            position++;
+
+        if (position - start > 10)
+            throw Machine::invalidValue;
+
+        qint64 value = expression.mid(start, position - start).toLongLong();
+
+        if (value > MAX_MAGNITUDE)
+            throw Machine::invalidValue;
+
+        return value;
+    }
+
+    // Character
+    if (character == '\'')
+    {
+        if (peek(2) != '\'' || peek(1).isNull())
+            throw Machine::invalidArgument;
+
+        unsigned char value = (unsigned char)peek(1).toLatin1();
+        position += 3;
+        return value;
+    }
+
+    // Label, hexadecimal value or hi/lo operator
+    if (character.isLetter() || character == '_')
+        return parseIdentifier();
+
+    throw Machine::invalidArgument;
+}
+
+qint64 ExpressionEvaluator::parseIdentifier()
+{
+    static QRegExp hexadecimalValue("h[0-9a-f]{1,8}");
+
+    int start = position;
+
+    while (peek().isLetterOrNumber() || peek() == '_')
+        position++;
+
+    QString identifier = expression.mid(start, position - start).toLower();
+
+    // Byte selection operators
+    skipWhitespace();
+    if ((identifier == "hi" || identifier == "lo") && peek() == '(')
+    {
+        position++;
+        qint64 value = parseBinary(0);
+        expect(')');
+
+        return (identifier == "hi") ? ((value >> 8) & 0xFF) : (value & 0xFF);
+    }
+
+    // Labels take precedence over hexadecimal values (e.g. a label named "hff")
+    if (labels.contains(identifier))
+        return labels.value(identifier);
+
+    if (hexadecimalValue.exactMatch(identifier))
+    {
+        qint64 value = identifier.mid(1).toLongLong(nullptr, 16);
+
+        if (value > MAX_MAGNITUDE)
+            throw Machine::invalidValue;
+
+        return value;
+    }
+
+    throw Machine::invalidLabel;
+}
+
+qint64 ExpressionEvaluator::applyOperator(Operator op, qint64 left, qint64 right)
+{
+    qint64 result = 0;
+
+    switch (op)
+    {
+        case OR:  result = left | right; break;
+        case XOR: result = left ^ right; break;
+        case AND: result = left & right; break;
+        case ADD: result = left + right; break;
+        case SUB: result = left - right; break;
+        case MUL: result = left * right; break;
+
+        case SHIFT_LEFT:
+        case SHIFT_RIGHT:
+            if (right < 0 || right > 31)
+                throw Machine::invalidValue;
+
+            result = (op == SHIFT_LEFT) ? (left << right) : (left >> right);
+            break;
+
+        case DIV:
+        case MOD:
+            if (right == 0)
+                throw Machine::invalidValue;
+
+            result = (op == DIV) ? (left / right) : (left % right);
+            break;
+    }
+
+    if (result > MAX_MAGNITUDE || result < -MAX_MAGNITUDE)
+        throw Machine::invalidValue;
+
+    return result;
+}
+
+// Reads the operator at the current position without consuming it
+bool ExpressionEvaluator::peekOperator(Operator &op, int &precedence, int &length)
+{
+    skipWhitespace();
+    QChar character = peek();
+    length = 1;
+
+    if      (character == '|') { op = OR;  precedence = 1; }
+    else if (character == '^') { op = XOR; precedence = 2; }
+    else if (character == '&') { op = AND; precedence = 3; }
+    else if (character == '+') { op = ADD; precedence = 5; }
+    else if (character == '-') { op = SUB; precedence = 5; }
+    else if (character == '*') { op = MUL; precedence = 6; }
+    else if (character == '/') { op = DIV; precedence = 6; }
+    else if (character == '%') { op = MOD; precedence = 6; }
+    else if (character == '<' && peek(1) == '<') { op = SHIFT_LEFT;  precedence = 4; length = 2; }
+    else if (character == '>' && peek(1) == '>') { op = SHIFT_RIGHT; precedence = 4; length = 2; }
+    else
+        return false;
+
+    return true;
+}
+
+void ExpressionEvaluator::skipWhitespace()
+{
+    while (peek().isSpace())
+        position++;
+}
+
+QChar ExpressionEvaluator::peek(int offset) const
+{
+    int index = position + offset;
+    return (index < expression.length()) ? expression.at(index) : QChar();
+}
+
+void ExpressionEvaluator::expect(QChar character)
+{
+    skipWhitespace();
+
+    if (peek() != character)
+        throw Machine::invalidArgument;
+
+    position++;
+}
@@ -0,0 +1,50 @@
+#ifndef EXPRESSIONEVALUATOR_H
+#define EXPRESSIONEVALUATOR_H
+
+#include <QHash>
+#include <QString>
+
+/// Folds assembler operand expressions to constants.
+///
+/// Supports decimal and h-prefixed hexadecimal numbers, 'c' characters,
+/// labels, $ (address of the current statement), parentheses, unary + - ~,
+/// hi(x)/lo(x) byte selection and the binary operators below, from lowest to
+/// highest precedence:
+///
+///   |   ^   &   << >>   + -   * / %
+///
+/// Errors are thrown as Machine::ErrorCode: invalidLabel for undefined labels,
+/// invalidArgument for malformed expressions and invalidValue for arithmetic
+/// errors (division by zero, out-of-range shifts or results).
+class ExpressionEvaluator
+{
+public:
+    ExpressionEvaluator(const QHash<QString, int> &labels, int currentAddress);
+
+    int evaluate(QString expression);
+
+private:
+    enum Operator
+    {
+        OR, XOR, AND, SHIFT_LEFT, SHIFT_RIGHT, ADD, SUB, MUL, DIV, MOD
+    };
+
+    qint64 parseBinary(int minimumPrecedence);
+    qint64 parseUnary();
+    qint64 parsePrimary();
+    qint64 parseIdentifier();
+    qint64 applyOperator(Operator op, qint64 left, qint64 right);
+    bool peekOperator(Operator &op, int &precedence, int &length);
+
+    void skipWhitespace();
+    QChar peek(int offset = 0) const;
+    void expect(QChar character);
+
+    const QHash<QString, int> &labels;
+    int currentAddress;
+
+    QString expression;
+    int position;
+};
+
+#endif // EXPRESSIONEVALUATOR_H
@@ -12,6 +12,16 @@
  *******************************************************************************/
 
 #include "machine.h"
+#include "controlflowgraph.h"
+#include "expressionevaluator.h"
+#include "peepholeoptimizer.h"
+
+#include <QSaveFile>
+#include <QSignalBlocker>
+#include <QTextStream>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
 
 #define DEBUG_INT(value) qDebug(QString::number(value).toStdString().c_str());
 #define DEBUG_STRING(value) qDebug(value.toStdString().c_str());
@@ -21,6 +31,17 @@ Machine::Machine(QObject *parent) :
 {
     PC = nullptr;
     littleEndian = false;
+    currentStatementAddress = 0;
+    assemblerGeneration = 1;
+    instructionStringsValid = false;
+    instructionStringsPC = 0;
+    opcodeDecodings.resize(256);
+    opcodeDecoded.fill(false, 256);
+
+    peepholeOptimizationEnabled = false;
+    optimizationBytesSaved = 0;
+    optimizationInstructionsRemoved = 0;
+    writeLogEnabled = false;
  
     clearCounters();
     setBreakpoint(-1);
@@ -29,8 +50,6 @@ Machine::Machine(QObject *parent) :
 
 Machine::~Machine()
 {
-    qDeleteAll(memory);
-    qDeleteAll(assemblerMemory);
     qDeleteAll(registers);
     qDeleteAll(flags);
     qDeleteAll(instructions);
@@ -57,6 +76,7 @@ void Machine::step()
 void Machine::fetchInstruction()
 {
     // Read first byte
+    memoryActivity.executions[getPCValue() & memoryMask]++;
     fetchedValue = memoryReadNext();
     currentInstruction = getInstructionFromValue(fetchedValue);
 }
@@ -375,50 +395,108 @@ int Machine::toSigned(int unsignedByte)
 
 void Machine::assemble(QString sourceCode)
 {
-    running = false;
-    buildSuccessful = false;
-    firstErrorLine = -1;
+    //////////////////////////////////////////////////
+    // Simplify source code
+    //////////////////////////////////////////////////
 
+    QStringList sourceLines = sourceCode.split("\n"); // Split source code to individual lines
 
+    // Strip comments and extra spaces
+    for (int lineNumber = 0; lineNumber < sourceLines.size(); lineNumber++)
+        sourceLines[lineNumber] = simplifySourceLine(sourceLines[lineNumber]);
 
-    //////////////////////////////////////////////////
-    // Regular expressions
-    //////////////////////////////////////////////////
+    optimizationReport.clear();
+    optimizationBytesSaved = 0;
+    optimizationInstructionsRemoved = 0;
 
-    // Regular expression to capture comments
-    static QString CHARS_EXCEPT_QUOTE_SEMICOLON = "[^';]*";
-    static QString STRING = "(?:'[^']*')";
-    static QString COMMENT = "(;.*)$";
+    assembleLines(sourceLines, !peepholeOptimizationEnabled); // The optimizer copies its final build
 
-    static QString commentsPattern = "^(?:" + CHARS_EXCEPT_QUOTE_SEMICOLON + STRING + "?)*" + COMMENT;
-    static QRegExp matchComments(commentsPattern);
+    if (buildSuccessful && peepholeOptimizationEnabled)
+        optimizeAssembledLines(sourceLines);
 
-    static QRegExp validLabel("[a-z_][a-z0-9_]*"); // Validates label names (must start with a letter/underline, may have numbers)
-    static QRegExp whitespace("\\s+");
+    if (buildSuccessful)
+        clearAfterBuild();
+}
 
+// Source code is only indexed by line start; each pass decodes and simplifies one line at a time
+void Machine::assembleUtf8(const char *data, qint64 size)
+{
+    QVector<qint64> lineStart;
+    lineStart.append(0);
 
+    for (const char *newline = (const char *) memchr(data, '\n', size);
+         newline != nullptr;
+         newline = (const char *) memchr(newline + 1, '\n', size - (newline + 1 - data)))
+    {
+        lineStart.append(newline + 1 - data);
+    }
 
-    //////////////////////////////////////////////////
-    // Simplify source code
-    //////////////////////////////////////////////////
+    lineStart.append(size + 1); // Sentinel, as if the text ended with a line break
 
-    QStringList sourceLines = sourceCode.split("\n"); // Split source code to individual lines
+    auto readLine = [this, data, &lineStart](int lineNumber)
+    {
+        qint64 start = lineStart[lineNumber];
+        int length = (int) (lineStart[lineNumber + 1] - 1 - start); // Without the '\n'
+        return simplifySourceLine(QString::fromUtf8(data + start, length));
+    };
 
-    // Strip comments and extra spaces
-    for (int lineNumber = 0; lineNumber < sourceLines.size(); lineNumber++)
+    optimizationReport.clear();
+    optimizationBytesSaved = 0;
+    optimizationInstructionsRemoved = 0;
+
+    assembleLines(lineStart.size() - 1, readLine, !peepholeOptimizationEnabled); // The optimizer copies its final build
+
+    if (buildSuccessful && peepholeOptimizationEnabled) // Rewrites need the lines in memory
     {
-        // Convert literal quotes to special symbol
-        sourceLines[lineNumber].replace("''''", "'" + QUOTE_SYMBOL); // '''' -> 'QUOTE_SYMBOL
-        sourceLines[lineNumber].replace("'''", QUOTE_SYMBOL); // ''' -> QUOTE_SYMBOL
+        QStringList sourceLines;
+        for (int lineNumber = 0; lineNumber < lineStart.size() - 1; lineNumber++)
+            sourceLines.append(readLine(lineNumber));
+
+        optimizeAssembledLines(sourceLines);
+    }
+
+    if (buildSuccessful)
+        clearAfterBuild();
+}
+
+FileErrorCode::FileErrorCode Machine::assembleFile(QString filename)
+{
+    QFile file(filename);
 
-        // Remove comments
-        if (matchComments.exactMatch(sourceLines[lineNumber]))
-            sourceLines[lineNumber].replace(matchComments.cap(1), "");
+    if (!file.open(QFile::ReadOnly))
+        return FileErrorCode::inputOutput;
 
-        // Trim whitespace
-        sourceLines[lineNumber] = sourceLines[lineNumber].trimmed();
+    if (file.size() == 0) // Can't map an empty file
+    {
+        assembleUtf8("", 0);
+        return FileErrorCode::noError;
     }
 
+    uchar *data = file.map(0, file.size());
+    if (data == nullptr)
+        return FileErrorCode::inputOutput;
+
+    assembleUtf8((const char *) data, file.size());
+
+    file.unmap(data);
+    return FileErrorCode::noError;
+}
+
+void Machine::assembleLines(QStringList sourceLines, bool copyToMemory)
+{
+    assembleLines(sourceLines.size(), [&sourceLines](int lineNumber) { return sourceLines.at(lineNumber); }, copyToMemory);
+}
+
+// Runs both assembler passes over simplified source lines (no comments, trimmed), reading each line once per pass
+void Machine::assembleLines(int numberOfLines, std::function<QString(int)> readLine, bool copyToMemory)
+{
+    static QRegExp validLabel("[a-z_][a-z0-9_]*"); // Validates label names (must start with a letter/underline, may have numbers)
+    static QRegExp whitespace("\\s+");
+
+    running = false;
+    buildSuccessful = false;
+    firstErrorLine = -1;
+
 
 
     //////////////////////////////////////////////////
@@ -428,17 +506,19 @@ void Machine::assemble(QString sourceCode)
     clearAssemblerData();
     PC->setValue(0);
 
-    for (int lineNumber = 0; lineNumber < sourceLines.size(); lineNumber++)
+    for (int lineNumber = 0; lineNumber < numberOfLines; lineNumber++)
     {
         try
         {
+            QString sourceLine = readLine(lineNumber);
+
             //////////////////////////////////////////////////
             // Read labels
             //////////////////////////////////////////////////
 
-            if (sourceLines[lineNumber].contains(":")) // If getLabel found a label
+            if (sourceLine.contains(":")) // If getLabel found a label
             {
-                QString labelName = sourceLines[lineNumber].section(":", 0, 0);
+                QString labelName = sourceLine.section(":", 0, 0);
 
                 // Check for invalid or duplicated label
                 if (!validLabel.exactMatch(labelName.toLower()))
@@ -448,16 +528,18 @@ void Machine::assemble(QString sourceCode)
 
                 labelPCMap.insert(labelName.toLower(), PC->getValue()); // Add to map
                 addressCorrespondingLabel[PC->getValue()] = labelName;
-                sourceLines[lineNumber] = sourceLines[lineNumber].replace(labelName + ":", "").trimmed(); // Remove label from sourceLines
+                sourceLine = removeLabel(sourceLine);
             }
 
             //////////////////////////////////////////////////
             // Reserve memory for instructions/directives
             //////////////////////////////////////////////////
 
-            if (!sourceLines[lineNumber].isEmpty())
+            if (!sourceLine.isEmpty())
             {
-                QString mnemonic = sourceLines[lineNumber].section(whitespace, 0, 0).toLower();
+                currentStatementAddress = PC->getValue();
+                QString mnemonic = sourceLine.section(whitespace, 0, 0).toLower();
+                QString arguments = removeExpressionWhitespace(sourceLine.section(whitespace, 1)); // Everything after mnemonic
 
                 const Instruction *instruction = getInstructionFromMnemonic(mnemonic);
                 if (instruction != NULL)
@@ -466,7 +548,7 @@ void Machine::assemble(QString sourceCode)
 
                     if (numBytes == 0) // If instruction has variable number of bytes
                     {
-                        QString addressArgument = sourceLines[lineNumber].section(whitespace, -1); // Last argument
+                        QString addressArgument = arguments.section(whitespace, -1); // Last argument
                         numBytes = calculateBytesToReserve(addressArgument);
                     }
 
@@ -474,7 +556,6 @@ void Machine::assemble(QString sourceCode)
                 }
                 else // Directive
                 {
-                    QString arguments = sourceLines[lineNumber].section(whitespace, 1); // Everything after mnemonic
                     obeyDirective(mnemonic, arguments, true, lineNumber);
                 }
             }
@@ -496,19 +577,22 @@ void Machine::assemble(QString sourceCode)
     // SECOND PASS: Build instructions/defines
     //////////////////////////////////////////////////
 
-    sourceLineCorrespondingAddress.fill(-1, sourceLines.size());
+    sourceLineCorrespondingAddress.fill(-1, numberOfLines);
     PC->setValue(0);
 
-    for (int lineNumber = 0; lineNumber < sourceLines.size(); lineNumber++)
+    for (int lineNumber = 0; lineNumber < numberOfLines; lineNumber++)
     {
         try
         {
             sourceLineCorrespondingAddress[lineNumber] = PC->getValue();
+            currentStatementAddress = PC->getValue();
 
-            if (!sourceLines[lineNumber].isEmpty())
+            QString sourceLine = removeLabel(readLine(lineNumber)); // Labels were validated by the first pass
+
+            if (!sourceLine.isEmpty())
             {
-                QString mnemonic  = sourceLines[lineNumber].section(whitespace, 0, 0).toLower();
-                QString arguments = sourceLines[lineNumber].section(whitespace, 1); // Everything after mnemonic
+                QString mnemonic  = sourceLine.section(whitespace, 0, 0).toLower();
+                QString arguments = removeExpressionWhitespace(sourceLine.section(whitespace, 1)); // Everything after mnemonic
 
                 const Instruction *instruction = getInstructionFromMnemonic(mnemonic);
                 if (instruction != NULL)
@@ -536,14 +620,15 @@ void Machine::assemble(QString sourceCode)
 
     buildSuccessful = true;
 
-    copyAssemblerMemoryToMemory();
-    clearAfterBuild();
+    if (copyToMemory)
+        copyAssemblerMemoryToMemory();
 }
 
 // Mnemonic must be lowercase
 void Machine::obeyDirective(QString mnemonic, QString arguments, bool reserveOnly, int sourceLine)
 {
     static QRegExp whitespace("\\s+");
+    static QRegExp matchDataDirective("db|dw|dab|daw");
 
     if (mnemonic == "org")
     {
@@ -552,19 +637,50 @@ void Machine::obeyDirective(QString mnemonic, QString arguments, bool reserveOnl
 
         if (numberOfArguments != 1)
             throw wrongNumberOfArguments;
-        if (!isValidOrg(argumentList.first()))
+
+        // Labels used by ORG must be defined before it, as the expression is also evaluated during the first pass
+        int origin = argumentToValue(argumentList.first(), false);
+        if (origin < 0)
             throw invalidAddress;
 
-        PC->setValue(stringToInt(argumentList.first()));
+        PC->setValue(origin);
     }
-    else if (QRegExp("db|dw|dab|daw").exactMatch(mnemonic))
+    else if (matchDataDirective.exactMatch(mnemonic))
     {
+        int bytesPerArgument = (mnemonic == "db" || mnemonic == "dab") ? 1 : 2;
+        bool isArray = (mnemonic == "dab" || mnemonic == "daw") ? true : false;
+
+        // Fast path: only numbers and strings, written without building an argument list
+        QVector<qint64> values;
+        if (parseLiteralArguments(arguments, values))
+        {
+            if (!isArray && values.size() > 1) // Too many arguments
+                throw wrongNumberOfArguments;
+
+            if (reserveOnly)
+            {
+                reserveAssemblerMemory(values.size() * bytesPerArgument, sourceLine); // Increments PC
+                return;
+            }
+
+            int maxValue = (bytesPerArgument == 1) ? 255 : 65535;
+            int minValue = (bytesPerArgument == 1) ? -128 : -32768;
+
+            foreach (qint64 value, values)
+            {
+                if (value < minValue || value > maxValue)
+                    throw invalidValue;
+
+                setAssemblerMemoryNextValue((int)value, bytesPerArgument);
+            }
+
+            return;
+        }
+
         QStringList argumentList;
         argumentList = splitDirectiveArguments(arguments);
 
         int numberOfArguments = argumentList.size();
-        int bytesPerArgument = (mnemonic == "db" || mnemonic == "dab") ? 1 : 2;
-        bool isArray = (mnemonic == "dab" || mnemonic == "daw") ? true : false;
 
         if (bytesPerArgument == 1 && numberOfArguments == 0)
         {
@@ -605,22 +721,7 @@ void Machine::obeyDirective(QString mnemonic, QString arguments, bool reserveOnl
             {
                 // TODO: Should DAB/DAW disallow labels as in Daedalus?
                 int value = argumentToValue(argument, true, bytesPerArgument);
-
-                // Write value
-                if (bytesPerArgument == 2 && littleEndian)
-                {
-                    setAssemblerMemoryNext( value       & 0xFF); // Least significant byte first
-                    setAssemblerMemoryNext((value >> 8) & 0xFF);
-                }
-                else if (bytesPerArgument == 2) // Big endian
-                {
-                    setAssemblerMemoryNext((value >> 8) & 0xFF); // Most significant byte first
-                    setAssemblerMemoryNext( value       & 0xFF);
-                }
-                else
-                {
-                    setAssemblerMemoryNext(value & 0xFF);
-                }
+                setAssemblerMemoryNextValue(value, bytesPerArgument);
             }
         }
     }
@@ -774,35 +875,101 @@ void Machine::emitError(int lineNumber, Machine::ErrorCode errorCode)
 }
 
 
+// Unreserves every address by starting a new generation, clearing only the previous build's footprint
 void Machine::clearAssemblerData()
 {
-    for (int i=0; i<assemblerMemory.size(); i++)
+    foreach (MemoryRange range, reservedRanges)
+        std::fill(assemblerMemory.begin() + range.start, assemblerMemory.begin() + range.end, Byte());
+
+    reservedRanges.clear();
+    assemblerGeneration++;
+
+    if (assemblerGeneration == 0) // Wrapped around, old stamps could match again
     {
-        assemblerMemory[i]->setValue(0);
-        reserved[i] = false;
-        addressCorrespondingSourceLine[i] = -1;
-        addressCorrespondingLabel[i] = "";
+        reservedGeneration.fill(0);
+        assemblerGeneration = 1;
     }
 
+    addressCorrespondingLabel.clear();
     sourceLineCorrespondingAddress.clear();
     labelPCMap.clear();
 }
 
 void Machine::setAssemblerMemoryNext(int value)
 {
-    assemblerMemory[PC->getValue()]->setValue(value);
+    if (isReserved(PC->getValue())) // Keeps the image clear outside the build's footprint
+        assemblerMemory[PC->getValue()].setValue(value);
+
     incrementPCValue();
 }
 
-// Copies assemblerMemory to machine's memory
+// Writes a DB/DW value with the machine's endianness
+void Machine::setAssemblerMemoryNextValue(int value, int numberOfBytes)
+{
+    if (numberOfBytes == 2 && littleEndian)
+    {
+        setAssemblerMemoryNext( value       & 0xFF); // Least significant byte first
+        setAssemblerMemoryNext((value >> 8) & 0xFF);
+    }
+    else if (numberOfBytes == 2) // Big endian
+    {
+        setAssemblerMemoryNext((value >> 8) & 0xFF); // Most significant byte first
+        setAssemblerMemoryNext( value       & 0xFF);
+    }
+    else
+    {
+        setAssemblerMemoryNext(value & 0xFF);
+    }
+}
+
+// Copies assemblerMemory to machine's memory, skipping identical chunks with memcmp.
+// Changed addresses are added to changedRanges.
 void Machine::copyAssemblerMemoryToMemory()
 {
-    for (int i=0; i<memory.size(); i++)
+    static_assert(sizeof(Byte) == 1, "Memory images are compared as raw bytes");
+    const int CHUNK_SIZE = 64;
+
+    const char *image    = reinterpret_cast<const char *>(assemblerMemory.constData());
+    const char *contents = reinterpret_cast<const char *>(memory.constData());
+    QVector<MemoryRange> copiedRanges;
+
+    for (int chunk = 0; chunk < memory.size(); chunk += CHUNK_SIZE)
+    {
+        int chunkEnd = qMin(chunk + CHUNK_SIZE, memory.size());
+
+        if (std::memcmp(image + chunk, contents + chunk, chunkEnd - chunk) == 0)
+            continue;
+
+        for (int i = chunk; i < chunkEnd; i++)
+        {
+            // Copy only different values to avoid marking bytes as changed
+            if (image[i] == contents[i])
+                continue;
+
+            setMemoryValue(i, assemblerMemory[i].getValue());
+
+            if (!copiedRanges.isEmpty() && copiedRanges.last().end == i)
+                copiedRanges.last().end++;
+            else
+                copiedRanges.append(MemoryRange{i, i + 1});
+        }
+    }
+
+    // Merge with ranges not yet taken (sorted and disjoint)
+    changedRanges += copiedRanges;
+    std::sort(changedRanges.begin(), changedRanges.end(),
+              [](const MemoryRange &a, const MemoryRange &b) { return a.start < b.start; });
+
+    QVector<MemoryRange> mergedRanges;
+    foreach (MemoryRange range, changedRanges)
     {
-        // Copy only different values to avoid marking bytes as changed
-        if (getMemoryValue(i) != assemblerMemory[i]->getValue())
-            setMemoryValue(i, assemblerMemory[i]->getValue());
+        if (!mergedRanges.isEmpty() && range.start <= mergedRanges.last().end)
+            mergedRanges.last().end = qMax(mergedRanges.last().end, range.end);
+        else
+            mergedRanges.append(range);
     }
+
+    changedRanges = mergedRanges;
 }
 
 // Reserve 'sizeToReserve' bytes starting from PC, associate addresses with a source line. Throws exception on overlap.
@@ -810,10 +977,9 @@ void Machine::reserveAssemblerMemory(int sizeToReserve, int associatedSourceLine
 {
     while (sizeToReserve > 0)
     {
-        if (!reserved[PC->getValue()])
+        if (!isReserved(PC->getValue()))
         {
-            reserved[PC->getValue()] = true;
-            addressCorrespondingSourceLine[PC->getValue()] = associatedSourceLine;
+            reserveAssemblerAddress(PC->getValue(), associatedSourceLine);
             incrementPCValue();
             sizeToReserve--;
         }
@@ -822,48 +988,31 @@ void Machine::reserveAssemblerMemory(int sizeToReserve, int associatedSourceLine
     }
 }
 
-// Method for machines that require the addressing mode to reserve memory.
-int Machine::calculateBytesToReserve(QString)
-{
-    return 0;
-}
-
-bool Machine::isValidValue(QString valueString, int min, int max)
+void Machine::reserveAssemblerAddress(int address, int associatedSourceLine)
 {
-    bool ok;
-    int value;
+    reservedGeneration[address] = assemblerGeneration;
+    addressCorrespondingSourceLine[address] = associatedSourceLine;
 
-    if (valueString.left(1).toLower() == "h")
-        value = valueString.mid(1).toInt(&ok, 16); // Remove "h"
+    if (!reservedRanges.isEmpty() && reservedRanges.last().end == address)
+        reservedRanges.last().end++;
     else
-        value = valueString.toInt(&ok, 10);
-
-    // Returns true if conversion ok and value between min and max
-    return (ok && value >= min && value <= max);
-}
-
-// Checks if string is a valid number for the machine
-bool Machine::isValidNBytesValue(QString valueString, int n)
-{
-    if (n == 1)
-        return isValidValue(valueString, -128, 255);
-    else
-        return isValidValue(valueString, -32768, 65535);
+        reservedRanges.append(MemoryRange{address, address + 1});
 }
 
-bool Machine::isValidByteValue(QString valueString)
+bool Machine::isReserved(int address) const
 {
-    return isValidValue(valueString, -128, 255);
+    return (address >= 0 && address < reservedGeneration.size() && reservedGeneration[address] == assemblerGeneration);
 }
 
-bool Machine::isValidAddress(QString addressString) // Allows negative values for offsets
+int Machine::getAssemblerMemoryValue(int address) const
 {
-    return isValidValue(addressString, -memory.size(), memory.size()-1);
+    return assemblerMemory[address].getValue();
 }
 
-bool Machine::isValidOrg(QString offsetString)
+// Method for machines that require the addressing mode to reserve memory.
+int Machine::calculateBytesToReserve(QString)
 {
-    return isValidValue(offsetString, 0, memory.size()-1);
+    return 0;
 }
 
 QStringList Machine::splitDirectiveArguments(QString arguments)
@@ -932,6 +1081,90 @@ QStringList Machine::splitDirectiveArguments(QString arguments)
     return finalArgumentList;
 }
 
+// Fast path of splitDirectiveArguments + argumentToValue for lists of decimal/hexadecimal numbers
+// and strings. Returns false if anything else is found (labels, expressions, allocation, errors),
+// leaving the arguments to the general path. Range checks are left to the caller.
+bool Machine::parseLiteralArguments(const QString &arguments, QVector<qint64> &values)
+{
+    const QChar *text = arguments.constData();
+    int length = arguments.length();
+    int position = 0;
+
+    while (position < length && text[position].isSpace())
+        position++;
+
+    if (position == length)
+        return false; // No arguments (DB defaults to 0)
+
+    while (position < length)
+    {
+        // String: one value per character
+        if (text[position] == '\'')
+        {
+            int end = arguments.indexOf('\'', position + 1);
+            if (end <= position + 1)
+                return false; // Unterminated or empty
+
+            for (int i = position + 1; i < end; i++)
+            {
+                if (text[i] == QUOTE_SYMBOL.at(0))
+                    return false;
+
+                values.append((unsigned char)text[i].toLatin1());
+            }
+
+            position = end + 1;
+        }
+
+        // Number, optionally negative
+        else
+        {
+            bool isNegative = (text[position] == '-');
+            if (isNegative)
+                position++;
+
+            bool isHexadecimal = (position < length && text[position].toLower() == 'h');
+            int start = (isHexadecimal) ? position + 1 : position;
+            int end = start;
+
+            while (end < length)
+            {
+                ushort c = text[end].unicode();
+                bool isDigit = (c >= '0' && c <= '9') || (isHexadecimal && (c | 0x20) >= 'a' && (c | 0x20) <= 'f');
+
+                if (!isDigit)
+                    break;
+
+                end++;
+            }
+
+            int maxDigits = (isHexadecimal) ? 8 : 10;
+            if (end == start || end - start > maxDigits)
+                return false;
+
+            // Token must end at a separator or string
+            if (end < length && !text[end].isSpace() && text[end] != ',' && text[end] != '\'')
+                return false;
+
+            // Labels take precedence over hexadecimal values
+            if (isHexadecimal && labelPCMap.contains(arguments.mid(position, end - position).toLower()))
+                return false;
+
+            qint64 value = (isHexadecimal) ? arguments.mid(start, end - start).toLongLong(nullptr, 16)
+                                           : arguments.mid(start, end - start).toLongLong();
+            values.append((isNegative) ? -value : value);
+
+            position = end;
+        }
+
+        // Separators
+        while (position < length && (text[position].isSpace() || text[position] == ','))
+            position++;
+    }
+
+    return true;
+}
+
 void Machine::extractArgumentAddressingModeCode(QString &argument, AddressingMode::AddressingModeCode &addressingModeCode)
 {
     addressingModeCode = getDefaultAddressingModeCode();
@@ -950,47 +1183,42 @@ void Machine::extractArgumentAddressingModeCode(QString &argument, AddressingMod
     }
 }
 
+// Evaluates an operand expression (labels, $, arithmetic, hi/lo) and validates the result's range
 int Machine::argumentToValue(QString argument, bool isImmediate, int immediateNumBytes)
 {
-    static QRegExp matchChar("'.'");
-    static QRegExp labelOffset("(.+)(\\+|\\-)(.+)"); // (label) (+|-) (offset)
+    // Immediate quote (''' or '''')
+    argument.replace("'" + QUOTE_SYMBOL, "39");
+    argument.replace(QUOTE_SYMBOL, "39");
 
-    // Convert label with +/- offset to number
-    if (labelOffset.exactMatch(argument.toLower()))
-    {
-        int sign = (labelOffset.cap(2) == "+") ? +1 : -1;
-
-        if (!labelPCMap.contains(labelOffset.cap(1))) // Validate label
-            throw invalidLabel;
-        if (!isValidAddress(labelOffset.cap(3))) // Validate offset
-            throw invalidArgument;
+    ExpressionEvaluator evaluator(labelPCMap, currentStatementAddress);
+    int value;
 
-        // Argument = Label + Offset
-        argument = QString::number(labelPCMap.value(labelOffset.cap(1)) + sign*stringToInt(labelOffset.cap(3)));
+    try
+    {
+        value = evaluator.evaluate(argument);
+    }
+    catch (ErrorCode errorCode)
+    {
+        if (errorCode == invalidArgument) // Malformed expression
+            throw (isImmediate) ? invalidValue : invalidAddress;
+        throw;
     }
-
-    // Convert label to number string
-    if (labelPCMap.contains(argument.toLower()))
-        argument = QString::number(labelPCMap.value(argument.toLower()));
 
     if (isImmediate)
     {
-        if (argument.contains(QUOTE_SYMBOL)) // Immediate quote
-            return (int)'\'';
-        else if (matchChar.exactMatch(argument)) // Immediate char
-            return (int)argument.at(1).toLatin1();
-        else if (isValidNBytesValue(argument, immediateNumBytes)) // Immediate hex/dec value
-            return stringToInt(argument);
-        else
+        int maxValue = (immediateNumBytes == 1) ? 255 : 65535;
+        int minValue = (immediateNumBytes == 1) ? -128 : -32768;
+
+        if (value < minValue || value > maxValue)
             throw invalidValue;
     }
     else
     {
-        if (isValidAddress(argument)) // Address
-            return stringToInt(argument);
-        else
+        if (value < -memory.size() || value > memory.size() - 1) // Allows negative values for offsets
             throw invalidAddress;
     }
+
+    return value;
 }
 
 int Machine::stringToInt(QString valueString)
@@ -1001,150 +1229,1329 @@ int Machine::stringToInt(QString valueString)
         return valueString.toInt(NULL, 10);
 }
 
+QString Machine::simplifySourceLine(QString sourceLine)
+{
+    // Regular expression to capture comments
+    static QString CHARS_EXCEPT_QUOTE_SEMICOLON = "[^';]*";
+    static QString STRING = "(?:'[^']*')";
+    static QString COMMENT = "(;.*)$";
 
+    static QString commentsPattern = "^(?:" + CHARS_EXCEPT_QUOTE_SEMICOLON + STRING + "?)*" + COMMENT;
+    static QRegExp matchComments(commentsPattern);
 
-//////////////////////////////////////////////////
-// Memory read/write with access count
-//////////////////////////////////////////////////
+    // Convert literal quotes to special symbol
+    sourceLine.replace("''''", "'" + QUOTE_SYMBOL); // '''' -> 'QUOTE_SYMBOL
+    sourceLine.replace("'''", QUOTE_SYMBOL); // ''' -> QUOTE_SYMBOL
 
-int Machine::memoryRead(int address)
-{
-    accessCount++;
-    return getMemoryValue(address);
-}
+    // Remove comments
+    if (matchComments.exactMatch(sourceLine))
+        sourceLine.replace(matchComments.cap(1), "");
 
-void Machine::memoryWrite(int address, int value)
-{
-    accessCount++;
-    setMemoryValue(address, value);
+    // Trim whitespace
+    return sourceLine.trimmed();
 }
 
-int Machine::memoryReadNext()
+QString Machine::removeLabel(QString sourceLine)
 {
-    int value = memoryRead(getPCValue());
-    incrementPCValue();
-    return value;
+    if (sourceLine.contains(":"))
+        sourceLine = sourceLine.replace(sourceLine.section(":", 0, 0) + ":", "");
+
+    return sourceLine.trimmed();
 }
 
-int Machine::GetCurrentOperandAddress()
+// Whitespace is part of an expression inside parentheses, after an operator or before a binary one,
+// e.g. "tabela + 2" or "(base * 2)". A sign directly before an operand starts a new argument instead,
+// so "A -5" is still a register and a value. Strings are kept as they are.
+QString Machine::removeExpressionWhitespace(QString const& arguments)
 {
+    static QString OPERATORS_BEFORE_OPERAND = "|^&+-*/%<>~(";
+    static QString BINARY_OPERATORS = "|^&*/%<>)";
 
-    int immediateAddress = decodedImmediateAddress; 
-    AddressingMode::AddressingModeCode addressingModeCode = decodedAdressingModeCode1;
+    QString result;
+    result.reserve(arguments.size());
 
-    switch (addressingModeCode)
+    int parenthesesDepth = 0;
+    bool isString = false;
+
+    for (int i = 0; i < arguments.size(); i++)
     {
-        case AddressingMode::DIRECT:
-            return memoryRead(immediateAddress);
+        QChar c = arguments.at(i);
 
-        case AddressingMode::INDIRECT:
-            return memoryRead(memoryRead(immediateAddress));
+        if (c == '\'')
+            isString = !isString;
 
-        case AddressingMode::IMMEDIATE:
-            return immediateAddress;
+        if (isString || !c.isSpace())
+        {
+            if (!isString && c == '(')
+                parenthesesDepth++;
+            else if (!isString && c == ')')
+                parenthesesDepth--;
 
-        case AddressingMode::INDEXED_BY_X:
-            return address(memoryRead(immediateAddress) + getRegisterValue("X"));
+            result.append(c);
+            continue;
+        }
 
-        case AddressingMode::INDEXED_BY_PC:
-            return address(memoryRead(immediateAddress) + getRegisterValue("PC"));
+        // Whitespace run, kept only if it separates two arguments
+        int end = i;
+        while (end < arguments.size() && arguments.at(end).isSpace())
+            end++;
 
-        default:
-            return 0;
-    }
-}
+        QChar previous = result.isEmpty() ? QChar() : result.at(result.size() - 1);
+        QChar next     = (end     < arguments.size()) ? arguments.at(end)     : QChar();
+        QChar nextNext = (end + 1 < arguments.size()) ? arguments.at(end + 1) : QChar();
 
-int Machine::GetCurrentOperandValue()
-{
-    return memoryRead(GetCurrentOperandAddress()); // Return 1-byte value
-}
+        bool isInsideExpression = parenthesesDepth > 0
+                || (!previous.isNull() && OPERATORS_BEFORE_OPERAND.contains(previous))
+                || (!next.isNull() && BINARY_OPERATORS.contains(next))
+                || ((next == '+' || next == '-') && nextNext.isSpace());
 
-int Machine::GetCurrentJumpAddress()
-{
-    return GetCurrentOperandAddress();
+        if (!isInsideExpression)
+            result.append(arguments.midRef(i, end - i));
+
+        i = end - 1;
+    }
+
+    return result;
 }
 
 
 
 //////////////////////////////////////////////////
-// Import/Export memory
+// Peephole optimization
 //////////////////////////////////////////////////
 
-// Returns true if successful
-FileErrorCode::FileErrorCode Machine::importMemory(QString filename, int start, int end, int dest)
+// Applies the optimizer's rewrites, keeping them only if the rewritten program assembles and every
+// other instruction still refers to the same code/data. The rewrites found in one pass don't share
+// lines, so they are validated together with a single trial build; if that fails, the batch is split
+// in halves until the rejected rewrites are isolated. Searches again until a pass accepts nothing.
+// Trial builds stay in the assembler's image, and only the final build is copied to memory.
+void Machine::optimizeAssembledLines(QStringList sourceLines)
 {
-    if(start < 0 || end > memory.size()){
-        return FileErrorCode::invalidAddress;
-    }
-    
-    char byte;
-    QFile memFile(filename); // Implicitly closed
+    typedef PeepholeOptimizer::Rewrite Rewrite;
 
-    // Open file
-    memFile.open(QFile::ReadOnly);
+    PeepholeOptimizer optimizer(*this);
+    bool buildMatchesSourceLines = true;
+    bool rewriteApplied = true;
 
-    // The file must contain the identifier's length, the machine's identifier and twice the amount of memory
-    if (memFile.size() != 1 + identifier.length() + memory.size() * 2)
-        return FileErrorCode::incorrectSize;
+    while (rewriteApplied)
+    {
+        rewriteApplied = false;
+        PeepholeOptimizer::Build originalBuild = optimizer.captureBuild(sourceLines);
 
-    // Read identifier length
-    memFile.getChar(&byte);
-    if (byte != identifier.length())
-        return FileErrorCode::invalidIdentifier; // Incorrect identifier length
+        QVector<Rewrite> accepted;
+        QVector<QVector<Rewrite>> pendingBatches;
+        pendingBatches.append(optimizer.findRewrites(originalBuild));
 
-    // Read identifier
-    for (int i = 0; i < identifier.length(); i++)
-    {
-        memFile.getChar(&byte);
+        while (!pendingBatches.isEmpty())
+        {
+            QVector<Rewrite> batch = pendingBatches.takeLast();
 
-        if (byte != identifier[i].toLatin1())
-            return FileErrorCode::invalidIdentifier; // Wrong character
-    }
+            if (batch.isEmpty())
+                continue;
 
-    // Read memory
-    memFile.seek(1 + identifier.length() + (2 * start)); //Set loaded file read starting point
-    int read_size = qMin<int>(end - start, getMemorySize() - dest); //Put the maximum amount of bytes read possible
+            Rewrite trialRewrite = PeepholeOptimizer::mergeRewrites(accepted + batch);
+            QStringList rewrittenLines = optimizer.applyRewrite(sourceLines, trialRewrite);
 
-    for (int address = dest; address < (dest + read_size); address++)
-    {
-        memFile.getChar(&byte);
-        setMemoryValue(address, byte);
-        memFile.getChar(&byte); // Skip byte
-    }
+            {
+                QSignalBlocker blocker(this); // Trial builds don't report errors
+                assembleLines(rewrittenLines, false);
+            }
 
-    // Return error status
-    if (memFile.error() != QFileDevice::NoError)
-        return FileErrorCode::inputOutput;
+            buildMatchesSourceLines = false;
+
+            if (optimizer.isRelocationValid(originalBuild, trialRewrite, rewrittenLines))
+            {
+                accepted += batch;
+                buildMatchesSourceLines = true;
+            }
+            else if (batch.size() > 1)
+            {
+                int half = batch.size() / 2;
+                pendingBatches.append(batch.mid(half)); // First half is tried first
+                pendingBatches.append(batch.mid(0, half));
+            }
+        }
+
+        if (accepted.isEmpty())
+            break;
+
+        std::sort(accepted.begin(), accepted.end(), [](const Rewrite &a, const Rewrite &b) { return a.line < b.line; });
+
+        foreach (const Rewrite &rewrite, accepted)
+        {
+            optimizationReport.append(QString("Linha %1: %2 (%3 bytes)").arg(rewrite.line + 1).arg(rewrite.description).arg(rewrite.bytesSaved));
+            optimizationBytesSaved += rewrite.bytesSaved;
+            optimizationInstructionsRemoved += rewrite.instructionsRemoved;
+        }
+
+        sourceLines = optimizer.applyRewrite(sourceLines, PeepholeOptimizer::mergeRewrites(accepted));
+        rewriteApplied = true; // Addresses changed, search again
+
+        if (!buildMatchesSourceLines)
+        {
+            assembleLines(sourceLines, false); // Accepted rewrites without the last rejected batch
+            buildMatchesSourceLines = true;
+        }
+    }
+
+    if (!buildMatchesSourceLines)
+        assembleLines(sourceLines, false); // Restore last accepted build
+
+    copyAssemblerMemoryToMemory();
+}
+
+bool Machine::isPeepholeOptimizationEnabled() const
+{
+    return peepholeOptimizationEnabled;
+}
+
+void Machine::setPeepholeOptimizationEnabled(bool enabled)
+{
+    peepholeOptimizationEnabled = enabled;
+}
+
+QStringList Machine::getOptimizationReport() const
+{
+    return optimizationReport;
+}
+
+int Machine::getOptimizationBytesSaved() const
+{
+    return optimizationBytesSaved;
+}
+
+int Machine::getOptimizationInstructionsRemoved() const
+{
+    return optimizationInstructionsRemoved;
+}
+
+
+
+//////////////////////////////////////////////////
+// Memory read/write with access count
+//////////////////////////////////////////////////
+
+int Machine::memoryRead(int address)
+{
+    accessCount++;
+    memoryActivity.reads[address & memoryMask]++;
+    return getMemoryValue(address);
+}
+
+void Machine::memoryWrite(int address, int value)
+{
+    accessCount++;
+    memoryActivity.writes[address & memoryMask]++;
+    setMemoryValue(address, value);
+
+    if (writeLogEnabled)
+        writeLog.append(address & memoryMask);
+}
+
+int Machine::memoryReadNext()
+{
+    int value = memoryRead(getPCValue());
+    incrementPCValue();
+    return value;
+}
+
+int Machine::GetCurrentOperandAddress()
+{
+
+    int immediateAddress = decodedImmediateAddress; 
+    AddressingMode::AddressingModeCode addressingModeCode = decodedAdressingModeCode1;
+
+    switch (addressingModeCode)
+    {
+        case AddressingMode::DIRECT:
+            return memoryRead(immediateAddress);
+
+        case AddressingMode::INDIRECT:
+            return memoryRead(memoryRead(immediateAddress));
+
+        case AddressingMode::IMMEDIATE:
+            return immediateAddress;
+
+        case AddressingMode::INDEXED_BY_X:
+            return address(memoryRead(immediateAddress) + getRegisterValue("X"));
+
+        case AddressingMode::INDEXED_BY_PC:
+            return address(memoryRead(immediateAddress) + getRegisterValue("PC"));
+
+        default:
+            return 0;
+    }
+}
+
+int Machine::GetCurrentOperandValue()
+{
+    return memoryRead(GetCurrentOperandAddress()); // Return 1-byte value
+}
+
+int Machine::GetCurrentJumpAddress()
+{
+    return GetCurrentOperandAddress();
+}
+
+// Accesses done by GetCurrentOperandAddress
+int Machine::getOperandAddressAccessCount(AddressingMode::AddressingModeCode addressingModeCode)
+{
+    switch (addressingModeCode)
+    {
+        case AddressingMode::DIRECT:
+            return 1;
+
+        case AddressingMode::INDIRECT:
+            return 2;
+
+        case AddressingMode::IMMEDIATE:
+            return 0;
+
+        case AddressingMode::INDEXED_BY_X:
+        case AddressingMode::INDEXED_BY_PC:
+            return 1;
+
+        default:
+            return 0;
+    }
+}
+
+// Accesses done by step() for the instruction; branchTaken selects the cost of conditional jumps
+int Machine::getStaticAccessCount(const DecodedInstruction &decoded, bool branchTaken)
+{
+    int fetchCount = 1;
+
+    if (decoded.instruction == nullptr)
+        return fetchCount;
+
+    bool isImmediate = (decoded.addressingModeCode == AddressingMode::IMMEDIATE);
+    int operandAddressCount = getOperandAddressAccessCount(decoded.addressingModeCode);
+
+    switch (decoded.instruction->getInstructionCode())
+    {
+    case Instruction::LDR: case Instruction::ADD: case Instruction::OR:
+    case Instruction::AND: case Instruction::SUB:
+        return fetchCount + operandAddressCount + 1; // Operand value read
+
+    case Instruction::STR:
+        return fetchCount + operandAddressCount + 1; // Operand write
+
+    case Instruction::JMP: case Instruction::JN:  case Instruction::JP: case Instruction::JV:
+    case Instruction::JNV: case Instruction::JZ:  case Instruction::JNZ: case Instruction::JC:
+    case Instruction::JNC: case Instruction::JB:  case Instruction::JNB:
+        return fetchCount + ((branchTaken && !isImmediate) ? operandAddressCount : 0);
+
+    case Instruction::JSR:
+        return fetchCount + ((!isImmediate) ? operandAddressCount + 1 : 0); // Return address write
+
+    default: // REG_IF reads its addresses without counting
+        return fetchCount;
+    }
+}
+
+
+
+//////////////////////////////////////////////////
+// Import/Export memory
+//////////////////////////////////////////////////
+
+// Returns true if successful
+FileErrorCode::FileErrorCode Machine::importMemory(QString filename, int start, int end, int dest)
+{
+    if(start < 0 || end > memory.size()){
+        return FileErrorCode::invalidAddress;
+    }
+    
+    QFile memFile(filename); // Implicitly closed
+
+    // A .mem file must contain the identifier's length, the machine's identifier and twice the amount of memory
+    qint64 fileSize = memFile.size();
+    qint64 memFileSize = 1 + identifier.length() + memory.size() * 2;
+    if (fileSize != memFileSize && fileSize < 4) // Not even a memory image's header
+        return FileErrorCode::incorrectSize;
+
+    // Open file and map it (or read it in a single call)
+    if (!memFile.open(QFile::ReadOnly))
+        return FileErrorCode::inputOutput;
+
+    QByteArray contents;
+    uchar *mapped = memFile.map(0, fileSize);
+    const uchar *data = mapped;
+
+    if (data == nullptr)
+    {
+        contents = memFile.readAll();
+        if (contents.size() != fileSize)
+            return FileErrorCode::inputOutput;
+
+        data = (const uchar *) contents.constData();
+    }
+
+    FileErrorCode::FileErrorCode result = FileErrorCode::noError;
+
+    if (isMemoryImage(data, fileSize))
+    {
+        result = loadMemoryImage(data, fileSize, start, end, dest);
+    }
+    else if (fileSize != memFileSize)
+    {
+        result = FileErrorCode::incorrectSize;
+    }
+    else
+    {
+        // Check identifier length and identifier
+        bool validIdentifier = (data[0] == identifier.length());
+        for (int i = 0; i < identifier.length() && validIdentifier; i++)
+            validIdentifier = (data[1 + i] == (uchar) identifier[i].toLatin1());
+
+        // Read memory (values interleaved with a skipped byte)
+        if (validIdentifier)
+        {
+            const uchar *image = data + 1 + identifier.length() + (2 * start); // Loaded file read starting point
+            int read_size = qMin<int>(end - start, getMemorySize() - dest); // Put the maximum amount of bytes read possible
+
+            for (int i = 0; i < read_size; i++)
+                setMemoryValue(dest + i, image[2 * i]);
+        }
+        else
+        {
+            result = FileErrorCode::invalidIdentifier;
+        }
+    }
+
+    if (mapped != nullptr)
+        memFile.unmap(mapped);
+
+    return result;
+}
+
+// Returns true if successful
+FileErrorCode::FileErrorCode Machine::exportMemory(QString filename)
+{
+    QFile memFile(filename); // Implicitly closed
+
+    // Identifier length, identifier and memory bytes (each followed by a zero), written at once
+    QByteArray contents(1 + identifier.length() + memory.size() * 2, 0);
+    char *data = contents.data();
+
+    data[0] = (unsigned char) identifier.length();
+
+    for (int i = 0; i < identifier.length(); i++)
+        data[1 + i] = identifier.at(i).toLatin1();
+
+    char *image = data + 1 + identifier.length();
+    for (int address = 0; address < memory.size(); address++)
+        image[2 * address] = memory[address].getValue();
+
+    // Open file and write
+    if (!memFile.open(QFile::WriteOnly) || memFile.write(contents) != contents.size())
+        return FileErrorCode::inputOutput;
+
+    // Return error status
+    if (memFile.error() != QFileDevice::NoError)
+        return FileErrorCode::inputOutput;
+    else
+        return FileErrorCode::noError;
+}
+
+FileErrorCode::FileErrorCode Machine::exportMemoryImage(QString filename, bool includeState, bool compress)
+{
+    QFile imageFile(filename); // Implicitly closed
+    QByteArray contents = saveMemoryImage(includeState, compress);
+
+    if (!imageFile.open(QFile::WriteOnly) || imageFile.write(contents) != contents.size())
+        return FileErrorCode::inputOutput;
+
+    // Return error status
+    if (imageFile.error() != QFileDevice::NoError)
+        return FileErrorCode::inputOutput;
     else
         return FileErrorCode::noError;
 }
 
-// Returns true if successful
-FileErrorCode::FileErrorCode Machine::exportMemory(QString filename)
+
+
+// Intel HEX record: ":", byte count, 16-bit address, type, data and two's complement checksum (hexadecimal)
+static QByteArray intelHexRecord(int type, int address, const QByteArray &data)
+{
+    QByteArray record;
+    record.append((char)data.size());
+    record.append((char)(address >> 8));
+    record.append((char)address);
+    record.append((char)type);
+    record.append(data);
+
+    int sum = 0;
+    for (int i = 0; i < record.size(); i++)
+        sum += (uchar)record[i];
+    record.append((char)(-sum));
+
+    return ":" + record.toHex().toUpper() + "\n";
+}
+
+// Records are read one line at a time, and only copied to memory once the whole file is valid
+FileErrorCode::FileErrorCode Machine::importIntelHex(QString filename, int start, int end, int dest)
+{
+    if (start < 0 || end > memory.size())
+        return FileErrorCode::invalidAddress;
+
+    QFile hexFile(filename); // Implicitly closed
+
+    if (!hexFile.open(QFile::ReadOnly | QFile::Text))
+        return FileErrorCode::inputOutput;
+
+    QVector<int> values(memory.size(), -1); // -1 for addresses not in the file
+    int baseAddress = 0; // Extended segment/linear address
+    bool endOfFile = false;
+
+    while (!endOfFile && !hexFile.atEnd())
+    {
+        QByteArray line = hexFile.readLine().trimmed();
+
+        if (line.isEmpty())
+            continue;
+        if (line[0] != ':' || line.size() < 11 || (line.size() % 2) == 0)
+            return FileErrorCode::inputOutput;
+
+        QByteArray record = QByteArray::fromHex(line.mid(1));
+        const uchar *bytes = (const uchar *)record.constData();
+
+        if (record.size() * 2 != line.size() - 1 || record.size() != bytes[0] + 5)
+            return FileErrorCode::inputOutput;
+
+        int sum = 0;
+        for (int i = 0; i < record.size(); i++)
+            sum += bytes[i];
+        if ((sum & 0xFF) != 0)
+            return FileErrorCode::invalidChecksum;
+
+        int length = bytes[0];
+        int recordAddress = (bytes[1] << 8) | bytes[2];
+        const uchar *data = bytes + 4;
+
+        switch (bytes[3])
+        {
+        case 0x00: // Data
+            for (int i = 0; i < length; i++)
+            {
+                int address = baseAddress + recordAddress + i;
+                int destination = dest + address - start;
+
+                if (address >= start && address < end && destination < memory.size())
+                    values[destination] = data[i];
+            }
+            break;
+
+        case 0x01: // End of file
+            endOfFile = true;
+            break;
+
+        case 0x02: // Extended segment address
+        case 0x04: // Extended linear address
+            if (length != 2)
+                return FileErrorCode::inputOutput;
+            baseAddress = ((data[0] << 8) | data[1]) << ((bytes[3] == 0x02) ? 4 : 16);
+            break;
+
+        case 0x03: // Start addresses (ignored)
+        case 0x05:
+            break;
+
+        default:
+            return FileErrorCode::inputOutput;
+        }
+    }
+
+    if (!endOfFile || hexFile.error() != QFileDevice::NoError)
+        return FileErrorCode::inputOutput;
+
+    for (int address = 0; address < memory.size(); address++)
+    {
+        if (values[address] != -1)
+            setMemoryValue(address, values[address]);
+    }
+
+    return FileErrorCode::noError;
+}
+
+FileErrorCode::FileErrorCode Machine::importBinary(QString filename, int start, int end, int dest)
+{
+    if (start < 0 || end > memory.size())
+        return FileErrorCode::invalidAddress;
+
+    QFile binaryFile(filename); // Implicitly closed
+
+    // One byte per address, possibly shorter than the memory
+    if (binaryFile.size() > memory.size())
+        return FileErrorCode::incorrectSize;
+
+    if (!binaryFile.open(QFile::ReadOnly) || !binaryFile.seek(qMin<qint64>(start, binaryFile.size())))
+        return FileErrorCode::inputOutput;
+
+    QByteArray bytes = binaryFile.read(qMax<qint64>(0, qMin<qint64>(end, binaryFile.size()) - start));
+
+    if (binaryFile.error() != QFileDevice::NoError)
+        return FileErrorCode::inputOutput;
+
+    int read_size = qMin<int>(bytes.size(), getMemorySize() - dest);
+    for (int i = 0; i < read_size; i++)
+        setMemoryValue(dest + i, (uchar)bytes[i]);
+
+    return FileErrorCode::noError;
+}
+
+FileErrorCode::FileErrorCode Machine::exportIntelHex(QString filename, int start, int end)
+{
+    if (start < 0 || end > memory.size())
+        return FileErrorCode::invalidAddress;
+
+    QFile hexFile(filename); // Implicitly closed
+
+    if (!hexFile.open(QFile::WriteOnly | QFile::Text))
+        return FileErrorCode::inputOutput;
+
+    // Data records of up to 16 bytes (memories are smaller than 64 KB, so no extended addresses)
+    for (int address = start; address < end; address += 16)
+    {
+        QByteArray data;
+        for (int i = address; i < qMin(address + 16, end); i++)
+            data.append((char)getMemoryValue(i));
+
+        hexFile.write(intelHexRecord(0x00, address, data));
+    }
+
+    hexFile.write(intelHexRecord(0x01, 0, QByteArray()));
+
+    // Return error status
+    if (hexFile.error() != QFileDevice::NoError)
+        return FileErrorCode::inputOutput;
+    else
+        return FileErrorCode::noError;
+}
+
+FileErrorCode::FileErrorCode Machine::exportBinary(QString filename, int start, int end)
+{
+    if (start < 0 || end > memory.size())
+        return FileErrorCode::invalidAddress;
+
+    QFile binaryFile(filename); // Implicitly closed
+    QByteArray bytes;
+
+    for (int address = start; address < end; address++)
+        bytes.append((char)getMemoryValue(address));
+
+    if (!binaryFile.open(QFile::WriteOnly) || binaryFile.write(bytes) != bytes.size())
+        return FileErrorCode::inputOutput;
+
+    // Return error status
+    if (binaryFile.error() != QFileDevice::NoError)
+        return FileErrorCode::inputOutput;
+    else
+        return FileErrorCode::noError;
+}
+
+
+
+//////////////////////////////////////////////////
+// Assembled image
+//////////////////////////////////////////////////
+
+// Layout (little-endian):
+//   "HASM", version, memory size, source lines, labels, address labels (uint32 each)
+//   identifier length (uint8), identifier
+//   image (1 byte per address), address -> source line (int32 per address)
+//   source line -> address (int32 per line)
+//   labels and address labels: address (int32), name length (uint16), UTF-8 name
+static const char ASSEMBLED_IMAGE_MAGIC[] = "HASM";
+
+static void appendUInt32(QByteArray &buffer, quint32 value)
+{
+    char bytes[4];
+    qToLittleEndian<quint32>(value, bytes);
+    buffer.append(bytes, 4);
+}
+
+static void appendLabel(QByteArray &buffer, int address, QString name)
+{
+    QByteArray nameBytes = name.toUtf8();
+    char lengthBytes[2];
+
+    appendUInt32(buffer, (quint32)address);
+    qToLittleEndian<quint16>((quint16)nameBytes.size(), lengthBytes);
+    buffer.append(lengthBytes, 2);
+    buffer.append(nameBytes);
+}
+
+// Bounds-checked reader over a (possibly memory-mapped) buffer
+class AssembledImageReader
+{
+public:
+    AssembledImageReader(const uchar *data, qint64 size) : data(data), size(size), offset(0), ok(data != nullptr) {}
+
+    const uchar *take(qint64 length)
+    {
+        if (!ok || length < 0 || offset + length > size)
+        {
+            ok = false;
+            return nullptr;
+        }
+
+        const uchar *pointer = data + offset;
+        offset += length;
+        return pointer;
+    }
+
+    quint32 readUInt32()
+    {
+        const uchar *pointer = take(4);
+        return (pointer) ? qFromLittleEndian<quint32>(pointer) : 0;
+    }
+
+    bool readLabel(int &address, QString &name)
+    {
+        address = (int)readUInt32();
+        const uchar *lengthPointer = take(2);
+        int length = (lengthPointer) ? qFromLittleEndian<quint16>(lengthPointer) : 0;
+        const uchar *namePointer = take(length);
+
+        if (!ok)
+            return false;
+
+        name = QString::fromUtf8((const char *)namePointer, length);
+        return true;
+    }
+
+    bool isOk() const { return ok; }
+
+private:
+    const uchar *data;
+    qint64 size;
+    qint64 offset;
+    bool ok;
+};
+
+QByteArray Machine::saveAssembledImage()
+{
+    QByteArray buffer;
+
+    if (!buildSuccessful)
+        return buffer;
+
+    int numberOfAddressLabels = addressCorrespondingLabel.size();
+
+    QByteArray identifierBytes = identifier.toLatin1();
+    buffer.reserve(32 + identifierBytes.size() + memory.size() * 5 + sourceLineCorrespondingAddress.size() * 4);
+
+    // Header
+    buffer.append(ASSEMBLED_IMAGE_MAGIC, 4);
+    appendUInt32(buffer, ASSEMBLER_VERSION);
+    appendUInt32(buffer, memory.size());
+    appendUInt32(buffer, sourceLineCorrespondingAddress.size());
+    appendUInt32(buffer, labelPCMap.size());
+    appendUInt32(buffer, numberOfAddressLabels);
+    buffer.append((char)identifierBytes.size());
+    buffer.append(identifierBytes);
+
+    // Image and source maps
+    for (int address = 0; address < assemblerMemory.size(); address++)
+        buffer.append((char)getAssemblerMemoryValue(address));
+
+    for (int address = 0; address < addressCorrespondingSourceLine.size(); address++)
+        appendUInt32(buffer, (quint32)((isReserved(address)) ? addressCorrespondingSourceLine[address] : -1));
+
+    for (int line = 0; line < sourceLineCorrespondingAddress.size(); line++)
+        appendUInt32(buffer, (quint32)sourceLineCorrespondingAddress[line]);
+
+    // Labels
+    QHash<QString, int>::const_iterator label;
+    for (label = labelPCMap.constBegin(); label != labelPCMap.constEnd(); ++label)
+        appendLabel(buffer, label.value(), label.key());
+
+    QHash<int, QString>::const_iterator addressLabel;
+    for (addressLabel = addressCorrespondingLabel.constBegin(); addressLabel != addressCorrespondingLabel.constEnd(); ++addressLabel)
+        appendLabel(buffer, addressLabel.key(), addressLabel.value());
+
+    return buffer;
+}
+
+// Returns false (leaving the machine untouched) if the data is invalid or belongs to another machine
+bool Machine::loadAssembledImage(const uchar *data, qint64 size)
+{
+    AssembledImageReader reader(data, size);
+
+    // Header
+    const uchar *magic = reader.take(4);
+    if (!magic || std::memcmp(magic, ASSEMBLED_IMAGE_MAGIC, 4) != 0)
+        return false;
+
+    quint32 version = reader.readUInt32();
+    quint32 memorySize = reader.readUInt32();
+    quint32 numberOfSourceLines = reader.readUInt32();
+    quint32 numberOfLabels = reader.readUInt32();
+    quint32 numberOfAddressLabels = reader.readUInt32();
+
+    const uchar *identifierLength = reader.take(1);
+    const uchar *identifierBytes = reader.take((identifierLength) ? *identifierLength : 0);
+
+    if (!reader.isOk() || version != (quint32)ASSEMBLER_VERSION || memorySize != (quint32)memory.size())
+        return false;
+    if (QString::fromLatin1((const char *)identifierBytes, *identifierLength) != identifier)
+        return false;
+
+    // Image and source maps (validated before touching the machine)
+    const uchar *image = reader.take(memorySize);
+    const uchar *addressLines = reader.take(memorySize * 4);
+    const uchar *lineAddresses = reader.take((qint64)numberOfSourceLines * 4);
+
+    QHash<QString, int> labels;
+    QVector<QPair<int, QString>> addressLabels;
+    int address;
+    QString name;
+
+    for (quint32 i = 0; i < numberOfLabels && reader.readLabel(address, name); i++)
+        labels.insert(name, address);
+
+    for (quint32 i = 0; i < numberOfAddressLabels && reader.readLabel(address, name); i++)
+        addressLabels.append(qMakePair(address & memoryMask, name));
+
+    if (!reader.isOk())
+        return false;
+
+    // Restore build
+    running = false;
+    clearAssemblerData();
+
+    for (int i = 0; i < memory.size(); i++)
+    {
+        int line = (qint32)qFromLittleEndian<quint32>(addressLines + i * 4);
+
+        if (line != -1)
+        {
+            reserveAssemblerAddress(i, line);
+            assemblerMemory[i].setValue(image[i]);
+        }
+    }
+
+    sourceLineCorrespondingAddress.resize(numberOfSourceLines);
+    for (int line = 0; line < (int)numberOfSourceLines; line++)
+        sourceLineCorrespondingAddress[line] = (qint32)qFromLittleEndian<quint32>(lineAddresses + line * 4);
+
+    labelPCMap = labels;
+    for (int i = 0; i < addressLabels.size(); i++)
+        addressCorrespondingLabel.insert(addressLabels[i].first, addressLabels[i].second);
+
+    buildSuccessful = true;
+    firstErrorLine = -1;
+
+    copyAssemblerMemoryToMemory();
+    clearAfterBuild();
+
+    return true;
+}
+
+
+
+//////////////////////////////////////////////////
+// Compact memory image
+//////////////////////////////////////////////////
+
+// Layout (little-endian):
+//   "HMEM", version, memory size (uint32 each)
+//   identifier length (uint8), identifier
+//   state present (uint8), then if present:
+//     number of registers (uint32), values (uint32 each, PC included)
+//     number of flags (uint32), values (uint8 each)
+//     stack size (uint32), values (uint8 each)
+//   encoding (uint8), payload length (uint32), payload
+//   Adler-32 checksum of everything above (uint32)
+//
+// Run-length payload: a control byte c < 128 is followed by c + 1 literal bytes,
+// c >= 128 by a single byte repeated c - 125 times (3 to 130).
+static const char MEMORY_IMAGE_MAGIC[] = "HMEM";
+
+enum MemoryImageEncoding
+{
+    RAW_ENCODING = 0,
+    RUN_LENGTH_ENCODING = 1
+};
+
+static quint32 adler32(const uchar *data, qint64 size)
+{
+    quint32 a = 1, b = 0;
+
+    for (qint64 i = 0; i < size; i++)
+    {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+
+    return (b << 16) | a;
+}
+
+static QByteArray encodeRunLength(const QByteArray &image)
+{
+    QByteArray payload;
+    int size = image.size();
+    int i = 0;
+
+    while (i < size)
+    {
+        int run = 1;
+        while (i + run < size && run < 130 && image[i + run] == image[i])
+            run++;
+
+        if (run >= 3)
+        {
+            payload.append((char)(128 + run - 3));
+            payload.append(image[i]);
+            i += run;
+        }
+        else
+        {
+            // Literals up to the next run of three equal bytes
+            int literalStart = i;
+            while (i < size && i - literalStart < 128 && !(i + 2 < size && image[i] == image[i + 1] && image[i] == image[i + 2]))
+                i++;
+
+            payload.append((char)(i - literalStart - 1));
+            payload.append(image.constData() + literalStart, i - literalStart);
+        }
+    }
+
+    return payload;
+}
+
+// Calls output(address, value) for each memory byte, in order; false if the payload doesn't decode to exactly memorySize bytes
+template <typename Output>
+static bool decodeMemoryPayload(int encoding, const uchar *payload, qint64 length, int memorySize, Output output)
+{
+    if (encoding == RAW_ENCODING)
+    {
+        if (length != memorySize)
+            return false;
+
+        for (int address = 0; address < memorySize; address++)
+            output(address, payload[address]);
+
+        return true;
+    }
+
+    if (encoding != RUN_LENGTH_ENCODING)
+        return false;
+
+    int address = 0;
+    qint64 offset = 0;
+
+    while (offset < length)
+    {
+        int control = payload[offset++];
+        int count = (control < 128) ? control + 1 : control - 125;
+
+        if (address + count > memorySize || offset + ((control < 128) ? count : 1) > length)
+            return false;
+
+        if (control < 128)
+        {
+            for (int i = 0; i < count; i++)
+                output(address++, payload[offset++]);
+        }
+        else
+        {
+            int value = payload[offset++];
+            for (int i = 0; i < count; i++)
+                output(address++, value);
+        }
+    }
+
+    return (address == memorySize);
+}
+
+bool Machine::isMemoryImage(const uchar *data, qint64 size)
+{
+    return data != nullptr && size >= 4 && std::memcmp(data, MEMORY_IMAGE_MAGIC, 4) == 0;
+}
+
+QByteArray Machine::saveMemoryImage(bool includeState, bool compress)
+{
+    QByteArray buffer;
+    QByteArray identifierBytes = identifier.toLatin1();
+
+    // Header
+    buffer.append(MEMORY_IMAGE_MAGIC, 4);
+    appendUInt32(buffer, MEMORY_IMAGE_VERSION);
+    appendUInt32(buffer, memory.size());
+    buffer.append((char)identifierBytes.size());
+    buffer.append(identifierBytes);
+
+    // Registers, flags and stack
+    buffer.append((char)((includeState) ? 1 : 0));
+
+    if (includeState)
+    {
+        appendUInt32(buffer, registers.size());
+        for (int id = 0; id < registers.size(); id++)
+            appendUInt32(buffer, (quint32)getRegisterValue(id));
+
+        appendUInt32(buffer, flags.size());
+        for (int id = 0; id < flags.size(); id++)
+            buffer.append((char)getFlagValue(id));
+
+        appendUInt32(buffer, getStackSize());
+        for (int address = 0; address < getStackSize(); address++)
+            buffer.append((char)getStackValue(address));
+    }
+
+    // Memory, run-length encoded only if it pays off
+    QByteArray image(memory.size(), 0);
+    for (int address = 0; address < memory.size(); address++)
+        image[address] = (char)memory[address].getValue();
+
+    QByteArray payload = (compress) ? encodeRunLength(image) : image;
+    bool isRunLength = compress && payload.size() < image.size();
+
+    if (!isRunLength)
+        payload = image;
+
+    buffer.append((char)((isRunLength) ? RUN_LENGTH_ENCODING : RAW_ENCODING));
+    appendUInt32(buffer, payload.size());
+    buffer.append(payload);
+
+    appendUInt32(buffer, adler32((const uchar *)buffer.constData(), buffer.size()));
+    return buffer;
+}
+
+// Leaves the machine untouched if the image is damaged or belongs to another machine
+FileErrorCode::FileErrorCode Machine::loadMemoryImage(const uchar *data, qint64 size, int start, int end, int dest)
+{
+    if (start < 0 || end > memory.size())
+        return FileErrorCode::invalidAddress;
+
+    if (!isMemoryImage(data, size) || size < 8)
+        return FileErrorCode::inputOutput;
+
+    // Checksum first, so nothing is read from a damaged file
+    if (adler32(data, size - 4) != qFromLittleEndian<quint32>(data + size - 4))
+        return FileErrorCode::invalidChecksum;
+
+    AssembledImageReader reader(data, size - 4);
+
+    // Header
+    reader.take(4);
+    quint32 version = reader.readUInt32();
+    quint32 memorySize = reader.readUInt32();
+
+    const uchar *identifierLength = reader.take(1);
+    const uchar *identifierBytes = reader.take((identifierLength) ? *identifierLength : 0);
+
+    if (!reader.isOk() || version != (quint32)MEMORY_IMAGE_VERSION)
+        return FileErrorCode::inputOutput;
+    if (QString::fromLatin1((const char *)identifierBytes, *identifierLength) != identifier)
+        return FileErrorCode::invalidIdentifier;
+    if (memorySize != (quint32)memory.size())
+        return FileErrorCode::incorrectSize;
+
+    // Registers, flags and stack
+    const uchar *hasState = reader.take(1);
+    const uchar *registerValues = nullptr, *flagValues = nullptr, *stackValues = nullptr;
+
+    if (hasState && *hasState)
+    {
+        if (reader.readUInt32() != (quint32)registers.size())
+            return FileErrorCode::incorrectSize;
+        registerValues = reader.take(registers.size() * 4);
+
+        if (reader.readUInt32() != (quint32)flags.size())
+            return FileErrorCode::incorrectSize;
+        flagValues = reader.take(flags.size());
+
+        if (reader.readUInt32() != (quint32)getStackSize())
+            return FileErrorCode::incorrectSize;
+        stackValues = reader.take(getStackSize());
+    }
+
+    // Memory (decoded once to validate it, then streamed into memory)
+    const uchar *encoding = reader.take(1);
+    quint32 payloadLength = reader.readUInt32();
+    const uchar *payload = reader.take(payloadLength);
+
+    if (!reader.isOk() || !decodeMemoryPayload(*encoding, payload, payloadLength, memorySize, [](int, int) {}))
+        return FileErrorCode::inputOutput;
+
+    int readSize = qMin<int>(end - start, getMemorySize() - dest);
+
+    decodeMemoryPayload(*encoding, payload, payloadLength, memorySize, [&](int address, int value)
+    {
+        if (address >= start && address - start < readSize)
+            setMemoryValue(dest + address - start, value);
+    });
+
+    // State belongs to the whole memory, so partial loads skip it
+    if (registerValues && start == 0 && end == memory.size() && dest == 0)
+    {
+        for (int id = 0; id < registers.size(); id++)
+            setRegisterValue(id, (int)qFromLittleEndian<quint32>(registerValues + id * 4));
+
+        for (int id = 0; id < flags.size(); id++)
+            setFlagValue(id, flagValues[id]);
+
+        for (int address = 0; address < getStackSize(); address++)
+            setStackValue(address, stackValues[address]);
+    }
+
+    return FileErrorCode::noError;
+}
+
+
+
+//////////////////////////////////////////////////
+// Checkpoints
+//////////////////////////////////////////////////
+
+// Layout (little-endian):
+//   "HCKP", version (uint32)
+//   instruction count, access count (uint64 each), breakpoint (int32), running (uint8)
+//   memory image length (uint32), memory image with state (see saveMemoryImage)
+//   Adler-32 checksum of everything above (uint32)
+static const char CHECKPOINT_MAGIC[] = "HCKP";
+static const int CHECKPOINT_IMAGE_OFFSET = 33; // Memory image after the fixed-size header
+
+static void appendUInt64(QByteArray &buffer, quint64 value)
+{
+    char bytes[8];
+    qToLittleEndian<quint64>(value, bytes);
+    buffer.append(bytes, 8);
+}
+
+bool Machine::isCheckpoint(const uchar *data, qint64 size)
+{
+    return data != nullptr && size >= 4 && std::memcmp(data, CHECKPOINT_MAGIC, 4) == 0;
+}
+
+QByteArray Machine::saveCheckpoint()
+{
+    QByteArray image = saveMemoryImage(true, true);
+    QByteArray buffer;
+    buffer.reserve(CHECKPOINT_IMAGE_OFFSET + image.size() + 4);
+
+    buffer.append(CHECKPOINT_MAGIC, 4);
+    appendUInt32(buffer, CHECKPOINT_VERSION);
+    appendUInt64(buffer, (quint64)instructionCount);
+    appendUInt64(buffer, (quint64)accessCount);
+    appendUInt32(buffer, (quint32)breakpoint);
+    buffer.append((char)((running) ? 1 : 0));
+    appendUInt32(buffer, image.size());
+    buffer.append(image);
+
+    appendUInt32(buffer, adler32((const uchar *)buffer.constData(), buffer.size()));
+    return buffer;
+}
+
+FileErrorCode::FileErrorCode Machine::loadCheckpoint(const uchar *data, qint64 size)
+{
+    if (!isCheckpoint(data, size) || size < CHECKPOINT_IMAGE_OFFSET + 4)
+        return FileErrorCode::inputOutput;
+
+    if (adler32(data, size - 4) != qFromLittleEndian<quint32>(data + size - 4))
+        return FileErrorCode::invalidChecksum;
+
+    AssembledImageReader reader(data, size - 4);
+
+    reader.take(4);
+    quint32 version = reader.readUInt32();
+    const uchar *counters = reader.take(16);
+    int savedBreakpoint = (int)reader.readUInt32();
+    const uchar *savedRunning = reader.take(1);
+    quint32 imageSize = reader.readUInt32();
+    const uchar *image = reader.take(imageSize);
+
+    if (!reader.isOk() || version != (quint32)CHECKPOINT_VERSION)
+        return FileErrorCode::inputOutput;
+
+    // Memory, registers, flags and stack (validated before anything is written)
+    FileErrorCode::FileErrorCode result = loadMemoryImage(image, imageSize, 0, memory.size(), 0);
+    if (result != FileErrorCode::noError)
+        return result;
+
+    instructionCount = (qint64)qFromLittleEndian<quint64>(counters);
+    accessCount = (qint64)qFromLittleEndian<quint64>(counters + 8);
+    setBreakpoint(savedBreakpoint);
+    running = (*savedRunning != 0);
+
+    return FileErrorCode::noError;
+}
+
+FileErrorCode::FileErrorCode Machine::exportCheckpoint(QString filename)
+{
+    QSaveFile checkpointFile(filename); // Only replaces the previous checkpoint when committed
+    QByteArray contents = saveCheckpoint();
+
+    if (!checkpointFile.open(QFile::WriteOnly) || checkpointFile.write(contents) != contents.size() || !checkpointFile.commit())
+        return FileErrorCode::inputOutput;
+
+    return FileErrorCode::noError;
+}
+
+FileErrorCode::FileErrorCode Machine::importCheckpoint(QString filename)
+{
+    QFile checkpointFile(filename); // Implicitly closed
+
+    if (!checkpointFile.open(QFile::ReadOnly) || checkpointFile.size() == 0)
+        return FileErrorCode::inputOutput;
+
+    uchar *data = checkpointFile.map(0, checkpointFile.size());
+    if (data == nullptr)
+        return FileErrorCode::inputOutput;
+
+    FileErrorCode::FileErrorCode result = loadCheckpoint(data, checkpointFile.size());
+
+    checkpointFile.unmap(data);
+    return result;
+}
+
+QString Machine::readMemoryFileIdentifier(QString filename)
 {
     QFile memFile(filename); // Implicitly closed
 
-    // Open file
-    memFile.open(QFile::WriteOnly);
+    if (!memFile.open(QFile::ReadOnly))
+        return QString();
+
+    // Checkpoints embed a memory image, which stores the version and memory size before the identifier
+    QByteArray magic = memFile.peek(4);
+    if (isCheckpoint((const uchar *) magic.constData(), magic.size()))
+    {
+        memFile.seek(CHECKPOINT_IMAGE_OFFSET);
+        magic = memFile.peek(4);
+    }
+
+    if (isMemoryImage((const uchar *) magic.constData(), magic.size()))
+        memFile.seek(memFile.pos() + 12);
 
-    // Write identifier length
-    memFile.putChar((unsigned char)identifier.length());
+    // Identifier's length followed by the identifier
+    char length;
+    if (!memFile.getChar(&length) || length <= 0)
+        return QString();
 
-    // Write identifier
-    for (int i = 0; i < identifier.length(); i++)
+    QByteArray identifier = memFile.read(length);
+    if (identifier.size() != length)
+        return QString();
+
+    return QString::fromLatin1(identifier);
+}
+
+
+//////////////////////////////////////////////////
+// Listing
+//////////////////////////////////////////////////
+
+QString Machine::generateListing(QString sourceCode)
+{
+    if (!buildSuccessful)
+        return QString();
+
+    QStringList sourceLines = sourceCode.split("\n");
+    ControlFlowGraph graph(*this);
+    const QVector<ControlFlowGraph::BasicBlock> &blocks = graph.getBlocks();
+
+    // Bytes emitted by each line
+    QVector<int> lineSize(sourceLines.size(), 0);
+    for (int address = 0; address < memory.size(); address++)
+    {
+        int line = (isReserved(address)) ? addressCorrespondingSourceLine[address] : -1;
+        if (line >= 0 && line < lineSize.size())
+            lineSize[line] += 1;
+    }
+
+    // Loops, by header block
+    QHash<int, QString> loopDescriptions;
+    foreach (ControlFlowGraph::Loop loop, graph.getLoops())
     {
-        memFile.putChar(identifier.at(i).toLatin1());
+        QString instructionRange = QString::number(loop.minInstructions);
+        QString accessRange = QString::number(loop.minAccesses);
+
+        if (loop.maxInstructions != loop.minInstructions)
+            instructionRange += " a " + QString::number(loop.maxInstructions);
+        if (loop.maxAccesses != loop.minAccesses)
+            accessRange += " a " + QString::number(loop.maxAccesses);
+
+        loopDescriptions.insert(loop.header, QString("; Laço (%1 blocos): %2 instruções e %3 acessos por iteração")
+                                .arg(loop.blocks.size()).arg(instructionRange).arg(accessRange));
     }
 
-    // Write memory bytes
-    foreach (Byte *byte, memory)
+    QString listing;
+    QTextStream stream(&listing);
+
+    stream << "; Listagem " << identifier << " - custos estáticos por bloco básico\n";
+    stream << "; Acessos à memória contados como na simulação (busca da instrução incluída)\n";
+    stream << ";\n";
+    stream << "; End.  Bytes         Código\n";
+
+    for (int line = 0; line < sourceLines.size(); line++)
     {
-        memFile.putChar(byte->getValue());
-        memFile.putChar(0);
+        int lineAddress = sourceLineCorrespondingAddress.value(line, -1);
+
+        // Annotate blocks starting at this line
+        for (int address = lineAddress; lineSize[line] > 0 && address < lineAddress + lineSize[line]; address++)
+        {
+            int blockIndex = graph.getBlockAt(address & memoryMask);
+            if (blockIndex < 0)
+                continue;
+
+            const ControlFlowGraph::BasicBlock &block = blocks[blockIndex];
+            QString description = QString("; Bloco %1: %2 instruções, %3 acessos").arg(blockIndex).arg(block.instructionCount).arg(block.accessCount);
+
+            if (block.takenAccessCount != block.accessCount)
+                description += QString(" (%1 se desviar)").arg(block.takenAccessCount);
+
+            QStringList successors;
+            foreach (ControlFlowGraph::Edge edge, block.successors)
+                successors.append(QString::number(edge.block));
+            if (block.hasUnknownSuccessor)
+                successors.append("?");
+
+            description += (successors.isEmpty()) ? ", fim" : ", segue para " + successors.join(", ");
+
+            stream << ";\n" << description << "\n";
+            if (loopDescriptions.contains(blockIndex))
+                stream << loopDescriptions.value(blockIndex) << "\n";
+        }
+
+        // Address and bytes
+        QString addressString, bytesString;
+
+        if (lineSize[line] > 0)
+        {
+            QStringList bytes;
+            for (int i = 0; i < qMin(lineSize[line], 4); i++)
+                bytes.append(QString("%1").arg(getMemoryValue(lineAddress + i), 2, 16, QChar('0')).toUpper());
+            if (lineSize[line] > 4)
+                bytes.append("...");
+
+            addressString = QString::number(lineAddress);
+            bytesString = bytes.join(" ");
+        }
+
+        QString row = QString("%1  %2  %3").arg(addressString, 5).arg(bytesString, -12).arg(sourceLines[line]);
+        while (row.endsWith(' '))
+            row.chop(1);
+
+        stream << row << "\n";
     }
 
+    stream.flush();
+    return listing;
+}
+
+FileErrorCode::FileErrorCode Machine::exportListing(QString filename, QString sourceCode)
+{
+    QFile listingFile(filename); // Implicitly closed
+
+    if (!listingFile.open(QFile::WriteOnly | QFile::Text))
+        return FileErrorCode::inputOutput;
+
+    listingFile.write(generateListing(sourceCode).toUtf8());
+
     // Return error status
-    if (memFile.error() != QFileDevice::NoError)
+    if (listingFile.error() != QFileDevice::NoError)
         return FileErrorCode::inputOutput;
     else
         return FileErrorCode::noError;
@@ -1152,65 +2559,126 @@ FileErrorCode::FileErrorCode Machine::exportMemory(QString filename)
 
 
 
+
 //////////////////////////////////////////////////
 // Instruction strings
 //////////////////////////////////////////////////
 
+// Disassembly of the bytes following an instruction start (no string)
+static const DecodedInstruction ARGUMENT_BYTE = {nullptr, -1, AddressingMode::DIRECT, -1, -1, 0};
+
+// Linear sweep from address 0, realigned at PC. After the first sweep, only spans around outdated
+// addresses (written bytes, previous and current PC) are swept again, each until instruction
+// boundaries match the previous sweep.
 void Machine::updateInstructionStrings()
 {
-    int address = 0, pendingArgumentBytes = 0;
-    bool pcReached = false;
+    int memorySize = getMemorySize();
+    int pcValue = getPCValue();
+    int previousPC = instructionStringsPC;
+    bool fullSweep = !instructionStringsValid;
+    QVector<int> outdated;
 
-    while (address < getMemorySize())
+    if (fullSweep)
     {
-        // Realign interpretation to PC when PC is reached
-        if (!pcReached && address >= getPCValue())
-        {
-            address = getPCValue();
-            pendingArgumentBytes = 0;
-            pcReached = true;
-        }
+        outdated.append(0);
+    }
+    else
+    {
+        outdated = outdatedInstructionStrings;
 
-        if (pendingArgumentBytes == 0) // Used to skip argument lines
+        if (pcValue != instructionStringsPC)
         {
-            setInstructionString(address, generateInstructionString(address, pendingArgumentBytes));
+            outdated.append(instructionStringsPC);
+            outdated.append(pcValue);
         }
-        else // Skip instruction's arguments (leave empty strings)
+
+        std::sort(outdated.begin(), outdated.end());
+    }
+
+    foreach (int address, outdatedInstructionStrings)
+        instructionStringOutdated[address] = false;
+
+    outdatedInstructionStrings.clear();
+    instructionStringsValid = true;
+    instructionStringsPC = pcValue;
+
+    int index = 0;
+
+    while (index < outdated.size())
+    {
+        int address = outdated[index];
+
+        // Start at the instruction whose arguments include the address, as its string shows them
+        while (address > 0 && address != previousPC && instructionStringPendingBytes[address] > 0)
+            address--;
+
+        int pendingArgumentBytes = instructionStringPendingBytes[address]; // Nothing changed before it
+
+        while (address < memorySize)
         {
-            setInstructionString(address, "");
-            pendingArgumentBytes -= 1;
-        }
+            while (index < outdated.size() && outdated[index] <= address)
+                index++;
+
+            instructionStringPendingBytes[address] = pendingArgumentBytes;
+
+            // Realign interpretation to PC when PC is reached
+            if (address == pcValue)
+                pendingArgumentBytes = 0;
+
+            DecodedInstruction decoded = ARGUMENT_BYTE;
+
+            if (pendingArgumentBytes == 0) // Used to skip argument lines
+            {
+                decoded = decodeInstructionAt(address);
+                Instruction *instruction = decoded.instruction;
+
+                bool isNop = (instruction == nullptr || instruction->getInstructionCode() == Instruction::NOP || instruction->getInstructionCode() == Instruction::VOLTA_NOP);
+                pendingArgumentBytes = (isNop) ? 0 : decoded.size - 1;
+            }
+            else // Skip instruction's arguments (leave empty strings)
+            {
+                pendingArgumentBytes -= 1;
+            }
+
+            if (disassembly[address] != decoded)
+            {
+                disassembly[address] = decoded;
+
+                if (!changedInstructionStrings.isEmpty() && changedInstructionStrings.last().end == address)
+                    changedInstructionStrings.last().end++;
+                else
+                    changedInstructionStrings.append(MemoryRange{address, address + 1});
+            }
+
+            address += 1;
 
-        address += 1;
+            // Boundaries resynchronized, unchanged until the next outdated address
+            bool nextIsOutdated = (index < outdated.size() && outdated[index] == address);
+            if (!fullSweep && address < memorySize && !nextIsOutdated && instructionStringPendingBytes[address] == pendingArgumentBytes)
+                break;
+        }
     }
 }
 
-QString Machine::generateInstructionString(int address, int &argumentsSize)
+QString Machine::formatInstruction(const DecodedInstruction &decoded)
 {
-    QString memoryString;
-    argumentsSize = 0;
-
-    // Fetch and decode instruction
-    int fetchedValue = getMemoryValue(address);
-    Instruction *instruction = getInstructionFromValue(getMemoryValue(address));
-    AddressingMode::AddressingModeCode addressingModeCode = extractAddressingModeCode(fetchedValue);
-    QString registerName = extractRegisterName(fetchedValue);
+    Instruction *instruction = decoded.instruction;
 
     if (instruction == nullptr || instruction->getInstructionCode() == Instruction::NOP || instruction->getInstructionCode() == Instruction::VOLTA_NOP)
         return "";
 
     // Instruction name
-    memoryString = instruction->getMnemonic().toUpper();
+    QString memoryString = instruction->getMnemonic().toUpper();
 
     // Register name
     if (instruction->getArguments().contains("r"))
-        memoryString += " " + ((registerName != "") ? registerName : "?");
+        memoryString += " " + ((decoded.registerId != -1) ? registers[decoded.registerId]->getName() : "?");
 
     // Argument value (with addressing mode)
     // Size can be 0 (variable number of bytes)
     if (instruction->getNumBytes() != 1)
     {
-        QString argumentString = generateArgumentsString(address, instruction, addressingModeCode, argumentsSize);
+        QString argumentString = formatArguments(decoded);
         if (argumentString.length() > 0) {
             memoryString += " " + argumentString;
         }
@@ -1219,18 +2687,57 @@ QString Machine::generateInstructionString(int address, int &argumentsSize)
     return memoryString;
 }
 
-QString Machine::generateArgumentsString(int address, Instruction *instruction, AddressingMode::AddressingModeCode addressingModeCode, int &argumentsSize)
+QString Machine::formatArguments(const DecodedInstruction &decoded)
 {
     QString argument;
-    QString addressingModePattern = getAddressingModePattern(addressingModeCode);
+    QString addressingModePattern = getAddressingModePattern(decoded.addressingModeCode);
 
     if (addressingModePattern != AddressingMode::NO_PATTERN)
         argument = addressingModePattern.replace("(.*)", "").toUpper(); // Surround argument string with the corresponding addressing mode syntax
 
-    argumentsSize = instruction->getNumBytes() - 1;
     return argument;
 }
 
+DecodedInstruction Machine::decodeAssembledInstructionAt(int address)
+{
+    memory.swap(assemblerMemory); // decodeInstructionAt only reads memory, so it sees the assembler's image
+    DecodedInstruction decoded = decodeInstructionAt(address);
+    memory.swap(assemblerMemory);
+
+    return decoded;
+}
+
+// Decodes the instruction stored at the address from memory (no access count, no side effects)
+DecodedInstruction Machine::decodeInstructionAt(int address)
+{
+    int fetchedValue = getMemoryValue(address);
+
+    // Instruction, addressing mode and register only depend on the instruction byte
+    if (!opcodeDecoded[fetchedValue])
+    {
+        DecodedInstruction &opcode = opcodeDecodings[fetchedValue];
+
+        opcode.instruction = getInstructionFromValue(fetchedValue);
+        opcode.addressingModeCode = extractAddressingModeCode(fetchedValue);
+        opcode.registerId = -1;
+
+        for (int id = 0; id < registers.size() && opcode.registerId == -1; id++)
+        {
+            if (registers[id]->matchByte(fetchedValue))
+                opcode.registerId = id;
+        }
+
+        opcode.size = (opcode.instruction != nullptr && opcode.instruction->getNumBytes() > 0) ? opcode.instruction->getNumBytes() : 1;
+        opcodeDecoded[fetchedValue] = true;
+    }
+
+    DecodedInstruction decoded = opcodeDecodings[fetchedValue];
+    decoded.argument       = (decoded.size > 1) ? getMemoryValue(address + 1) : -1;
+    decoded.secondArgument = (decoded.size > 2) ? getMemoryValue(address + 2) : -1;
+
+    return decoded;
+}
+
 
 
 
@@ -1238,6 +2745,11 @@ QString Machine::generateArgumentsString(int address, Instruction *instruction,
 // Getters/setters, clear
 //////////////////////////////////////////////////
 
+QString Machine::getIdentifier() const
+{
+    return identifier;
+}
+
 bool Machine::isRunning() const
 {
     return this->running;
@@ -1274,9 +2786,9 @@ void Machine::setBreakpoint(int value)
 // Used to highlight the next operand
 void Machine::getNextOperandAddress(int &intermediateAddress, int &intermediateAddress2, int &finalOperandAddress)
 {
-    int fetchedValue = getMemoryValue(PC->getValue());
-    Instruction *instruction = getInstructionFromValue(fetchedValue);
-    AddressingMode::AddressingModeCode addressingModeCode = extractAddressingModeCode(fetchedValue);
+    DecodedInstruction decoded = decodeInstructionAt(PC->getValue()); // Opcode cache, no pattern matching
+    Instruction *instruction = decoded.instruction;
+    AddressingMode::AddressingModeCode addressingModeCode = decoded.addressingModeCode;
     int immediateAddress;
 
     intermediateAddress  = -1;
@@ -1328,33 +2840,39 @@ static bool isPowerOfTwo(unsigned int value)
 
 void Machine::setMemorySize(int size)
 {
-    memory.fill(nullptr, size);
-    assemblerMemory.fill(nullptr, size);
-    instructionStrings.fill("", size);
-    reserved.fill(false, size);
+    memory.fill(Byte(), size);
+    assemblerMemory.fill(Byte(), size);
+    reservedGeneration.fill(0, size); // Never the current generation
     changed.fill(true, size);
+    memoryActivity.reads.fill(0, size);
+    memoryActivity.writes.fill(0, size);
+    memoryActivity.executions.fill(0, size);
     addressCorrespondingSourceLine.fill(-1, size);
-    addressCorrespondingLabel.fill("", size);
-
-    for (int i=0; i<memory.size(); i++)
-    {
-        memory[i] = new Byte();
-        assemblerMemory[i] = new Byte();
-    }
+    addressCorrespondingLabel.clear();
+    reservedRanges.clear();
+    changedRanges.clear();
 
     Q_ASSERT(isPowerOfTwo(size)); // Size must be a power of two for the mask to work
     memoryMask = (size - 1);
+
+    clearInstructionStrings();
 }
 
 int Machine::getMemoryValue(int address) const
 {
-    return memory[address & memoryMask]->getValue();
+    return memory[address & memoryMask].getValue();
 }
 
 void Machine::setMemoryValue(int address, int value)
 {
-    memory[address & memoryMask]->setValue(value);
+    memory[address & memoryMask].setValue(value);
     changed[address & memoryMask] = true;
+
+    if (!instructionStringOutdated[address & memoryMask])
+    {
+        instructionStringOutdated[address & memoryMask] = true;
+        outdatedInstructionStrings.append(address & memoryMask);
+    }
 }
 
 bool Machine::hasByteChanged(int address)
@@ -1370,6 +2888,36 @@ bool Machine::hasByteChanged(int address)
     }
 }
 
+QVector<MemoryRange> Machine::takeChangedRanges()
+{
+    QVector<MemoryRange> ranges = changedRanges;
+    changedRanges.clear();
+
+    return ranges;
+}
+
+// Compares the visible labels with the last reported ones, visiting labels instead of addresses
+QVector<int> Machine::takeChangedLabels()
+{
+    QHash<int, QString> labels = (buildSuccessful) ? addressCorrespondingLabel : QHash<int, QString>();
+    QVector<int> addresses;
+
+    for (QHash<int, QString>::const_iterator it = labels.constBegin(); it != labels.constEnd(); ++it)
+    {
+        if (reportedLabels.value(it.key()) != it.value())
+            addresses.append(it.key());
+    }
+
+    for (QHash<int, QString>::const_iterator it = reportedLabels.constBegin(); it != reportedLabels.constEnd(); ++it)
+    {
+        if (!labels.contains(it.key()))
+            addresses.append(it.key());
+    }
+
+    reportedLabels = labels; // Implicitly shared
+    return addresses;
+}
+
 void Machine::clearMemory()
 {
     for (int i=0; i<memory.size(); i++)
@@ -1378,17 +2926,31 @@ void Machine::clearMemory()
 
 QString Machine::getInstructionString(int address)
 {
-    return instructionStrings[address & memoryMask];
+    return formatInstruction(disassembly[address & memoryMask]);
+}
+
+const DecodedInstruction& Machine::getDisassembledInstruction(int address) const
+{
+    return disassembly[address & memoryMask];
 }
 
-void Machine::setInstructionString(int address, QString value)
+QVector<MemoryRange> Machine::takeChangedInstructionStrings()
 {
-    instructionStrings[address & memoryMask] = value;
+    QVector<MemoryRange> ranges = changedInstructionStrings;
+    changedInstructionStrings.clear();
+
+    return ranges;
 }
 
 void Machine::clearInstructionStrings()
 {
-    instructionStrings.fill("", getMemorySize());
+    disassembly.fill(ARGUMENT_BYTE, getMemorySize()); // Empty strings
+    changedInstructionStrings.clear();
+    changedInstructionStrings.append(MemoryRange{0, getMemorySize()});
+    instructionStringPendingBytes.fill(0, getMemorySize());
+    instructionStringOutdated.fill(false, getMemorySize());
+    outdatedInstructionStrings.clear();
+    instructionStringsValid = false;
 }
 
 int Machine::getNumberOfFlags() const
@@ -1569,14 +3131,28 @@ void Machine::incrementPCValue(int units)
     PC->setValue(PC->getValue() + units);
 }
 
+int Machine::getStackSize()
+{
+    return 0;
+}
+
+int Machine::getStackValue(int)
+{
+    return 0;
+}
+
+void Machine::setStackValue(int, int)
+{
+}
+
 int Machine::getPCCorrespondingSourceLine()
 {
-    return addressCorrespondingSourceLine.value(PC->getValue(), -1);
+    return (isReserved(PC->getValue())) ? addressCorrespondingSourceLine[PC->getValue()] : -1;
 }
 
 int Machine::getAddressCorrespondingSourceLine(int address)
 {
-    return (buildSuccessful) ? addressCorrespondingSourceLine.value(address, -1) : -1;
+    return (buildSuccessful && isReserved(address)) ? addressCorrespondingSourceLine[address] : -1;
 }
 
 int Machine::getSourceLineCorrespondingAddress(int line)
@@ -1654,22 +3230,54 @@ QString Machine::getAddressingModePattern(AddressingMode::AddressingModeCode add
     return QString("");
 }
 
-int Machine::getInstructionCount()
+qint64 Machine::getInstructionCount()
 {
     return instructionCount;
 }
 
-int Machine::getAccessCount()
+qint64 Machine::getAccessCount()
 {
     return accessCount;
 }
 
+void Machine::setCounters(qint64 instructionCount, qint64 accessCount)
+{
+    this->instructionCount = instructionCount;
+    this->accessCount = accessCount;
+}
+
 void Machine::clearCounters()
 {
     instructionCount = 0;
     accessCount = 0;
 }
 
+const MemoryActivity& Machine::getMemoryActivity() const
+{
+    return memoryActivity;
+}
+
+void Machine::setMemoryActivity(const MemoryActivity &activity)
+{
+    memoryActivity = activity; // Implicitly shared
+}
+
+void Machine::setWriteLogEnabled(bool enabled)
+{
+    writeLogEnabled = enabled;
+    writeLog.clear();
+}
+
+const QVector<int>& Machine::getWriteLog() const
+{
+    return writeLog;
+}
+
+void Machine::clearWriteLog()
+{
+    writeLog.resize(0); // Keeps the capacity
+}
+
 void Machine::clear()
 {
     clearMemory();
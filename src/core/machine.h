@@ -8,7 +8,9 @@
 #include <QFile>
 #include <QHash>
 #include <QPair>
+#include <QByteArray>
 #include <iostream>
+#include <functional>
 
 #include "byte.h"
 #include "flag.h"
@@ -24,10 +26,48 @@ namespace FileErrorCode
         inputOutput,
         incorrectSize,
         invalidIdentifier,
-        invalidAddress
+        invalidAddress,
+        invalidChecksum
     };
 }
 
+/// Instruction decoded from memory without simulating it (no access count, no side effects)
+struct DecodedInstruction
+{
+    Instruction *instruction; // nullptr if the byte isn't an instruction
+    int registerId; // -1 if no register matches
+    AddressingMode::AddressingModeCode addressingModeCode;
+    int argument; // First argument's value (address or immediate), -1 if none
+    int secondArgument; // Second address (REG's "if r a0 a1"), -1 if none
+    int size; // In bytes, 0 for argument bytes in the memory view's disassembly
+};
+
+inline bool operator==(const DecodedInstruction &a, const DecodedInstruction &b)
+{
+    return a.instruction == b.instruction && a.registerId == b.registerId && a.addressingModeCode == b.addressingModeCode &&
+           a.argument == b.argument && a.secondArgument == b.secondArgument && a.size == b.size;
+}
+
+inline bool operator!=(const DecodedInstruction &a, const DecodedInstruction &b)
+{
+    return !(a == b);
+}
+
+/// Contiguous range of memory addresses
+struct MemoryRange
+{
+    int start;
+    int end; // Exclusive
+};
+
+/// Simulated accesses to each address since the memory size was set (counters wrap around)
+struct MemoryActivity
+{
+    QVector<quint32> reads; // Includes instruction fetches
+    QVector<quint32> writes;
+    QVector<quint32> executions; // Instructions fetched from the address
+};
+
 class Machine : public QObject
 {
     Q_OBJECT
@@ -53,6 +93,13 @@ public:
     QString ALLOCATE_SYMBOL = "%";
     QString QUOTE_SYMBOL = "¢";
 
+    /// Bumped whenever the assembler output changes, invalidating cached builds
+    static const int ASSEMBLER_VERSION = 2;
+    /// Bumped whenever the compact memory image layout changes
+    static const int MEMORY_IMAGE_VERSION = 1;
+    /// Bumped whenever the checkpoint layout changes
+    static const int CHECKPOINT_VERSION = 1;
+
     explicit Machine(QObject *parent = 0);
     ~Machine();
 
@@ -94,6 +141,10 @@ public:
 
     // Assembly
     void assemble(QString sourceCode);
+    void assembleUtf8(const char *data, qint64 size); // Reads lines in place, the text is never copied as a whole
+    FileErrorCode::FileErrorCode assembleFile(QString filename); // Memory-mapped, see assembleUtf8
+    void assembleLines(QStringList sourceLines, bool copyToMemory = true); // Trial builds only fill the assembler's image
+    void assembleLines(int numberOfLines, std::function<QString(int)> readLine, bool copyToMemory = true); // readLine returns a simplified line
     void obeyDirective(QString mnemonic, QString arguments, bool reserveOnly, int sourceLine);
     void buildInstruction(QString mnemonic, QString arguments);
     void emitError(int lineNumber, Machine::ErrorCode errorCode);
@@ -101,25 +152,34 @@ public:
     // Assembler memory
     void clearAssemblerData();
     void setAssemblerMemoryNext(int value); // Increments PC
+    void setAssemblerMemoryNextValue(int value, int numberOfBytes); // Increments PC
     void copyAssemblerMemoryToMemory();
     void reserveAssemblerMemory(int sizeToReserve, int associatedSourceLine);
+    void reserveAssemblerAddress(int address, int associatedSourceLine);
+    bool isReserved(int address) const;
+    int getAssemblerMemoryValue(int address) const; // 0 if not reserved
     virtual int calculateBytesToReserve(QString addressArgument);
 
-    // Assembler checks
-    bool isValidValue(QString valueString, int min, int max);
-    bool isValidNBytesValue(QString valueString, int numberOfBytes);
-    bool isValidByteValue(QString valueString);
-    bool isValidAddress(QString addressString);
-    bool isValidOrg(QString offsetString);
-
     // Auxiliary methods
+    QString simplifySourceLine(QString sourceLine); // Strips comments and whitespace
+    static QString removeLabel(QString sourceLine);
+    static QString removeExpressionWhitespace(QString const& arguments); // What's left only separates arguments
     QStringList splitDirectiveArguments(QString arguments);
+    bool parseLiteralArguments(const QString &arguments, QVector<qint64> &values);
     QStringList splitInstructionArguments(QString const& arguments, Instruction const& instruction);
     void extractArgumentAddressingModeCode(QString &argument, AddressingMode::AddressingModeCode &addressingModeCode);
     int convertToUnsigned(int value, int numberOfBytes);
     int argumentToValue(QString argument, bool isImmediate, int immediateNumBytes = 1);
     int stringToInt(QString valueString);
 
+    // Peephole optimization (see PeepholeOptimizer)
+    void optimizeAssembledLines(QStringList sourceLines);
+    bool isPeepholeOptimizationEnabled() const;
+    void setPeepholeOptimizationEnabled(bool enabled);
+    QStringList getOptimizationReport() const;
+    int getOptimizationBytesSaved() const;
+    int getOptimizationInstructionsRemoved() const;
+
 
 
     //////////////////////////////////////////////////
@@ -134,16 +194,80 @@ public:
     int GetCurrentOperandValue(); // increments accessCount
     int GetCurrentJumpAddress(); // increments accessCount
 
+    // Static access counts, following the same rules (used by ControlFlowGraph)
+    virtual int getOperandAddressAccessCount(AddressingMode::AddressingModeCode addressingModeCode);
+    virtual int getStaticAccessCount(const DecodedInstruction &decoded, bool branchTaken); // Includes the fetch
+
 
 
     //////////////////////////////////////////////////
     // Import/Export memory
     //////////////////////////////////////////////////
 
-    ///Set up the machine's memory from a .mem file
+    ///Set up the machine's memory from a .mem file or a compact memory image (detected by its header)
     FileErrorCode::FileErrorCode importMemory(QString filename, int start, int end, int dest);
     ///Save the machine's memory in a .mem file
     FileErrorCode::FileErrorCode exportMemory(QString filename);
+    ///Save the machine's memory in a compact memory image file
+    FileErrorCode::FileErrorCode exportMemoryImage(QString filename, bool includeState = true, bool compress = true);
+    ///Machine identifier stored in a .mem file's, memory image's or checkpoint's header (empty if unreadable)
+    static QString readMemoryFileIdentifier(QString filename);
+
+    ///Set up [start, end) of the memory, at dest, from an Intel HEX or raw binary file
+    FileErrorCode::FileErrorCode importIntelHex(QString filename, int start, int end, int dest);
+    FileErrorCode::FileErrorCode importBinary(QString filename, int start, int end, int dest);
+    ///Save [start, end) of the memory as Intel HEX records or raw bytes
+    FileErrorCode::FileErrorCode exportIntelHex(QString filename, int start, int end);
+    FileErrorCode::FileErrorCode exportBinary(QString filename, int start, int end);
+
+
+
+    //////////////////////////////////////////////////
+    // Compact memory image
+    //////////////////////////////////////////////////
+
+    ///Serialize the memory (run-length encoded if compress is set) and optionally registers, flags and stack
+    QByteArray saveMemoryImage(bool includeState, bool compress);
+    ///Load [start, end) of an image's memory to dest; state is only restored when loading the whole memory
+    FileErrorCode::FileErrorCode loadMemoryImage(const uchar *data, qint64 size, int start, int end, int dest);
+    static bool isMemoryImage(const uchar *data, qint64 size);
+
+
+
+    //////////////////////////////////////////////////
+    // Checkpoints
+    //////////////////////////////////////////////////
+
+    ///Serialize the complete machine state: memory image with registers, flags and stack, counters and breakpoint
+    QByteArray saveCheckpoint();
+    ///Restore a state serialized by saveCheckpoint, leaving the machine untouched on errors
+    FileErrorCode::FileErrorCode loadCheckpoint(const uchar *data, qint64 size);
+    ///Save a checkpoint file (replaced atomically) or resume from one
+    FileErrorCode::FileErrorCode exportCheckpoint(QString filename);
+    FileErrorCode::FileErrorCode importCheckpoint(QString filename);
+    static bool isCheckpoint(const uchar *data, qint64 size);
+
+
+
+    //////////////////////////////////////////////////
+    // Assembled image (see AssemblyCache)
+    //////////////////////////////////////////////////
+
+    ///Serialize the result of the last successful build (image, source map and labels)
+    QByteArray saveAssembledImage();
+    ///Restore a build serialized by saveAssembledImage, as if assemble() had been called
+    bool loadAssembledImage(const uchar *data, qint64 size);
+
+
+
+    //////////////////////////////////////////////////
+    // Listing
+    //////////////////////////////////////////////////
+
+    ///Listing of the last build, annotated with static costs of each basic block and loop
+    QString generateListing(QString sourceCode);
+    ///Save the listing in a text file
+    FileErrorCode::FileErrorCode exportListing(QString filename, QString sourceCode);
 
 
 
@@ -152,9 +276,12 @@ public:
     //////////////////////////////////////////////////
 
     ///Given the current position of the program counter, update the interpretation of the bytes
+    ///(only around bytes written and PC moves since the last update). Text is formatted on demand.
     void updateInstructionStrings();
-    QString generateInstructionString(int address, int &argumentsSize); // TODO: Fix Pericles
-    virtual QString generateArgumentsString(int address, Instruction *instruction, AddressingMode::AddressingModeCode addressingModeCode, int &argumentsSize);
+    virtual DecodedInstruction decodeInstructionAt(int address);
+    DecodedInstruction decodeAssembledInstructionAt(int address); // From the assembler's image, for builds not copied to memory
+    QString formatInstruction(const DecodedInstruction &decoded); // Empty for NOP, invalid instructions and argument bytes
+    virtual QString formatArguments(const DecodedInstruction &decoded);
 
 
 
@@ -162,6 +289,8 @@ public:
     // Getters/setters, clear
     //////////////////////////////////////////////////
 
+    QString getIdentifier() const;
+
     bool isRunning() const;
     void setRunning(bool running);
 
@@ -178,10 +307,13 @@ public:
     int  getMemoryValue(int address) const;
     void setMemoryValue(int address, int value);
     bool hasByteChanged(int address); // Since last look-up
+    QVector<MemoryRange> takeChangedRanges(); // Changed by builds since last look-up
+    QVector<int> takeChangedLabels(); // Addresses whose getAddressCorrespondingLabel changed since last look-up
     void clearMemory();
 
-    QString getInstructionString(int address);
-    void setInstructionString(int address, QString value);
+    QString getInstructionString(int address); // Formats the disassembled instruction
+    const DecodedInstruction& getDisassembledInstruction(int address) const;
+    QVector<MemoryRange> takeChangedInstructionStrings(); // Since last look-up
     void clearInstructionStrings();
 
     int  getNumberOfFlags() const;
@@ -209,6 +341,10 @@ public:
     void setPCValue(int value);
     void incrementPCValue(int units = 1);
 
+    virtual int  getStackSize(); // 0 if the machine has no stack
+    virtual int  getStackValue(int address);
+    virtual void setStackValue(int address, int value);
+
     int getPCCorrespondingSourceLine();
     int getSourceLineCorrespondingAddress(int line);
     int getAddressCorrespondingSourceLine(int address);
@@ -223,10 +359,18 @@ public:
     int getAddressingModeBitCode(AddressingMode::AddressingModeCode addressingModeCode);
     QString getAddressingModePattern(AddressingMode::AddressingModeCode addressingModeCode);
 
-    int  getInstructionCount();
-    int  getAccessCount();
+    qint64 getInstructionCount();
+    qint64 getAccessCount();
+    void setCounters(qint64 instructionCount, qint64 accessCount); // Mirrors a machine simulated elsewhere
     void clearCounters();
 
+    const MemoryActivity& getMemoryActivity() const; // Counted by memoryRead, memoryWrite and fetchInstruction
+    void setMemoryActivity(const MemoryActivity &activity); // Mirrors a machine simulated elsewhere
+
+    void setWriteLogEnabled(bool enabled); // Clears the log
+    const QVector<int>& getWriteLog() const; // Addresses written by memoryWrite since the log was cleared
+    void clearWriteLog();
+
     virtual void clear();
     virtual void clearAfterBuild();
 
@@ -263,19 +407,44 @@ protected:
     ///Program counter
     Register *PC;
     ///Simulated memory
-    QVector<Byte*> memory;
-    ///Simulated memory configuration created by the assembler
-    QVector<Byte*> assemblerMemory;
+    QVector<Byte> memory;
+    ///Simulated memory configuration created by the assembler (zero outside reserved addresses)
+    QVector<Byte> assemblerMemory;
     ///Interpretation of each memory adress as an instruction based on PC position
-    QVector<QString> instructionStrings;
-    ///Reserved memory
-    QVector<bool> reserved;
-    // Each address may be associated with a line of code
+    QVector<DecodedInstruction> disassembly;
+    ///Addresses whose disassembly changed since takeChangedInstructionStrings
+    QVector<MemoryRange> changedInstructionStrings;
+    ///Arguments of the previous instruction still pending when the disassembly reaches each address (0 at instruction starts)
+    QVector<int> instructionStringPendingBytes;
+    ///Addresses written since the last updateInstructionStrings
+    QVector<int> outdatedInstructionStrings;
+    QVector<bool> instructionStringOutdated;
+    bool instructionStringsValid; // False forces a full update
+    int instructionStringsPC; // PC used by the last update
+    ///Decoding of each instruction byte (without arguments), filled as decodeInstructionAt finds them
+    QVector<DecodedInstruction> opcodeDecodings;
+    QVector<bool> opcodeDecoded;
+    ///Reserved memory: an address is reserved if stamped with the current assembler generation,
+    ///so clearAssemblerData doesn't need to visit every address
+    QVector<quint32> reservedGeneration;
+    quint32 assemblerGeneration;
+    ///Addresses reserved by the current generation, cleared by the next one
+    QVector<MemoryRange> reservedRanges;
+    ///Addresses changed by copyAssemblerMemoryToMemory since takeChangedRanges, sorted and disjoint
+    QVector<MemoryRange> changedRanges;
+    // Each address may be associated with a line of code (only valid for reserved addresses)
     QVector<int> addressCorrespondingSourceLine, sourceLineCorrespondingAddress;
     ///Each adress' corresponding label
-    QVector<QString> addressCorrespondingLabel;
+    QHash<int, QString> addressCorrespondingLabel;
+    ///Labels as last reported by takeChangedLabels
+    QHash<int, QString> reportedLabels;
     ///True values indicate the memory adress associated to this position has been changed
     QVector<bool> changed;
+    ///Per-address access counters (see getMemoryActivity)
+    MemoryActivity memoryActivity;
+    ///Addresses written while recording an execution (see ExecutionTrace)
+    QVector<int> writeLog;
+    bool writeLogEnabled;
     ///The machine's flags
     QVector<Flag*> flags;
     ///The machine's instructions
@@ -284,10 +453,18 @@ protected:
     QVector<AddressingMode*> addressingModes;
     ///Map of labels to adresses
     QHash<QString, int> labelPCMap;
+    ///Address of the statement being assembled (value of $ in expressions)
+    int currentStatementAddress;
     ///Instruction descriptions
     QHash<QString, QString> descriptions;
 
 
+    ///Peephole optimizer settings and results of the last build
+    bool peepholeOptimizationEnabled;
+    QStringList optimizationReport;
+    int optimizationBytesSaved;
+    int optimizationInstructionsRemoved;
+
     bool buildSuccessful;
     bool running;
     bool littleEndian;
@@ -296,9 +473,9 @@ protected:
     ///Breakpoint position
     int breakpoint;
     ///Amount of instructions executed during simulation
-    int instructionCount;
+    qint64 instructionCount;
     ///Number of memory acesses done during simulation
-    int accessCount;
+    qint64 accessCount;
     ///Used to "cut down" memory adresses to the machine's maximum address
     int memoryMask;
     
@@ -0,0 +1,505 @@
+#include "peepholeoptimizer.h"
+
+#include <QPair>
+#include <QSet>
+
+// Limit for the flag liveness search (instructions visited)
+static const int MAX_VISITED_INSTRUCTIONS = 1024;
+
+PeepholeOptimizer::PeepholeOptimizer(Machine &machine) :
+    machine(machine)
+{
+}
+
+
+
+//////////////////////////////////////////////////
+// Build snapshot
+//////////////////////////////////////////////////
+
+PeepholeOptimizer::Build PeepholeOptimizer::captureBuild(const QStringList &sourceLines)
+{
+    static QRegExp whitespace("\\s+");
+
+    Build build;
+    int memorySize = machine.getMemorySize();
+    DecodedInstruction notDecoded = {nullptr, -1, AddressingMode::DIRECT, -1, -1, 0};
+
+    build.lineAddress.fill(-1, sourceLines.size());
+    build.lineSize.fill(0, sourceLines.size());
+    build.decoded.fill(notDecoded, sourceLines.size());
+    build.addressLine.fill(-1, memorySize);
+    build.isJumpTarget.fill(false, memorySize);
+
+    for (int address = 0; address < memorySize; address++)
+    {
+        int line = machine.getAddressCorrespondingSourceLine(address);
+
+        if (line >= 0 && line < sourceLines.size())
+        {
+            build.addressLine[address] = line;
+            build.lineSize[line] += 1;
+        }
+
+        QString label = machine.getAddressCorrespondingLabel(address);
+
+        if (!label.isEmpty())
+        {
+            build.isJumpTarget[address] = true;
+            build.labelAddress.insert(label.toLower(), address);
+        }
+    }
+
+    for (int line = 0; line < sourceLines.size(); line++)
+    {
+        build.statements.append(Machine::removeLabel(sourceLines[line]));
+        build.lineAddress[line] = machine.getSourceLineCorrespondingAddress(line);
+
+        QString mnemonic = build.statements[line].section(whitespace, 0, 0).toLower();
+        if (build.lineSize[line] == 0 || machine.getInstructionFromMnemonic(mnemonic) == nullptr)
+            continue;
+
+        DecodedInstruction decoded = machine.decodeAssembledInstructionAt(build.lineAddress[line]); // Trial builds aren't in memory
+        build.decoded[line] = decoded;
+
+        // Mark targets of direct jumps
+        if (decoded.instruction == nullptr || decoded.addressingModeCode != AddressingMode::DIRECT)
+            continue;
+
+        Instruction::InstructionCode instructionCode = decoded.instruction->getInstructionCode();
+
+        if (isJump(instructionCode) || instructionCode == Instruction::REG_IF)
+            build.isJumpTarget[machine.address(decoded.argument)] = true;
+        if (instructionCode == Instruction::REG_IF)
+            build.isJumpTarget[machine.address(decoded.secondArgument)] = true;
+        if (instructionCode == Instruction::JSR) // Return address is stored at the target, execution starts after it
+            build.isJumpTarget[machine.address(decoded.argument + 1)] = true;
+    }
+
+    return build;
+}
+
+
+
+//////////////////////////////////////////////////
+// Rewrites
+//////////////////////////////////////////////////
+
+QVector<PeepholeOptimizer::Rewrite> PeepholeOptimizer::findRewrites(const Build &build)
+{
+    QVector<Rewrite> rewrites;
+    QVector<int> instructionLines;
+
+    for (int line = 0; line < build.decoded.size(); line++)
+    {
+        if (build.decoded[line].instruction != nullptr)
+            instructionLines.append(line);
+    }
+
+    int lastClaimedLine = -1; // Rewrites sharing a line aren't returned together
+
+    for (int i = 0; i < instructionLines.size(); i++)
+    {
+        int line = instructionLines[i];
+        int previousLine = (i > 0 && isAdjacent(build, instructionLines[i - 1], line)) ? instructionLines[i - 1] : -1;
+        int nextLine = (i + 1 < instructionLines.size() && isAdjacent(build, line, instructionLines[i + 1])) ? instructionLines[i + 1] : -1;
+
+        Rewrite rewrite;
+        rewrite.line = line;
+        rewrite.firstLine = (previousLine != -1) ? previousLine : line;
+        rewrite.lastLine = line;
+        rewrite.bytesSaved = 0;
+        rewrite.instructionsRemoved = 0;
+
+        if (rewrite.firstLine <= lastClaimedLine)
+            continue;
+
+        bool found = findJumpToNext(build, line, rewrite)
+                || (nextLine != -1 && findRedundantLoad(build, previousLine, line, nextLine, rewrite))
+                || (nextLine != -1 && findNegation(build, line, nextLine, rewrite));
+
+        if (found)
+        {
+            foreach (int rewrittenLine, rewrite.statements.keys())
+                rewrite.lastLine = qMax(rewrite.lastLine, rewrittenLine);
+
+            rewrites.append(rewrite);
+            lastClaimedLine = rewrite.lastLine;
+        }
+    }
+
+    return rewrites;
+}
+
+PeepholeOptimizer::Rewrite PeepholeOptimizer::mergeRewrites(const QVector<Rewrite> &rewrites)
+{
+    Rewrite merged;
+    merged.line = merged.firstLine = merged.lastLine = -1;
+    merged.bytesSaved = 0;
+    merged.instructionsRemoved = 0;
+
+    foreach (const Rewrite &rewrite, rewrites)
+    {
+        for (QHash<int, QString>::const_iterator it = rewrite.statements.constBegin(); it != rewrite.statements.constEnd(); ++it)
+            merged.statements.insert(it.key(), it.value());
+
+        merged.bytesSaved += rewrite.bytesSaved;
+        merged.instructionsRemoved += rewrite.instructionsRemoved;
+    }
+
+    return merged;
+}
+
+// Replaces statements, keeping the labels of the rewritten lines
+QStringList PeepholeOptimizer::applyRewrite(QStringList sourceLines, const Rewrite &rewrite)
+{
+    foreach (int line, rewrite.statements.keys())
+    {
+        QString label = (sourceLines[line].contains(":")) ? sourceLines[line].section(":", 0, 0) + ": " : "";
+        sourceLines[line] = (label + rewrite.statements.value(line)).trimmed();
+    }
+
+    return sourceLines;
+}
+
+// Checks the machine's current build (the rewritten program) against the original one: every
+// untouched instruction must be the same, with its address operands following the moved code,
+// and no address used as a value may have moved
+bool PeepholeOptimizer::isRelocationValid(const Build &original, const Rewrite &rewrite, const QStringList &rewrittenLines)
+{
+    if (!machine.getBuildSuccessful())
+        return false;
+
+    Build current = captureBuild(rewrittenLines);
+
+    for (int line = 0; line < original.decoded.size(); line++)
+    {
+        const DecodedInstruction &before = original.decoded[line];
+        const DecodedInstruction &after  = current.decoded[line];
+
+        if (rewrite.statements.contains(line))
+            continue;
+
+        if (hasMovedValueOperand(original, current, line))
+            return false;
+
+        if (before.instruction == nullptr)
+            continue;
+
+        if (after.instruction != before.instruction || after.size != before.size || after.registerId != before.registerId)
+            return false;
+        if (before.addressingModeCode != after.addressingModeCode || before.addressingModeCode == AddressingMode::INDEXED_BY_PC)
+            return false; // PC-relative operands can't be checked
+
+        if (before.addressingModeCode != AddressingMode::IMMEDIATE && before.argument != -1)
+        {
+            if (after.argument != relocateAddress(original, current, before.argument))
+                return false;
+        }
+
+        if (before.secondArgument != -1)
+        {
+            if (after.secondArgument != relocateAddress(original, current, before.secondArgument))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+
+
+//////////////////////////////////////////////////
+// Patterns
+//////////////////////////////////////////////////
+
+// JMP/Jcc to the instruction right after it
+bool PeepholeOptimizer::findJumpToNext(const Build &build, int line, Rewrite &rewrite)
+{
+    const DecodedInstruction &jump = build.decoded[line];
+
+    if (!isJump(jump.instruction->getInstructionCode()) || jump.addressingModeCode != AddressingMode::DIRECT)
+        return false;
+    if (jump.argument != machine.address(build.lineAddress[line] + jump.size))
+        return false;
+
+    rewrite.statements.insert(line, "");
+    rewrite.description = QString("%1 para a instrução seguinte removido").arg(jump.instruction->getMnemonic().toUpper());
+    rewrite.bytesSaved = jump.size;
+    rewrite.instructionsRemoved = 1;
+
+    return true;
+}
+
+// STR r x followed by LDR r x: the load only updates N and Z, which must already reflect r
+bool PeepholeOptimizer::findRedundantLoad(const Build &build, int previousLine, int storeLine, int loadLine, Rewrite &rewrite)
+{
+    const DecodedInstruction &store = build.decoded[storeLine];
+    const DecodedInstruction &load  = build.decoded[loadLine];
+    int loadAddress = build.lineAddress[loadLine];
+
+    if (store.instruction->getInstructionCode() != Instruction::STR || load.instruction->getInstructionCode() != Instruction::LDR)
+        return false;
+    if (store.addressingModeCode != AddressingMode::DIRECT || load.addressingModeCode != AddressingMode::DIRECT)
+        return false;
+    if (store.registerId != load.registerId || store.argument != load.argument)
+        return false;
+    if (build.isJumpTarget[loadAddress]) // Load may be reached without the store
+        return false;
+    if (store.argument >= loadAddress && store.argument < loadAddress + load.size) // Store modifies the load
+        return false;
+    if (!flagsFollowRegister(build, previousLine, storeLine, store.registerId))
+        return false;
+
+    rewrite.line = loadLine;
+    rewrite.statements.insert(loadLine, "");
+    rewrite.description = QString("%1 redundante removido (valor já armazenado pelo %2 anterior)")
+            .arg(load.instruction->getMnemonic().toUpper())
+            .arg(store.instruction->getMnemonic().toUpper());
+    rewrite.bytesSaved = load.size;
+    rewrite.instructionsRemoved = 1;
+
+    return true;
+}
+
+// NOT r followed by ADD r #1 is a two's complement negation
+bool PeepholeOptimizer::findNegation(const Build &build, int notLine, int addLine, Rewrite &rewrite)
+{
+    const DecodedInstruction &complement = build.decoded[notLine];
+    const DecodedInstruction &increment  = build.decoded[addLine];
+    Instruction *negation = getInstructionFromCode(Instruction::NEG);
+
+    if (negation == nullptr)
+        return false;
+    if (complement.instruction->getInstructionCode() != Instruction::NOT || increment.instruction->getInstructionCode() != Instruction::ADD)
+        return false;
+    if (increment.addressingModeCode != AddressingMode::IMMEDIATE || increment.argument != 1)
+        return false;
+    if (complement.registerId != increment.registerId || build.isJumpTarget[build.lineAddress[addLine]])
+        return false;
+    if (!isCarryDeadAfter(build, addLine)) // NEG doesn't update C and V like ADD does
+        return false;
+
+    QString statement = negation->getMnemonic().toUpper();
+    if (negation->getArguments().contains("r"))
+        statement += " " + machine.getRegisterName(complement.registerId);
+
+    rewrite.statements.insert(notLine, statement);
+    rewrite.statements.insert(addLine, "");
+    rewrite.description = QString("%1 e %2 #1 substituídos por %3")
+            .arg(complement.instruction->getMnemonic().toUpper())
+            .arg(increment.instruction->getMnemonic().toUpper())
+            .arg(statement);
+    rewrite.bytesSaved = complement.size + increment.size - negation->getNumBytes();
+    rewrite.instructionsRemoved = 1;
+
+    return true;
+}
+
+
+
+//////////////////////////////////////////////////
+// Analysis
+//////////////////////////////////////////////////
+
+// True if the second line's instruction is stored right after the first's
+bool PeepholeOptimizer::isAdjacent(const Build &build, int firstLine, int secondLine)
+{
+    return machine.address(build.lineAddress[firstLine] + build.lineSize[firstLine]) == build.lineAddress[secondLine];
+}
+
+// True if N and Z reflect the register's value when the line is executed
+bool PeepholeOptimizer::flagsFollowRegister(const Build &build, int previousLine, int line, int registerId)
+{
+    // With a single accumulator, every instruction that writes it also updates N and Z
+    if (hasSingleAccumulator())
+        return true;
+
+    if (previousLine == -1 || build.isJumpTarget[build.lineAddress[line]])
+        return false;
+
+    const DecodedInstruction &previous = build.decoded[previousLine];
+
+    switch (previous.instruction->getInstructionCode())
+    {
+    case Instruction::LDR: case Instruction::ADD: case Instruction::OR:  case Instruction::AND:
+    case Instruction::NOT: case Instruction::SUB: case Instruction::NEG: case Instruction::SHR:
+    case Instruction::SHL: case Instruction::ROR: case Instruction::ROL:
+        return previous.instruction->getArguments().contains("r") && previous.registerId == registerId;
+
+    default:
+        return false;
+    }
+}
+
+// True if C (and V, if present) are overwritten before being read on every path that follows the line
+bool PeepholeOptimizer::isCarryDeadAfter(const Build &build, int line)
+{
+    const int CARRY = 0x1, OVERFLOW = 0x2;
+    int initialFlags = CARRY | (machine.hasFlag(Flag::OVERFLOW_FLAG) ? OVERFLOW : 0);
+    int subtractionFlags = OVERFLOW | (machine.hasFlag(Flag::BORROW) ? 0 : CARRY);
+
+    QVector<QPair<int, int>> pending; // Address, flags still live
+    QSet<QPair<int, int>> visited;
+
+    pending.append(qMakePair(machine.address(build.lineAddress[line] + build.lineSize[line]), initialFlags));
+
+    while (!pending.isEmpty())
+    {
+        QPair<int, int> state = pending.takeLast();
+        int address = state.first, liveFlags = state.second;
+
+        if (visited.contains(state))
+            continue;
+        if (visited.size() >= MAX_VISITED_INSTRUCTIONS)
+            return false;
+        visited.insert(state);
+
+        // Only follow assembled instructions
+        int instructionLine = build.addressLine[address];
+        if (instructionLine < 0 || build.lineAddress[instructionLine] != address || build.decoded[instructionLine].instruction == nullptr)
+            return false;
+
+        const DecodedInstruction &decoded = build.decoded[instructionLine];
+        Instruction::InstructionCode instructionCode = decoded.instruction->getInstructionCode();
+        int readFlags = 0, writtenFlags = 0;
+
+        switch (instructionCode)
+        {
+        case Instruction::JC: case Instruction::JNC: case Instruction::JB: case Instruction::JNB:
+        case Instruction::ROR: case Instruction::ROL:
+            readFlags = CARRY;
+            break;
+        case Instruction::JV: case Instruction::JNV:
+            readFlags = OVERFLOW;
+            break;
+        case Instruction::ADD:
+            writtenFlags = CARRY | OVERFLOW;
+            break;
+        case Instruction::SUB:
+            writtenFlags = subtractionFlags;
+            break;
+        case Instruction::SHR: case Instruction::SHL:
+            writtenFlags = CARRY;
+            break;
+        case Instruction::JSR: // Subroutine may read the flags
+            return false;
+        case Instruction::HLT:
+            continue;
+        default:
+            break;
+        }
+
+        if (liveFlags & readFlags)
+            return false;
+
+        liveFlags &= ~writtenFlags;
+        if (liveFlags == 0)
+            continue;
+
+        // Successors
+        int nextAddress = machine.address(address + decoded.size);
+
+        if (isJump(instructionCode))
+        {
+            if (decoded.addressingModeCode != AddressingMode::DIRECT)
+                return false;
+
+            pending.append(qMakePair(machine.address(decoded.argument), liveFlags));
+            if (instructionCode == Instruction::JMP)
+                continue;
+        }
+
+        pending.append(qMakePair(nextAddress, liveFlags));
+    }
+
+    return true;
+}
+
+bool PeepholeOptimizer::hasSingleAccumulator()
+{
+    int accessibleRegisters = 0;
+
+    for (int id = 0; id < machine.getNumberOfRegisters(); id++)
+    {
+        if (machine.getRegisterBitCode(machine.getRegisterName(id)) != Register::NO_BIT_CODE)
+            accessibleRegisters++;
+    }
+
+    // INC/DEC write registers without updating flags
+    return accessibleRegisters == 1 && getInstructionFromCode(Instruction::INC) == nullptr && getInstructionFromCode(Instruction::DEC) == nullptr;
+}
+
+Instruction* PeepholeOptimizer::getInstructionFromCode(Instruction::InstructionCode instructionCode)
+{
+    foreach (Instruction *instruction, machine.getInstructions())
+    {
+        if (instruction->getInstructionCode() == instructionCode)
+            return instruction;
+    }
+
+    return nullptr;
+}
+
+// Where an address of the original build ended up, -1 if its bytes were removed
+int PeepholeOptimizer::relocateAddress(const Build &original, const Build &current, int address)
+{
+    int line = original.addressLine.value(address, -1);
+
+    if (line < 0)
+        return address; // Unassembled memory doesn't move
+
+    int offset = address - original.lineAddress[line];
+
+    // A removed line is replaced by the statement that follows it
+    if (offset > 0 && offset >= current.lineSize[line])
+        return -1;
+
+    return current.lineAddress[line] + offset;
+}
+
+// True if the line is a DB/DW directive or an immediate instruction whose operand refers to a
+// label (or $) that isn't at the same address in both builds
+bool PeepholeOptimizer::hasMovedValueOperand(const Build &original, const Build &current, int line)
+{
+    static QRegExp whitespace("\\s+");
+    static QRegExp quotedText("'[^']*'|\"[^\"]*\"");
+    static QRegExp identifier("\\b[a-z_][a-z0-9_]*");
+
+    QString mnemonic = original.statements[line].section(whitespace, 0, 0).toLower();
+    bool isData = (mnemonic == "db" || mnemonic == "dw" || mnemonic == "dab" || mnemonic == "daw");
+    bool isImmediate = (original.decoded[line].instruction != nullptr && original.decoded[line].addressingModeCode == AddressingMode::IMMEDIATE);
+
+    if (!isData && !isImmediate)
+        return false;
+
+    QString operands = original.statements[line].section(whitespace, 1).toLower();
+    operands.replace(quotedText, " "); // Text isn't an expression
+
+    if (operands.contains("$") && original.lineAddress[line] != current.lineAddress[line])
+        return true;
+
+    for (int position = identifier.indexIn(operands); position != -1; position = identifier.indexIn(operands, position + identifier.matchedLength()))
+    {
+        QString name = identifier.cap(0);
+
+        if (original.labelAddress.contains(name) && original.labelAddress.value(name) != current.labelAddress.value(name, -1))
+            return true;
+    }
+
+    return false;
+}
+
+bool PeepholeOptimizer::isJump(Instruction::InstructionCode instructionCode)
+{
+    switch (instructionCode)
+    {
+    case Instruction::JMP: case Instruction::JN:  case Instruction::JP: case Instruction::JV:
+    case Instruction::JNV: case Instruction::JZ:  case Instruction::JNZ:
+    case Instruction::JC:  case Instruction::JNC: case Instruction::JB: case Instruction::JNB:
+        return true;
+
+    default:
+        return false;
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef PEEPHOLEOPTIMIZER_H
+#define PEEPHOLEOPTIMIZER_H
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "machine.h"
+
+/// Finds local optimizations in an assembled program, driven by the machine's instruction table:
+///
+///   STR r x / LDR r x        -> STR r x      (when N and Z already reflect r)
+///   JMP next                 -> (removed)    (also conditional jumps)
+///   NOT r / ADD r #1         -> NEG r        (when C and V are overwritten before being read)
+///
+/// Rewrites are expressed on source lines, so the program is reassembled with them and labels,
+/// addresses and source maps stay consistent. The rewrites found in one pass never share lines,
+/// so Machine::optimizeAssembledLines validates them together, keeping them only if
+/// isRelocationValid accepts the new build.
+/// Addresses used as values (immediate operands, DB/DW data) can't be told apart from numbers
+/// once assembled, so a rewrite is refused if it moves a label or $ referenced that way.
+class PeepholeOptimizer
+{
+public:
+    /// Snapshot of a successful build, indexed by source line or address
+    struct Build
+    {
+        QStringList statements; // Source lines without labels
+        QVector<int> lineAddress; // Lines without bytes point to the next statement
+        QVector<int> lineSize; // Bytes emitted by each line
+        QVector<int> addressLine; // -1 for unassembled addresses
+        QVector<DecodedInstruction> decoded; // Per line, instruction == nullptr if not an instruction
+        QVector<bool> isJumpTarget; // Per address: labelled or target of a direct jump
+        QHash<QString, int> labelAddress; // Lowercase label names
+    };
+
+    struct Rewrite
+    {
+        int line; // First line affected (reported)
+        int firstLine, lastLine; // Lines the pattern reads or changes
+        QHash<int, QString> statements; // Replacement statement for each line (empty to remove it)
+        QString description;
+        int bytesSaved;
+        int instructionsRemoved;
+    };
+
+    explicit PeepholeOptimizer(Machine &machine);
+
+    Build captureBuild(const QStringList &sourceLines);
+    QVector<Rewrite> findRewrites(const Build &build);
+    QStringList applyRewrite(QStringList sourceLines, const Rewrite &rewrite);
+    static Rewrite mergeRewrites(const QVector<Rewrite> &rewrites); // Statements and totals of all of them
+    bool isRelocationValid(const Build &original, const Rewrite &rewrite, const QStringList &rewrittenLines);
+
+private:
+    bool findJumpToNext(const Build &build, int line, Rewrite &rewrite);
+    bool findRedundantLoad(const Build &build, int previousLine, int storeLine, int loadLine, Rewrite &rewrite);
+    bool findNegation(const Build &build, int notLine, int addLine, Rewrite &rewrite);
+
+    bool isAdjacent(const Build &build, int firstLine, int secondLine);
+    bool flagsFollowRegister(const Build &build, int previousLine, int line, int registerId);
+    bool isCarryDeadAfter(const Build &build, int line);
+    bool hasSingleAccumulator();
+    Instruction* getInstructionFromCode(Instruction::InstructionCode instructionCode);
+    int relocateAddress(const Build &original, const Build &current, int address);
+    bool hasMovedValueOperand(const Build &original, const Build &current, int line);
+
+    static bool isJump(Instruction::InstructionCode instructionCode); // Jumps and conditional jumps (not JSR)
+
+    Machine &machine;
+};
+
+#endif // PEEPHOLEOPTIMIZER_H
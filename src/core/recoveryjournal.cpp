@@ -0,0 +1,348 @@
+#include "recoveryjournal.h"
+
+#include <QDir>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QUuid>
+#include <QtEndian>
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+static const char JOURNAL_MAGIC[] = "HRJ1";
+static const char JOURNAL_EXTENSION[] = ".hrj";
+static const char LOCK_EXTENSION[] = ".lock";
+static const int RECORD_HEADER_SIZE = 7; // Type, payload size, checksum
+
+static void appendUInt32(QByteArray &buffer, quint32 value)
+{
+    uchar bytes[4];
+    qToLittleEndian(value, bytes);
+    buffer.append((const char *)bytes, 4);
+}
+
+static bool syncToDisk(QFile &file)
+{
+    if (!file.flush())
+        return false;
+
+#ifdef Q_OS_WIN
+    return _commit(file.handle()) == 0;
+#else
+    return fsync(file.handle()) == 0;
+#endif
+}
+
+RecoveryJournal::RecoveryJournal(QString directory, QObject *parent) :
+    QThread(parent),
+    directory(directory),
+    filename(QDir(directory).absoluteFilePath(QUuid::createUuid().toString().mid(1, 36) + JOURNAL_EXTENSION)), // Unique even if a PID is reused
+    lockFile(filename + LOCK_EXTENSION),
+    hasPendingText(false),
+    isWriting(false),
+    discardRequested(false),
+    stopRequested(false)
+{
+    QDir().mkpath(directory);
+
+    lockFile.setStaleLockTime(0); // Only stale once the process is gone
+    lockFile.tryLock(0); // Errors are ignored, the journal just can't be told apart from an orphan
+}
+
+RecoveryJournal::~RecoveryJournal()
+{
+    {
+        QMutexLocker locker(&mutex);
+        stopRequested = true;
+        pendingCondition.wakeAll();
+    }
+
+    wait();
+}
+
+QString RecoveryJournal::getFilename() const
+{
+    return filename;
+}
+
+bool RecoveryJournal::adoptOrphan(QString &text)
+{
+    QFileInfoList journals = QDir(directory).entryInfoList(QStringList() << QString("*") + JOURNAL_EXTENSION, QDir::Files, QDir::Time); // Newest first
+
+    foreach (const QFileInfo &journal, journals)
+    {
+        QString orphanFilename = journal.absoluteFilePath();
+
+        if (orphanFilename == filename)
+            continue;
+
+        // Fails while the instance that wrote it is running (including this one)
+        QLockFile orphanLock(orphanFilename + LOCK_EXTENSION);
+        orphanLock.setStaleLockTime(0);
+
+        if (!orphanLock.tryLock(0))
+            continue;
+
+        QString orphanText;
+
+        if (!recover(orphanFilename, orphanText))
+        {
+            QFile::remove(orphanFilename); // Nothing valid left in it
+            continue;
+        }
+
+        // Renamed, so it keeps protecting the text until this journal's first snapshot replaces it
+        if (QFile::rename(orphanFilename, filename))
+        {
+            text = orphanText;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void RecoveryJournal::save(const QString &text)
+{
+    {
+        QMutexLocker locker(&mutex);
+        pendingText = text; // Replaces a text not written yet
+        hasPendingText = true;
+        pendingCondition.wakeAll();
+    }
+
+    if (!isRunning())
+        start(QThread::LowPriority);
+}
+
+void RecoveryJournal::flush()
+{
+    QMutexLocker locker(&mutex);
+
+    while ((hasPendingText || isWriting || discardRequested) && isRunning())
+        writtenCondition.wait(&mutex);
+}
+
+void RecoveryJournal::discard()
+{
+    {
+        QMutexLocker locker(&mutex);
+        pendingText.clear();
+        hasPendingText = false;
+        discardRequested = true;
+        pendingCondition.wakeAll();
+    }
+
+    if (!isRunning())
+        start(QThread::LowPriority);
+}
+
+
+
+//////////////////////////////////////////////////
+// Worker thread
+//////////////////////////////////////////////////
+
+void RecoveryJournal::run()
+{
+    forever
+    {
+        QString text;
+        bool discarding;
+
+        {
+            QMutexLocker locker(&mutex);
+
+            while (!hasPendingText && !discardRequested && !stopRequested)
+                pendingCondition.wait(&mutex);
+
+            if (!hasPendingText && !discardRequested) // Stopped, nothing left to write
+                break;
+
+            discarding = discardRequested;
+            text = pendingText;
+            pendingText.clear();
+            hasPendingText = false;
+            discardRequested = false;
+            isWriting = true;
+        }
+
+        if (discarding)
+        {
+            journalFile.close();
+            QFile::remove(filename);
+            writtenText.clear();
+        }
+        else
+        {
+            writeText(text); // Errors are ignored, the next save starts over
+        }
+
+        QMutexLocker locker(&mutex);
+        isWriting = false;
+        writtenCondition.wakeAll();
+    }
+
+    journalFile.close();
+}
+
+bool RecoveryJournal::writeText(const QString &text)
+{
+    if (text == writtenText && journalFile.isOpen())
+        return true;
+
+    QByteArray utf8Text = text.toUtf8(); // Sized as stored in the journal
+
+    if (!journalFile.isOpen() || journalFile.size() > qMax((qint64)COMPACTION_RATIO * utf8Text.size(), (qint64)MINIMUM_COMPACTION_SIZE))
+        return writeSnapshot(utf8Text, text);
+
+    // Single changed range: everything between the common prefix and suffix
+    int prefix = 0;
+    int maximumLength = qMin(text.size(), writtenText.size());
+
+    while (prefix < maximumLength && text[prefix] == writtenText[prefix])
+        prefix++;
+
+    int suffix = 0;
+
+    while (suffix < maximumLength - prefix && text[text.size() - 1 - suffix] == writtenText[writtenText.size() - 1 - suffix])
+        suffix++;
+
+    // Never split a surrogate pair, its halves can't be encoded separately
+    if (prefix > 0 && text[prefix - 1].isHighSurrogate())
+        prefix--;
+
+    if (suffix > 0 && text[text.size() - suffix].isLowSurrogate())
+        suffix--;
+
+    QByteArray payload;
+    appendUInt32(payload, prefix);
+    appendUInt32(payload, writtenText.size() - prefix - suffix); // Removed
+    payload.append(text.mid(prefix, text.size() - prefix - suffix).toUtf8()); // Inserted
+
+    if (!appendRecord(DiffRecord, payload))
+    {
+        journalFile.close(); // Rewritten by the next save
+        return false;
+    }
+
+    writtenText = text;
+    return true;
+}
+
+bool RecoveryJournal::writeSnapshot(const QByteArray &utf8Text, const QString &text)
+{
+    journalFile.close();
+
+    // Replaced atomically, so a crash while compacting keeps the previous journal
+    QSaveFile snapshotFile(filename);
+
+    if (!snapshotFile.open(QFile::WriteOnly))
+        return false;
+
+    snapshotFile.write(JOURNAL_MAGIC, 4);
+    snapshotFile.write(makeRecord(SnapshotRecord, utf8Text));
+
+    if (!snapshotFile.commit()) // Synced to disk
+        return false;
+
+    journalFile.setFileName(filename);
+
+    if (!journalFile.open(QFile::WriteOnly | QFile::Append))
+        return false;
+
+    writtenText = text;
+    return true;
+}
+
+bool RecoveryJournal::appendRecord(RecordType type, const QByteArray &payload)
+{
+    QByteArray record = makeRecord(type, payload);
+    return journalFile.write(record) == record.size() && syncToDisk(journalFile);
+}
+
+QByteArray RecoveryJournal::makeRecord(RecordType type, const QByteArray &payload)
+{
+    QByteArray record;
+    record.reserve(RECORD_HEADER_SIZE + payload.size());
+
+    quint16 checksum = qChecksum(payload.constData(), payload.size());
+
+    record.append((char)type);
+    appendUInt32(record, payload.size());
+    record.append((char)(checksum & 0xFF));
+    record.append((char)(checksum >> 8));
+    record.append(payload);
+
+    return record;
+}
+
+
+
+//////////////////////////////////////////////////
+// Recovery
+//////////////////////////////////////////////////
+
+bool RecoveryJournal::recover(QString filename, QString &text)
+{
+    QFile file(filename);
+
+    if (!file.open(QFile::ReadOnly))
+        return false;
+
+    QByteArray journal = file.readAll();
+    const uchar *data = (const uchar *)journal.constData();
+
+    if (!journal.startsWith(QByteArray(JOURNAL_MAGIC, 4)))
+        return false;
+
+    QString recoveredText;
+    bool hasSnapshot = false;
+    int offset = 4;
+
+    // Replays records up to the end, or to the first one that was torn or damaged
+    while (offset + RECORD_HEADER_SIZE <= journal.size())
+    {
+        int type = data[offset];
+        quint32 payloadSize = qFromLittleEndian<quint32>(data + offset + 1);
+        quint16 checksum = data[offset + 5] | (data[offset + 6] << 8);
+
+        if (payloadSize > (quint32)(journal.size() - offset - RECORD_HEADER_SIZE))
+            break;
+
+        const char *payload = journal.constData() + offset + RECORD_HEADER_SIZE;
+
+        if (qChecksum(payload, payloadSize) != checksum)
+            break;
+
+        if (type == SnapshotRecord)
+        {
+            recoveredText = QString::fromUtf8(payload, payloadSize);
+            hasSnapshot = true;
+        }
+        else if (type == DiffRecord && hasSnapshot && payloadSize >= 8)
+        {
+            quint32 position = qFromLittleEndian<quint32>((const uchar *)payload);
+            quint32 removed = qFromLittleEndian<quint32>((const uchar *)payload + 4);
+
+            if (position > (quint32)recoveredText.size() || removed > (quint32)recoveredText.size() - position)
+                break;
+
+            recoveredText.replace(position, removed, QString::fromUtf8(payload + 8, payloadSize - 8));
+        }
+        else
+        {
+            break;
+        }
+
+        offset += RECORD_HEADER_SIZE + payloadSize;
+    }
+
+    if (hasSnapshot)
+        text = recoveredText;
+
+    return hasSnapshot;
+}
@@ -0,0 +1,73 @@
+#ifndef RECOVERYJOURNAL_H
+#define RECOVERYJOURNAL_H
+
+#include <QFile>
+#include <QLockFile>
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QWaitCondition>
+
+/// Background autosave of a text, kept as a journal that can be replayed after a crash.
+///
+/// save() only hands the text over; a worker thread compares it with the last text written and
+/// appends the changed range as one diff record, then syncs the file to disk. Texts saved while
+/// the worker is busy are coalesced, so only the latest one is written. When the journal grows
+/// past COMPACTION_RATIO times the text's UTF-8 size, it's rewritten as a single snapshot record.
+///
+/// Records are checksummed, so recover() replays them up to the first torn or damaged one.
+///
+/// Each instance writes its own journal in a shared directory and holds a lock on it while it
+/// exists. A journal whose lock is stale was left by an instance that crashed, and adoptOrphan()
+/// takes it over, so instances running side by side never recover each other's text.
+class RecoveryJournal : public QThread
+{
+    Q_OBJECT
+public:
+    explicit RecoveryJournal(QString directory, QObject *parent = 0); // Creates the directory if needed
+    ~RecoveryJournal(); // Writes the pending text, then releases the lock
+
+    QString getFilename() const;
+
+    bool adoptOrphan(QString &text); // Call before the first save, false if no crashed instance left a journal
+
+    void save(const QString &text); // Returns immediately
+    void flush(); // Blocks until every saved text is on disk
+    void discard(); // Removes the journal, the text is safe elsewhere
+
+    static bool recover(QString filename, QString &text); // False if there's nothing valid to recover
+
+    static const int COMPACTION_RATIO = 4;
+    static const int MINIMUM_COMPACTION_SIZE = 64 * 1024; // Bytes, smaller journals are never compacted
+
+protected:
+    virtual void run();
+
+private:
+    enum RecordType
+    {
+        SnapshotRecord, // Whole text
+        DiffRecord // Position, removed length and inserted text
+    };
+
+    bool writeText(const QString &text);
+    bool writeSnapshot(const QByteArray &utf8Text, const QString &text); // Replaces the journal
+    bool appendRecord(RecordType type, const QByteArray &payload);
+
+    static QByteArray makeRecord(RecordType type, const QByteArray &payload);
+
+    QString directory, filename;
+    QLockFile lockFile; // Held for the instance's lifetime
+
+    // Shared with the worker thread
+    QMutex mutex;
+    QWaitCondition pendingCondition, writtenCondition;
+    QString pendingText;
+    bool hasPendingText, isWriting, discardRequested, stopRequested;
+
+    // Worker thread only
+    QFile journalFile; // Open for appending after the first snapshot
+    QString writtenText;
+};
+
+#endif // RECOVERYJOURNAL_H
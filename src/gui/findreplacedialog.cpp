@@ -1,5 +1,6 @@
 #include "findreplacedialog.h"
 #include "ui_findreplacedialog.h"
+#include <algorithm>
 
 FindReplaceDialog::FindReplaceDialog(HidraCodeEditor *editor, QWidget *parent) :
     QDialog(parent),
@@ -9,7 +10,13 @@ FindReplaceDialog::FindReplaceDialog(HidraCodeEditor *editor, QWidget *parent) :
     this->editor = editor;
     selected = false;
     current = 0;
+    changingCount = 0;
     this->clearCounters();
+
+    connect(editor->document(),
+            &QTextDocument::contentsChange,
+            this,
+            &FindReplaceDialog::onContentsChange);
 }
 
 FindReplaceDialog::~FindReplaceDialog()
@@ -25,6 +32,9 @@ void FindReplaceDialog::clearState()
     ui->caseCheckBox->setChecked(false);
     ui->regexCheckBox->setChecked(false);
     this->clearCounters();
+
+    /* Not kept up to date while closed. */
+    index.clear();
 }
 
 void FindReplaceDialog::onSelectionChange()
@@ -46,43 +56,34 @@ void FindReplaceDialog::clearCounters()
 
 void FindReplaceDialog::updateCounters()
 {
-    /* RAII guard */
-    ChangingGuard guard(this->changingGuard());
-
-    bool prevSelected = selected;
-
-    /* Saves original position to restore later. */
-    QTextCursor cursor = editor->textCursor();
-    int originalPos = cursor.selectionStart();
-    int originalLength = cursor.selectionEnd() - originalPos;
-
-    /* Moves to the beginning of the document. */
-    cursor.setPosition(0, QTextCursor::MoveAnchor);
-    editor->setTextCursor(cursor);
+    this->ensureIndex();
 
-    foundCount = 0;
-    current = 0;
+    int originalPos = editor->textCursor().selectionStart();
 
-    while (this->findRaw()) {
-        foundCount++;
-        cursor = editor->textCursor();
-
-        /* Counts this search as behind original selection. */
-        if (cursor.selectionStart() <= originalPos) {
-            current++;
-        }
-    }
-
-    /* Restores original selection. */
-    cursor.setPosition(originalPos, QTextCursor::MoveAnchor);
-    cursor.movePosition(QTextCursor::NextCharacter, QTextCursor::KeepAnchor, originalLength);
-    editor->setTextCursor(cursor);
+    /* Matches starting at or before the selection are behind it. */
+    QVector<int> const &starts = index.getStarts();
+    foundCount = starts.size();
+    current = std::upper_bound(starts.constBegin(), starts.constEnd(), originalPos) - starts.constBegin();
 
     /* Updates UI display. */
     ui->labelCurrent->setText(QString::number(current));
     ui->labelFound->setText(QString::number(foundCount));
+}
+
+void FindReplaceDialog::ensureIndex()
+{
+    QString findText(ui->findTextEdit->toPlainText());
+    bool caseSensitive = ui->caseCheckBox->isChecked();
+    bool regex = ui->regexCheckBox->isChecked();
 
-    selected = prevSelected;
+    if (!index.matchesSearch(findText, caseSensitive, regex)) {
+        index.build(editor->document(), findText, caseSensitive, regex);
+    }
+}
+
+void FindReplaceDialog::onContentsChange(int position, int charsRemoved, int charsAdded)
+{
+    index.update(position, charsRemoved, charsAdded);
 }
 
 bool FindReplaceDialog::findRaw()
@@ -150,43 +151,8 @@ int FindReplaceDialog::replaceRaw()
     int diff = 0;
 
     if (ui->regexCheckBox->isChecked()) {
-        QRegExp findRegex(this->findRegex());
         QString selection(editor->textCursor().selectedText());
-
-        /*
-         * Matches the selection with the regular expression and gets captured
-         * groups.
-         */
-        findRegex.indexIn(selection);
-        QStringList matches(findRegex.capturedTexts());
-
-        /*
-         * Expression given by the user to replace the match, using $i to refer
-         * to captured groups, $0 to refer to the whole match.
-         */
-        QString replaceExpr(ui->replaceTextEdit->toPlainText());
-
-        /* The first piece will not contain a '$'. */
-        QStringList pieces(replaceExpr.split('$'));
-        QString replaceText(pieces[0]);
-
-        /* Keep track if previous is between "$$". */
-        bool prevEmpty = false;
-
-        for (int i = 1; i < pieces.length(); i++) {
-            if (prevEmpty) {
-                /* Previous empty? Ignore '$' and just append things. */
-                replaceText += pieces[i];
-                prevEmpty = false;
-            } else if (pieces[i].length() == 0) {
-                /* Current empty? Between "$$". */
-                replaceText += '$';
-                prevEmpty = true;
-            } else {
-                /* Otherwise, potential parameter. */
-                this->replaceRegexParam(replaceText, pieces[i], matches);
-            }
-        }
+        QString replaceText(this->replacementText(selection));
 
         editor->insertPlainText(replaceText);
         diff = replaceText.length() - selection.length();
@@ -201,6 +167,113 @@ int FindReplaceDialog::replaceRaw()
     return diff;
 }
 
+QString FindReplaceDialog::replacementText(QString const &matchedText)
+{
+    if (!ui->regexCheckBox->isChecked()) {
+        return ui->replaceTextEdit->toPlainText();
+    }
+
+    QRegExp findRegex(this->findRegex());
+
+    /*
+     * Matches the selection with the regular expression and gets captured
+     * groups.
+     */
+    findRegex.indexIn(matchedText);
+    QStringList matches(findRegex.capturedTexts());
+
+    /*
+     * Expression given by the user to replace the match, using $i to refer
+     * to captured groups, $0 to refer to the whole match.
+     */
+    QString replaceExpr(ui->replaceTextEdit->toPlainText());
+
+    /* The first piece will not contain a '$'. */
+    QStringList pieces(replaceExpr.split('$'));
+    QString replaceText(pieces[0]);
+
+    /* Keep track if previous is between "$$". */
+    bool prevEmpty = false;
+
+    for (int i = 1; i < pieces.length(); i++) {
+        if (prevEmpty) {
+            /* Previous empty? Ignore '$' and just append things. */
+            replaceText += pieces[i];
+            prevEmpty = false;
+        } else if (pieces[i].length() == 0) {
+            /* Current empty? Between "$$". */
+            replaceText += '$';
+            prevEmpty = true;
+        } else {
+            /* Otherwise, potential parameter. */
+            this->replaceRegexParam(replaceText, pieces[i], matches);
+        }
+    }
+
+    return replaceText;
+}
+
+void FindReplaceDialog::replaceMatches(int from, int to, int &position)
+{
+    /* RAII guard */
+    ChangingGuard guard(this->changingGuard());
+
+    this->ensureIndex();
+
+    QVector<int> const &matchStarts = index.getStarts();
+    QVector<int> const &matchLengths = index.getLengths();
+
+    int first = std::lower_bound(matchStarts.constBegin(), matchStarts.constEnd(), from) - matchStarts.constBegin();
+    int last = first;
+
+    while (last < matchStarts.size() && matchStarts[last] + matchLengths[last] <= to) {
+        last++;
+    }
+
+    /* Copies, since the index is updated when the edit block ends. */
+    QVector<int> starts(matchStarts.mid(first, last - first));
+    QVector<int> lengths(matchLengths.mid(first, last - first));
+
+    /* Regex replacements depend on the matched text. */
+    QString documentText;
+    if (index.isRegex()) {
+        documentText = editor->document()->toPlainText();
+    }
+
+    QStringList replacements;
+    int newPosition = position;
+    int sizeDiff = 0;
+
+    for (int i = 0; i < starts.size(); i++) {
+        replacements.append(this->replacementText(documentText.mid(starts[i], lengths[i])));
+        int diff = replacements.last().length() - lengths[i];
+
+        /* Same adjustments as replacing one match at a time. */
+        if (starts[i] + lengths[i] <= position) {
+            newPosition += diff;
+        } else if (starts[i] <= position) {
+            newPosition = starts[i] + sizeDiff;
+        }
+
+        sizeDiff += diff;
+    }
+
+    /* Back to front, so the positions of the remaining matches stay valid. */
+    QTextCursor cursor(editor->document());
+    cursor.beginEditBlock();
+
+    for (int i = starts.size() - 1; i >= 0; i--) {
+        cursor.setPosition(starts[i], QTextCursor::MoveAnchor);
+        cursor.setPosition(starts[i] + lengths[i], QTextCursor::KeepAnchor);
+        cursor.insertText(replacements[i]);
+    }
+
+    cursor.endEditBlock();
+
+    position = newPosition;
+    selected = false;
+}
+
 void FindReplaceDialog::replaceRegexParam(QString &replaceText, QString const &piece, QStringList const &matches)
 {
     int cut = 0;
@@ -268,29 +341,8 @@ void FindReplaceDialog::replaceAll()
     QTextCursor cursor = editor->textCursor();
     int originalPos = cursor.selectionStart();
 
-    /* Moves to the start. */
-    cursor.setPosition(0, QTextCursor::MoveAnchor);
-    editor->setTextCursor(cursor);
-
-    while (this->findRaw()) {
-        cursor = editor->textCursor();
-
-        /*
-         * Replaces and gets the difference between replaced text and found
-         * text.
-         */
-        int sizeDiff = this->replaceRaw();
-
-        /*
-         * Takes size difference into account in order to maintain original
-         * position correct.
-         */
-        if (cursor.selectionEnd() <= originalPos) {
-            originalPos += sizeDiff;
-        } else if (cursor.selectionStart() <= originalPos) {
-            originalPos = cursor.selectionStart();
-        }
-    }
+    /* Single edit, the original position follows the replacements. */
+    this->replaceMatches(0, editor->document()->characterCount(), originalPos);
 
     /* Restore original position. */
     cursor.setPosition(originalPos, QTextCursor::MoveAnchor);
@@ -307,24 +359,9 @@ void FindReplaceDialog::replaceSelection()
     int selectionStart = cursor.selectionStart();
     int selectionEnd = cursor.selectionEnd();
 
-    /* Moves to the beginning of the selection. */
-    cursor.setPosition(selectionStart, QTextCursor::MoveAnchor);
-    editor->setTextCursor(cursor);
-
-    /* Keeps track if we still are inside the selection. */
-    bool insideSelection = true;
-
-    while (this->findRaw() && insideSelection) {
-        /* Are we inside the selection? */
-        cursor = editor->textCursor();
-        insideSelection = cursor.selectionEnd() <= selectionEnd;
-
-        if (insideSelection) {
-            /* If so, replaces and takes difference into account. */
-            int sizeDiff = this->replaceRaw();
-            selectionEnd += sizeDiff;
-        }
-    }
+    /* Replaces the matches inside the selection in a single edit. */
+    int position = selectionStart;
+    this->replaceMatches(selectionStart, selectionEnd, position);
 
     /* Restores the cursor to the beginning of the selection. */
     cursor.setPosition(selectionStart, QTextCursor::MoveAnchor);
@@ -3,6 +3,7 @@
 
 #include <QDialog>
 #include "hidracodeeditor.h"
+#include "searchindex.h"
 
 namespace Ui {
 class FindReplaceDialog;
@@ -27,6 +28,7 @@ private slots:
     void on_replaceButton_clicked();
     void on_replaceAllButton_clicked();
     void on_replaceSelected_clicked();
+    void onContentsChange(int position, int charsRemoved, int charsAdded);
 
 protected:
     virtual void closeEvent(QCloseEvent *evt);
@@ -40,9 +42,15 @@ private:
     int current;
     int foundCount;
 
+    /* Matches of the current search, kept up to date while the dialog is open. */
+    SearchIndex index;
+
     void updateCounters();
     void clearCounters();
 
+    /* Rebuilds the index if the search changed since it was built. */
+    void ensureIndex();
+
     /* Finds the searched text and returns if found. No wrap-around. */
     bool findRaw();
     /*
@@ -50,6 +58,14 @@ private:
      * the replaced text and the searched text.
      */
     int replaceRaw();
+    /*
+     * Replaces every indexed match inside [from, to) in a single edit block,
+     * so the document reports one change (one undo step, one re-highlight)
+     * when it ends. Moves position as the replacements shift the text.
+     */
+    void replaceMatches(int from, int to, int &position);
+    /* Text that replaces a match, with regex groups ($1...) substituted. */
+    QString replacementText(QString const &matchedText);
 
     void find();
     void replace();
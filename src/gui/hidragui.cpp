@@ -15,13 +15,33 @@
 #include "ui_hidragui.h"
 #include <QSizeGrip>
 #include <QInputDialog>
+#include <QActionGroup>
+#include <QStandardPaths>
 
 #define DEBUG_INT(value) qDebug(QString::number(value).toStdString().c_str());
 #define DEBUG_STRING(value) qDebug(value.toStdString().c_str());
 
+// Run speeds (instructions per second), 0 for unlimited
+static const int EXECUTION_SPEEDS[] = {1, 5, 20, 50, 200, 1000, 10000, 100000, 0};
+static const int DEFAULT_INSTRUCTIONS_PER_SECOND = 50; // Every instruction is shown
+
+static const char *RECOVERY_DIRECTORY = "recovery"; // Inside the application data directory, one journal per instance
+static const int BACKUP_INTERVAL = 10000; // Milliseconds, only changed documents are saved
+
+static QString rateToString(double rate)
+{
+    if (rate >= 1e6)
+        return QString::number(rate / 1e6, 'f', 1) + " M";
+    else if (rate >= 1e3)
+        return QString::number(rate / 1e3, 'f', 1) + " k";
+    else
+        return QString::number(rate, 'f', 0) + " ";
+}
+
 HidraGui::HidraGui(QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::HidraGui),
+    recoveryJournal(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/" + RECOVERY_DIRECTORY),
     colorGrayedOut(QColor(144, 144, 144))
 {
     ui->setupUi(this);
@@ -48,18 +68,28 @@ HidraGui::HidraGui(QWidget *parent) :
 
     ui->tableViewMemoryInstructions->installEventFilter(this);
     ui->tableViewMemoryData->installEventFilter(this);
-    enableDataChangedSignal();
+    connect(&memoryModel, SIGNAL(memoryValueEdited(QModelIndex, int)), this, SLOT(memoryValueEdited(QModelIndex, int)));
+
+    snapshotTimer.setInterval(SimulationThread::SNAPSHOT_INTERVAL);
+    connect(&snapshotTimer, SIGNAL(timeout()), this, SLOT(updateFromSnapshot()));
+    connect(&simulation, SIGNAL(finished()), this, SLOT(simulationFinished()));
+
     advanceToNextCell = false;
 
     buildSuccessful = true;
-    previousPCValue = 0;
 
     // View options
     showHexValues  = false;
     showSignedData = false;
     showCharacters = false;
-    fastExecute    = false;
+    instructionsPerSecond = DEFAULT_INSTRUCTIONS_PER_SECOND;
     followPC       = true;
+    showPerformance = false;
+    showMemoryMap  = false;
+    recordExecution = false;
+
+    // Build options
+    peepholeOptimization = false;
 
     ui->actionFollowPCMode->setChecked(followPC);
 
@@ -67,12 +97,28 @@ HidraGui::HidraGui(QWidget *parent) :
     machine = nullptr;
 
     ui->scrollAreaRegisters->setFrameShape(QFrame::NoFrame);
+    initializeExecutionSpeedMenu();
+
+    // Performance panel (see PerformanceMonitor)
+    performanceLabel = new QLabel();
+    performanceLabel->setVisible(showPerformance);
+    ui->statusBar->addPermanentWidget(performanceLabel);
+    performanceStatistics = PerformanceStatistics{0, 0, 0, 0, 0, SimulationThread::getEngineName()};
+
+    // Memory map (see MemoryHeatmapWidget)
+    memoryHeatmap = new MemoryHeatmapWidget();
+    memoryHeatmap->setVisible(showMemoryMap);
+    ui->verticalLayout_2->insertWidget(ui->verticalLayout_2->indexOf(ui->areaInformation) + 1, memoryHeatmap);
+    connect(memoryHeatmap, SIGNAL(addressClicked(int)), this, SLOT(memoryHeatmapClicked(int)));
+
+    // Execution history, only shown while recording (see ExecutionTrace)
+    ui->labelTimeline->setVisible(recordExecution);
+    ui->sliderTimeline->setVisible(recordExecution);
 
     // Select Neander machine and update interface
     selectMachine("Neander");
 
     modifiedFile = false;
-    modifiedSinceBackup = false;
     forceSaveAs = true;
     updateWindowTitle();
 
@@ -83,17 +129,21 @@ HidraGui::HidraGui(QWidget *parent) :
     baseConversor = new BaseConversorDialog();
     pointConversor = new PointConversorDialog();
 
-    // Open recovery file (if existing)
-    /*if (QFile::exists("__Recovery__.txt"))
+    // Recover the source left unsaved by a session that crashed (journals are removed on close)
+    QString recoveredSource;
+    if (recoveryJournal.adoptOrphan(recoveredSource))
     {
-        load("__Recovery__.txt");
+        codeEditor->setPlainText(recoveredSource);
         modifiedFile = true;
+        updateWindowTitle();
+        ui->statusBar->showMessage(tr("Código recuperado da sessão anterior. Selecione a máquina novamente."));
     }
 
     // Set backup timer
-    backupTimer.setInterval(3*60000); // Save backup every N minutes
+    backupRevision = -1; // Recovered source is journaled again
+    backupTimer.setInterval(BACKUP_INTERVAL);
     connect(&backupTimer, SIGNAL(timeout()), this, SLOT(saveBackup()));
-    backupTimer.start(); */ // TODO: Only open recovery once
+    backupTimer.start();
 }
 
 HidraGui::~HidraGui()
@@ -113,6 +163,8 @@ void HidraGui::selectMachine(QString machineName)
 {
     if (currentMachineName != machineName)
     {
+        stopSimulation();
+
         Machine *previousMachine = machine;
 
         if (machineName == "Neander")
@@ -137,6 +189,7 @@ void HidraGui::selectMachine(QString machineName)
             return; // Error
 
         delete previousMachine;
+        trace.clear();
         connect(machine, SIGNAL(buildErrorDetected(QString)), this, SLOT(addError(QString)));
 
         ui->comboBoxMachine->setCurrentText(machineName);
@@ -146,6 +199,7 @@ void HidraGui::selectMachine(QString machineName)
 
         codeEditor->disableLineHighlight();
         initializeMachineInterface();
+        updateTimeline();
 
         currentMachineName = machineName;
     }
@@ -168,7 +222,7 @@ void HidraGui::scrollToCurrentLine()
     if (followPC)
     {
         codeEditor->setCurrentLine(machine->getPCCorrespondingSourceLine());
-        ui->tableViewMemoryInstructions->scrollTo(memoryModel.index(machine->getPCValue(), ColumnAddress));
+        ui->tableViewMemoryInstructions->scrollTo(memoryModel.index(machine->getPCValue(), MemoryTableModel::ColumnAddress));
     }
 }
 
@@ -177,14 +231,26 @@ void HidraGui::loadConfFile()
     showHexValues  = settings.value("showHexValues", false).toBool();
     showSignedData = settings.value("showSignedData", false).toBool();
     showCharacters = settings.value("showCharacters", false).toBool();
-    fastExecute    = settings.value("fastExecute", false).toBool();
+    instructionsPerSecond = settings.value("instructionsPerSecond", settings.value("fastExecute", false).toBool() ? 0 : DEFAULT_INSTRUCTIONS_PER_SECOND).toInt();
     followPC       = settings.value("followPC", true).toBool();
+    showPerformance = settings.value("showPerformance", false).toBool();
+    showMemoryMap  = settings.value("showMemoryMap", false).toBool();
+    recordExecution = settings.value("recordExecution", false).toBool();
+    peepholeOptimization = settings.value("peepholeOptimization", false).toBool();
 
     ui->actionHexadecimalMode->setChecked(showHexValues);
     ui->actionSignedMode->setChecked(showSignedData);
     ui->actionShowCharacters->setChecked(showCharacters);
-    ui->actionFastExecuteMode->setChecked(fastExecute);
     ui->actionFollowPCMode->setChecked(followPC);
+    ui->actionShowPerformance->setChecked(showPerformance);
+    ui->actionShowMemoryMap->setChecked(showMemoryMap);
+    ui->actionRecordExecution->setChecked(recordExecution);
+    ui->actionPeepholeOptimization->setChecked(peepholeOptimization);
+
+    foreach (QAction *action, ui->menuExecutionSpeed->actions())
+        action->setChecked(action->data().toInt() == instructionsPerSecond);
+
+    machine->setPeepholeOptimizationEnabled(peepholeOptimization);
 }
 
 
@@ -204,49 +270,34 @@ void HidraGui::initializeMachineInterfaceComponents()
     loadConfFile();
 }
 
-void HidraGui::initializeMemoryTable()
+void HidraGui::initializeExecutionSpeedMenu()
 {
-    int memorySize = machine->getMemorySize();
-    manuallyModifiedMemory = false;
-
-    ui->tableViewMemoryInstructions->setModel(&memoryModel);
-    ui->tableViewMemoryData->setModel(&memoryModel);
-
-    // Set table size
-    memoryModel.setRowCount(memorySize);
-    memoryModel.setColumnCount(NumColumns);
+    QActionGroup *speedGroup = new QActionGroup(this); // Exclusive
 
-    previousRowColor = QVector<QColor>(memorySize);
-
-    // Initialize all cells
-    for (int row = 0; row < memorySize; row++)
+    for (int speed : EXECUTION_SPEEDS)
     {
-        for (int column = 0; column < memoryModel.columnCount(); column++)
-        {
-            memoryModel.setData(memoryModel.index(row, column), "");
-            QStandardItem *item = memoryModel.item(row, column);
+        QAction *action = ui->menuExecutionSpeed->addAction((speed > 0) ? QString("%1 instruções/s").arg(speed) : QString("Ilimitada"));
+        action->setCheckable(true);
+        action->setData(speed);
+        speedGroup->addAction(action);
+    }
 
-            if (column != ColumnInstructionValue && column != ColumnDataValue)
-                item->setFlags(item->flags() & ~Qt::ItemIsEditable); // Disable editing
-        }
+    connect(speedGroup, SIGNAL(triggered(QAction*)), this, SLOT(executionSpeedSelected(QAction*)));
+}
 
-        memoryModel.item(row, ColumnAddress)->setForeground(colorGrayedOut); // Grayed out
-        previousRowColor[row] = Qt::white;
+void HidraGui::initializeMemoryTable()
+{
+    int memorySize = machine->getMemorySize();
+    manuallyModifiedMemory = false;
 
-        // On mouse-over, the byte address is sent to the statusbar (with "@" prefix)
-        // The information box then obtains the address and displays its value in dec/hex/bin
-        memoryModel.item(row, ColumnInstructionValue)->setStatusTip(QString("@I") + QString::number(row));
-        memoryModel.item(row, ColumnDataValue       )->setStatusTip(QString("@D") + QString::number(row));
-    }
+    // Cells are read from the machine on demand (see MemoryTableModel)
+    memoryModel.setMachine(machine);
+    memoryModel.setAddressForeground(colorGrayedOut); // Grayed out
+    highlightedRows.clear();
+    memoryHeatmap->setMemorySize(memorySize);
 
-    // Set table headers
-    memoryModel.setHeaderData(ColumnPC,                Qt::Horizontal, " ");
-    memoryModel.setHeaderData(ColumnAddress,           Qt::Horizontal, " End ");
-    memoryModel.setHeaderData(ColumnInstructionValue,  Qt::Horizontal, "Valor");
-    memoryModel.setHeaderData(ColumnDataValue,         Qt::Horizontal, "Dado");
-    memoryModel.setHeaderData(ColumnCharacter,         Qt::Horizontal, "Car.");
-    memoryModel.setHeaderData(ColumnLabel,             Qt::Horizontal, "  Label  ");
-    memoryModel.setHeaderData(ColumnInstructionString, Qt::Horizontal, " Instrução ");
+    ui->tableViewMemoryInstructions->setModel(&memoryModel);
+    ui->tableViewMemoryData->setModel(&memoryModel);
 
     // Adjust table settings
     ui->tableViewMemoryInstructions->verticalHeader()->hide();
@@ -255,13 +306,13 @@ void HidraGui::initializeMemoryTable()
     ui->tableViewMemoryData->setMouseTracking(true);
 
     // Hide columns
-    ui->tableViewMemoryInstructions->hideColumn(ColumnLabel);
-    ui->tableViewMemoryInstructions->hideColumn(ColumnDataValue);
-    ui->tableViewMemoryInstructions->hideColumn(ColumnCharacter);
-    ui->tableViewMemoryData->hideColumn(ColumnPC);
-    ui->tableViewMemoryData->hideColumn(ColumnInstructionValue);
-    ui->tableViewMemoryData->hideColumn(ColumnInstructionString);
-    ui->tableViewMemoryData->setColumnHidden(ColumnCharacter, !showCharacters);
+    ui->tableViewMemoryInstructions->hideColumn(MemoryTableModel::ColumnLabel);
+    ui->tableViewMemoryInstructions->hideColumn(MemoryTableModel::ColumnDataValue);
+    ui->tableViewMemoryInstructions->hideColumn(MemoryTableModel::ColumnCharacter);
+    ui->tableViewMemoryData->hideColumn(MemoryTableModel::ColumnPC);
+    ui->tableViewMemoryData->hideColumn(MemoryTableModel::ColumnInstructionValue);
+    ui->tableViewMemoryData->hideColumn(MemoryTableModel::ColumnInstructionString);
+    ui->tableViewMemoryData->setColumnHidden(MemoryTableModel::ColumnCharacter, !showCharacters);
 
     // Resize
     ui->tableViewMemoryInstructions->resizeRowsToContents();
@@ -270,8 +321,8 @@ void HidraGui::initializeMemoryTable()
     ui->tableViewMemoryData->resizeColumnsToContents();
 
     // Scroll to appropriate position
-    ui->tableViewMemoryInstructions->scrollTo(memoryModel.index(0, ColumnAddress), QAbstractItemView::PositionAtTop);
-    ui->tableViewMemoryData->scrollTo(memoryModel.index((memorySize < 4096) ? 128 : 1024, ColumnAddress), QAbstractItemView::PositionAtTop);
+    ui->tableViewMemoryInstructions->scrollTo(memoryModel.index(0, MemoryTableModel::ColumnAddress), QAbstractItemView::PositionAtTop);
+    ui->tableViewMemoryData->scrollTo(memoryModel.index((memorySize < 4096) ? 128 : 1024, MemoryTableModel::ColumnAddress), QAbstractItemView::PositionAtTop);
 }
 
 void HidraGui::initializeStackTable()
@@ -300,7 +351,7 @@ void HidraGui::initializeStackTable()
 
         // On mouse-over, the byte address is sent to the statusbar (with "@" prefix)
         // The information box then obtains the address and displays its value in dec/hex/bin
-        memoryModel.item(row, ColumnDataValue)->setStatusTip(QString("@S") + QString::number(row));
+        stackModel.item(row, ColumnStackValue)->setStatusTip(QString("@S") + QString::number(row));
     }
 
     // Set table headers
@@ -368,8 +419,8 @@ void HidraGui::initializeRegisterWidgets()
 
 void HidraGui::initializeHighlighter()
 {
-    highlighter->initializeHighlighter(*machine);
-    highlighter->rehighlight();
+    if (highlighter->initializeHighlighter(*machine))
+        highlighter->rehighlight(); // Otherwise blocks keep their formats
 }
 
 void HidraGui::initializeInstructionsList()
@@ -440,7 +491,7 @@ void HidraGui::clearMachineInterfaceComponents()
 
 void HidraGui::clearMemoryTable()
 {
-    memoryModel.clear();
+    memoryModel.setMachine(nullptr);
 }
 
 void HidraGui::clearStackTable()
@@ -494,123 +545,159 @@ void HidraGui::updateMachineInterfaceComponents(bool force, bool updateInstructi
     updateCodeEditor();
     updateButtons();
     updateInformation();
+    updateMemoryHeatmap();
 }
 
 void HidraGui::updateMemoryTable(bool force, bool updateInstructionStrings)
 {
-    int memorySize  = machine->getMemorySize();
-    int currentLine = machine->getPCCorrespondingSourceLine();
-    bool instructionStringsUpdated = false;
-
-    disableDataChangedSignal();
+    int memorySize = machine->getMemorySize();
 
     if (force || updateInstructionStrings)
-    {
         machine->updateInstructionStrings();
-        instructionStringsUpdated = true;
+
+    if (force)
+    {
+        memoryModel.setDisplayOptions(showHexValues, showSignedData, showCharacters);
+        machine->takeChangedLabels(); // Every row is checked below
+        memoryModel.updateLabels();
     }
 
     //////////////////////////////////////////////////
     // Column 0: PC Arrow
     //////////////////////////////////////////////////
 
-    if (memoryModel.hasIndex(previousPCValue, ColumnPC))
-        memoryModel.item(previousPCValue, ColumnPC)->setText(""); // Clear last PC Value's arrow
-    memoryModel.item(machine->getPCValue(), ColumnPC)->setText("\u2192"); // Show arrow on current PC value
-    previousPCValue = machine->getPCValue(); // Update last PC value
+    memoryModel.setPCRow(machine->getPCValue());
+
+    //////////////////////////////////////////////////
+    // Columns 2, 3, 4: Byte value, Character
+    //////////////////////////////////////////////////
 
     for (int row=0; row<memorySize; row++)
     {
-        int byteAddress = row;
-        int value = machine->getMemoryValue(byteAddress);
+        if (machine->hasByteChanged(row)) // Only repaint row if byte value has changed
+            memoryModel.markRowChanged(row);
+    }
 
-        //////////////////////////////////////////////////
-        // Column 1: Address
-        //////////////////////////////////////////////////
+    //////////////////////////////////////////////////
+    // Column 6: Instruction strings
+    //////////////////////////////////////////////////
 
-        if (force)
-        {
-            memoryModel.item(row, ColumnAddress)->setText(valueToString(byteAddress, showHexValues, false));
-        }
+    if (force || updateInstructionStrings)
+        updateInstructionStringCells(force);
 
-        //////////////////////////////////////////////////
-        // Columns 2, 3, 4: Byte value, Character
-        //////////////////////////////////////////////////
 
-        if (machine->hasByteChanged(byteAddress) || force) // Only update cell if byte value has changed
-        {
-            QString instructionValueStr = valueToString(value, showHexValues, false);
-            QString dataValueStr        = valueToString(value, showHexValues, showSignedData);
 
-            memoryModel.item(row, ColumnInstructionValue)->setText(instructionValueStr);
-            memoryModel.item(row, ColumnDataValue)->setText(dataValueStr);
+    //////////////////////////////////////////////////
+    // Row color (highlight current instruction)
+    //////////////////////////////////////////////////
 
-            if (showCharacters)
-                memoryModel.item(row, ColumnCharacter)->setText((value >= 32 && value < 128) ? QChar(value) : ' ');
-        }
+    updateRowHighlight();
 
-        //////////////////////////////////////////////////
-        // Column 5: Label
-        //////////////////////////////////////////////////
+    memoryModel.emitChanges();
 
-        if (force) // Only update when forced
-        {
-            QString labelName = machine->getAddressCorrespondingLabel(byteAddress);
-            memoryModel.item(row, ColumnLabel)->setText(labelName);
-        }
+    // Adjust size
+    if (force)
+    {
+        ui->tableViewMemoryInstructions->resizeColumnsToContents();
+        ui->tableViewMemoryData->resizeColumnsToContents();
+    }
+}
 
-        //////////////////////////////////////////////////
-        // Column 6: Instruction strings
-        //////////////////////////////////////////////////
+// Only visits rows that are or were highlighted: current line, operand and intermediate addresses
+void HidraGui::updateRowHighlight()
+{
+    QHash<int, QColor> rowColor;
+
+    if (sourceAndMemoryInSync)
+    {
+        int memorySize  = machine->getMemorySize();
+        int currentLine = machine->getPCCorrespondingSourceLine();
+        int pcValue     = machine->getPCValue();
+
+        int intermediateAddress, intermediateAddress2, finalOperandAddress;
+        machine->getNextOperandAddress(intermediateAddress, intermediateAddress2, finalOperandAddress);
 
-        if (instructionStringsUpdated)
+        // Current line's bytes are contiguous around PC
+        if (currentLine >= 0)
         {
-            QString instructionString = machine->getInstructionString(byteAddress);
-            memoryModel.item(row, ColumnInstructionString)->setText(instructionString);
+            for (int row = pcValue; row >= 0 && machine->getAddressCorrespondingSourceLine(row) == currentLine; row--)
+                rowColor.insert(row, QColor(255, 244, 128, 60)); // Yellow
+
+            for (int row = pcValue + 1; row < memorySize && machine->getAddressCorrespondingSourceLine(row) == currentLine; row++)
+                rowColor.insert(row, QColor(255, 244, 128, 60)); // Yellow
         }
+
+        // Operands take precedence
+        if (intermediateAddress >= 0)
+            rowColor.insert(intermediateAddress, QColor(255, 228, 148, 60)); // Orange
+        if (intermediateAddress2 >= 0)
+            rowColor.insert(intermediateAddress2, QColor(255, 228, 148, 60)); // Orange
+        if (finalOperandAddress >= 0)
+            rowColor.insert(finalOperandAddress, QColor(255, 202, 176, 60)); // Red
     }
 
+    // Rows that lost their highlight return to the base color
+    foreach (int row, highlightedRows)
+    {
+        if (!rowColor.contains(row))
+            memoryModel.setRowColor(row, QColor());
+    }
 
+    highlightedRows.clear();
 
-    //////////////////////////////////////////////////
-    // Row color (highlight current instruction)
-    //////////////////////////////////////////////////
+    for (QHash<int, QColor>::const_iterator it = rowColor.constBegin(); it != rowColor.constEnd(); ++it)
+    {
+        memoryModel.setRowColor(it.key(), it.value()); // Only repaints row if color changed
+        highlightedRows.append(it.key());
+    }
+}
 
-    int intermediateAddress, intermediateAddress2, finalOperandAddress;
-    machine->getNextOperandAddress(intermediateAddress, intermediateAddress2, finalOperandAddress);
+// Repaints only the rows a build changed, instead of forcing the whole table
+void HidraGui::updateMemoryTableAfterBuild(const QVector<MemoryRange> &changedRanges)
+{
+    machine->updateInstructionStrings();
 
-    for (int row=0; row<memorySize; row++)
+    // Columns 2, 3, 4: Byte value, Character
+    foreach (MemoryRange range, changedRanges)
     {
-        QColor rowColor;
-
-        // Get new color
-        if (sourceAndMemoryInSync && row == finalOperandAddress)
-            rowColor = QColor(255, 202, 176, 60); // Red
-        else if (sourceAndMemoryInSync && (row == intermediateAddress || row == intermediateAddress2))
-            rowColor = QColor(255, 228, 148, 60); // Orange
-        else if (sourceAndMemoryInSync && currentLine == machine->getAddressCorrespondingSourceLine(row) && currentLine >= 0)
-            rowColor = QColor(255, 244, 128, 60); // Yellow
-        else
-            rowColor = QColor(30, 30, 30); //Must be same as base TO-DO Palette must be held by class
-
-        // Update row color if needed
-        if (previousRowColor[row] != rowColor)
+        for (int row = range.start; row < range.end; row++)
         {
-            for (int column=0; column<NumColumns; column++)
-                memoryModel.item(row, column)->setBackground(rowColor);
+            machine->hasByteChanged(row); // Clear flag, row is repainted here
+            memoryModel.markRowChanged(row);
         }
-
-        previousRowColor[row] = rowColor;
     }
 
-    // Adjust size
-    if (force)
+    // Column 5: Label (only addresses whose label changed)
+    bool labelsChanged = memoryModel.updateLabels(machine->takeChangedLabels());
+
+    // Column 6: Instruction strings
+    updateInstructionStringCells(false);
+
+    memoryModel.emitChanges();
+
+    if (labelsChanged)
     {
         ui->tableViewMemoryInstructions->resizeColumnsToContents();
         ui->tableViewMemoryData->resizeColumnsToContents();
     }
+}
+
+// Repaints instruction strings only where the disassembly changed
+void HidraGui::updateInstructionStringCells(bool force)
+{
+    QVector<MemoryRange> changedRanges = machine->takeChangedInstructionStrings();
+
+    if (force)
+    {
+        changedRanges.clear();
+        changedRanges.append(MemoryRange{0, machine->getMemorySize()});
+    }
 
-    enableDataChangedSignal();
+    foreach (MemoryRange range, changedRanges)
+    {
+        for (int row = range.start; row < range.end; row++)
+            memoryModel.markRowChanged(row);
+    }
 }
 
 void HidraGui::updateStackTable()
@@ -770,12 +857,14 @@ QString HidraGui::getValueDescription(int value, bool isSigned)
 
 void HidraGui::newFile()
 {
+    stopSimulation();
     codeEditor->clear();
     machine->clear();
     initializeMachineInterface();
 
     currentFilename = "";
     modifiedFile = false;
+    recoveryJournal.discard();
     updateWindowTitle();
 }
 
@@ -795,6 +884,7 @@ void HidraGui::save(QString filename)
     currentFilename = filename;
     modifiedFile = false;
     forceSaveAs = false;
+    recoveryJournal.discard(); // Nothing left to recover
     updateWindowTitle();
 }
 
@@ -904,6 +994,7 @@ void HidraGui::load(QString filename, bool showErrors = true)
     currentFilename = filename;
     modifiedFile = false;
     forceSaveAs = false;
+    recoveryJournal.discard();
 
     codeEditor->clearBreakpoint();
     updateWindowTitle();
@@ -917,6 +1008,9 @@ void HidraGui::load(QString filename, bool showErrors = true)
 
 void HidraGui::step(bool refresh, bool updateInstructionStrings)
 {
+    if (recordExecution)
+        trace.resume(*machine);
+
     try
     {
         machine->step();
@@ -927,14 +1021,132 @@ void HidraGui::step(bool refresh, bool updateInstructionStrings)
         QMessageBox::information(this, tr("Error"), error);
     }
 
+    if (recordExecution)
+    {
+        trace.recordStep(*machine);
+        trace.finish(*machine);
+        updateTimeline();
+    }
+
     if (refresh)
     {
         updateMachineInterface(false, updateInstructionStrings);
         scrollToCurrentLine();
-        QApplication::processEvents();
     }
 }
 
+void HidraGui::stopSimulation()
+{
+    if (!snapshotTimer.isActive()) // Not running, or already finished
+        return;
+
+    simulation.stopSimulation();
+    finishSimulation();
+}
+
+void HidraGui::finishSimulation()
+{
+    snapshotTimer.stop();
+    simulation.wait();
+
+    if (simulation.takeSnapshot()) // Final state, unless already shown
+        simulation.getSnapshot().apply(*machine);
+
+    updatePerformanceInformation(false);
+
+    machine->setRunning(false);
+    updateMachineInterface(); // Refresh skipped updates, update instruction strings
+    scrollToCurrentLine();
+
+    if (!recordExecution) // Turned off while the simulation thread was recording
+        trace.clear();
+
+    updateTimeline();
+
+    if (!simulation.getError().isEmpty())
+        QMessageBox::information(this, tr("Error"), simulation.getError());
+}
+
+void HidraGui::updateFromSnapshot()
+{
+    if (simulation.takeSnapshot())
+    {
+        QElapsedTimer refreshTimer;
+        refreshTimer.start();
+
+        simulation.getSnapshot().apply(*machine);
+        updateMachineInterface(false, false); // Don't update instruction strings when running
+        scrollToCurrentLine();
+
+        performanceMonitor.addSnapshot(simulation.getSnapshot());
+        performanceMonitor.addRefresh(refreshTimer.nsecsElapsed());
+    }
+
+    if (performanceMonitor.sample(performanceStatistics))
+        updatePerformanceInformation(true);
+}
+
+void HidraGui::updatePerformanceInformation(bool newSample)
+{
+    if (!showPerformance)
+        return;
+
+    QString performanceString = "Motor: " + performanceStatistics.engine;
+
+    if (newSample) // Running
+    {
+        performanceString += "  |  " + rateToString(performanceStatistics.instructionsPerSecond) + "instr/s"
+                           + "  |  " + rateToString(performanceStatistics.accessesPerSecond) + "acessos/s"
+                           + "  |  Simulação " + QString::number(qRound(performanceStatistics.simulationLoad * 100)) + "%"
+                           + ", tela " + QString::number(qRound(performanceStatistics.refreshLoad * 100)) + "%"
+                           + "  |  " + QString::number(performanceStatistics.refreshesPerSecond, 'f', 0) + " atualizações/s";
+    }
+    else
+    {
+        performanceString += "  |  Parado";
+    }
+
+    performanceLabel->setText(performanceString);
+}
+
+void HidraGui::updateMemoryHeatmap()
+{
+    if (showMemoryMap)
+        memoryHeatmap->addActivity(machine->getMemoryActivity());
+}
+
+void HidraGui::memoryHeatmapClicked(int address)
+{
+    ui->tableViewMemoryInstructions->scrollTo(memoryModel.index(address, MemoryTableModel::ColumnAddress), QAbstractItemView::PositionAtCenter);
+    ui->tableViewMemoryData->scrollTo(memoryModel.index(address, MemoryTableModel::ColumnAddress), QAbstractItemView::PositionAtCenter);
+}
+
+void HidraGui::updateTimeline()
+{
+    bool running = snapshotTimer.isActive(); // The simulation thread is recording
+    ui->sliderTimeline->setEnabled(!running && trace.getLength() > 0);
+
+    if (running)
+        return;
+
+    ui->sliderTimeline->blockSignals(true);
+    ui->sliderTimeline->setRange(0, trace.getLength());
+    ui->sliderTimeline->setPageStep(qMax(trace.getLength() / 20, 1));
+    ui->sliderTimeline->setValue(trace.getCurrentIndex());
+    ui->sliderTimeline->blockSignals(false);
+
+    ui->labelTimeline->setText(QString("Histórico: %1 / %2%3")
+                               .arg(trace.getCurrentIndex())
+                               .arg(trace.getLength())
+                               .arg(trace.isTruncated() ? "+" : ""));
+}
+
+void HidraGui::simulationFinished()
+{
+    if (snapshotTimer.isActive()) // Stopped by the machine (halt, breakpoint, error)
+        finishSimulation();
+}
+
 
 void HidraGui::dragEnterEvent(QDragEnterEvent *e)
 {
@@ -982,16 +1194,6 @@ bool HidraGui::eventFilter(QObject *obj, QEvent *event)
     return QMainWindow::eventFilter(obj, event);
 }
 
-void HidraGui::enableDataChangedSignal()
-{
-    connect(&memoryModel, SIGNAL(dataChanged(QModelIndex, QModelIndex)), this, SLOT(memoryTableDataChanged(QModelIndex, QModelIndex)));
-}
-
-void HidraGui::disableDataChangedSignal()
-{
-    disconnect(&memoryModel, SIGNAL(dataChanged(QModelIndex, QModelIndex)), this, SLOT(memoryTableDataChanged(QModelIndex, QModelIndex)));
-}
-
 void HidraGui::enableStatusBarSignal()
 {
     connect(ui->statusBar, SIGNAL(messageChanged(QString)), this, SLOT(statusBarMessageChanged(QString)));
@@ -1052,8 +1254,6 @@ void HidraGui::sourceCodeChanged()
         updateWindowTitle();
     }
 
-    modifiedSinceBackup = true;
-
     if (sourceAndMemoryInSync)
     {
         sourceAndMemoryInSync = false;
@@ -1062,18 +1262,19 @@ void HidraGui::sourceCodeChanged()
     }
 }
 
-void HidraGui::memoryTableDataChanged(QModelIndex topLeft, QModelIndex bottomRight)
+void HidraGui::memoryValueEdited(QModelIndex index, int value)
 {
-    if (topLeft == bottomRight && (topLeft == ui->tableViewMemoryInstructions->currentIndex() || topLeft == ui->tableViewMemoryData->currentIndex()))
+    if (index == ui->tableViewMemoryInstructions->currentIndex() || index == ui->tableViewMemoryData->currentIndex())
     {
-        machine->setMemoryValue(topLeft.row(), memoryModel.data(topLeft).toString().toInt(nullptr, (showHexValues) ? 16 : 10));
+        stopSimulation();
+        machine->setMemoryValue(index.row(), value);
         updateMemoryTable(false, true);
 
         // Check if moving to cell below is pending
-        if (advanceToNextCell && topLeft == ui->tableViewMemoryInstructions->currentIndex())
-            ui->tableViewMemoryInstructions->setCurrentIndex(memoryModel.index(topLeft.row() + 1, topLeft.column()));
-        else if (advanceToNextCell && topLeft == ui->tableViewMemoryData->currentIndex())
-            ui->tableViewMemoryData->setCurrentIndex(memoryModel.index(topLeft.row() + 1, topLeft.column()));
+        if (advanceToNextCell && index == ui->tableViewMemoryInstructions->currentIndex())
+            ui->tableViewMemoryInstructions->setCurrentIndex(memoryModel.index(index.row() + 1, index.column()));
+        else if (advanceToNextCell && index == ui->tableViewMemoryData->currentIndex())
+            ui->tableViewMemoryData->setCurrentIndex(memoryModel.index(index.row() + 1, index.column()));
 
         manuallyModifiedMemory = true;
         advanceToNextCell = false;
@@ -1106,19 +1307,13 @@ void HidraGui::statusBarMessageChanged(QString newMessage)
 
 void HidraGui::saveBackup()
 {
-    if (modifiedFile && modifiedSinceBackup)
-    {
-        QFile file("__Recovery__.txt");
-
-        if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
-            return; // Ignore errors
+    int revision = codeEditor->document()->revision();
 
-        QTextStream out(&file);
-        out << tr(";; ARQUIVO RECUPERADO. Selecione a máquina novamente.\n")
-            << tr(";; --------------------------------------------------\n")
-            << codeEditor->toPlainText();
-
-        modifiedSinceBackup = false;
+    // The journal's thread writes only what changed since the last backup
+    if (modifiedFile && revision != backupRevision)
+    {
+        recoveryJournal.save(codeEditor->toPlainText());
+        backupRevision = revision;
     }
 }
 
@@ -1178,18 +1373,18 @@ void HidraGui::on_actionClose_triggered()
 void HidraGui::closeEvent(QCloseEvent *event)
 {
     bool cancelled, answeredNo = false;
-    machine->setRunning(false);
+    stopSimulation();
 
     saveChangesDialog(cancelled, &answeredNo);
 
-    // Delete backup file
-    /*if (!cancelled)
-        QFile::remove("__Recovery__.txt");*/
-
     if (!cancelled && !answeredNo && manuallyModifiedMemory && QMessageBox::warning(this, "Aviso", "Modificações manuais feitas na memória serão perdidas.",
                                                                                     QMessageBox::Ok|QMessageBox::Cancel) == QMessageBox::Cancel)
         cancelled = true;
 
+    // Delete backup file once the window is sure to close
+    if (!cancelled)
+        recoveryJournal.discard();
+
     // Accept/reject window close event
     if (!cancelled)
         event->accept();
@@ -1205,6 +1400,8 @@ void HidraGui::closeEvent(QCloseEvent *event)
 
 void HidraGui::on_actionBuild_triggered()
 {
+    stopSimulation();
+
     if (manuallyModifiedMemory)
     {
         if (QMessageBox::warning(this, "Aviso", "Modificações manuais feitas na memória serão sobrescritas.",
@@ -1217,12 +1414,24 @@ void HidraGui::on_actionBuild_triggered()
     int previousPC = machine->getPCValue();
 
     clearErrorsField();
+    ui->statusBar->setToolTip(""); // Previous optimizer report
     machine->assemble(codeEditor->toPlainText());
+    trace.clear(); // Recorded states belong to the previous program
+    updateTimeline();
 
     if (machine->getBuildSuccessful())
     {
         sourceAndMemoryInSync = true;
         scrollToCurrentLine();
+
+        // Optimizer report (not an error): summary in the status bar, each rewrite in its tooltip
+        if (machine->getOptimizationInstructionsRemoved() > 0)
+        {
+            ui->statusBar->showMessage(QString("Otimização: %1 instrução(ões) removida(s), %2 byte(s) economizado(s).")
+                                       .arg(machine->getOptimizationInstructionsRemoved())
+                                       .arg(machine->getOptimizationBytesSaved()));
+            ui->statusBar->setToolTip(machine->getOptimizationReport().join("\n"));
+        }
     }
     else
     {
@@ -1230,13 +1439,14 @@ void HidraGui::on_actionBuild_triggered()
         machine->setPCValue(previousPC);
     }
 
-    updateMachineInterface(true);
+    updateMemoryTableAfterBuild(machine->takeChangedRanges());
+    updateMachineInterface(false, false);
 }
 
 void HidraGui::on_actionResetPC_triggered()
 {
     // Stop machine and reset PC
-    machine->setRunning(false);
+    stopSimulation();
     machine->setPCValue(0);
 
     // Reset SP on stack machines
@@ -1253,11 +1463,9 @@ void HidraGui::on_actionResetPC_triggered()
 void HidraGui::on_actionRun_triggered()
 {
     // If already running, stop
-    if (machine->isRunning())
+    if (snapshotTimer.isActive())
     {
-        // Stop
-        machine->setRunning(false);
-        updateMachineInterface();
+        stopSimulation();
     }
     else
     {
@@ -1266,24 +1474,20 @@ void HidraGui::on_actionRun_triggered()
         int breakpointAddress = machine->getSourceLineCorrespondingAddress(breakpointLine);
         machine->setBreakpoint(breakpointAddress);
 
-        // Start running
+        // Start running on the simulation thread, the interface follows its snapshots
         machine->setRunning(true);
+        simulation.startSimulation(machine, instructionsPerSecond, (recordExecution) ? &trace : nullptr);
+        snapshotTimer.start();
+        performanceMonitor.start(machine->getInstructionCount(), machine->getAccessCount());
 
-        // Keep running until stopped
-        while (machine->isRunning())
-        {
-            int instructionsPerRefresh = (fastExecute) ? 100 : 1; // Inside while loop, allows realtime change
-            int nextInstructionCount = machine->getInstructionCount() + 1;
-            bool refresh = (nextInstructionCount % instructionsPerRefresh == 0); // Refresh whenever it's a multiple of instructionsPerRefresh
-            step(refresh, false); // Don't update instruction strings when running
-        }
-
-        updateMachineInterface(); // When finished, refresh skipped updates in fastExecute, update instruction strings
+        updateButtons();
+        updateTimeline();
     }
 }
 
 void HidraGui::on_actionStep_triggered()
 {
+    stopSimulation();
     step(true, true);
 }
 
@@ -1291,13 +1495,13 @@ void HidraGui::on_actionImportMemory_triggered()
 {
     QString filename = QFileDialog::getOpenFileName(this,
                                                     "Importar memória", "",
-                                                    "Arquivo de memória (*.mem)");
+                                                    "Arquivo de memória (*.mem *.hmem *.hex *.bin);;Checkpoint (*.hchk)");
 
     if (!filename.isEmpty())
     {
         QString errorMessage;
 
-        switch (machine->importMemory(filename, 0, machine->getMemorySize(), 0))
+        switch (importMemoryFile(filename, 0, machine->getMemorySize(), 0))
         {
             case FileErrorCode::noError:
                 break;
@@ -1314,6 +1518,10 @@ void HidraGui::on_actionImportMemory_triggered()
                 errorMessage = "Arquivo incompatível com a máquina selecionada.";
                 break;
 
+            case FileErrorCode::invalidChecksum:
+                errorMessage = "Arquivo corrompido.";
+                break;
+
             default:
                 errorMessage = "Erro não especificado.";
                 break;
@@ -1330,7 +1538,7 @@ void HidraGui::on_actionImportMemoryPartial_triggered()
 {
         QString filename = QFileDialog::getOpenFileName(this,
                                                     "Carregamento Parcial de Memória", "",
-                                                    "Arquivo de memória (*.mem)");
+                                                    "Arquivo de memória (*.mem *.hmem *.hex *.bin)");
 
     if (!filename.isEmpty())
     {
@@ -1345,7 +1553,7 @@ void HidraGui::on_actionImportMemoryPartial_triggered()
         dest = QInputDialog::getInt(this, tr("Carga Parcial de memória"), tr("Entre com o endereço de destino (Memória)"), 0, 0, machine->getMemorySize(), 1, &ok);
         if(!ok){return;}
         
-        switch (machine->importMemory(filename, start, end, dest))
+        switch (importMemoryFile(filename, start, end, dest))
         {
             case FileErrorCode::noError:
                 break;
@@ -1362,6 +1570,10 @@ void HidraGui::on_actionImportMemoryPartial_triggered()
                 errorMessage = "Arquivo incompatível com a máquina selecionada.";
                 break;
 
+            case FileErrorCode::invalidChecksum:
+                errorMessage = "Arquivo corrompido.";
+                break;
+
             default:
                 errorMessage = "Erro não especificado.";
                 break;
@@ -1378,18 +1590,73 @@ void HidraGui::on_actionExportMemory_triggered()
 {
     QString filename = QFileDialog::getSaveFileName(this,
                                                     "Exportar memória", "",
-                                                    "Arquivo de memória (*.mem)");
+                                                    "Arquivo de memória (*.mem);;Imagem de memória compacta (*.hmem);;Intel HEX (*.hex);;Binário (*.bin);;Checkpoint (*.hchk)");
 
     if (!filename.isEmpty())
     {
-        if (machine->exportMemory(filename) != FileErrorCode::noError)
+        if (exportMemoryFile(filename) != FileErrorCode::noError)
             QMessageBox::information(this, "Erro ao exportar memória.", "Erro ao exportar memória.");
     }
 }
 
+FileErrorCode::FileErrorCode HidraGui::importMemoryFile(QString filename, int start, int end, int dest)
+{
+    QString extension = QFileInfo(filename).suffix().toLower();
+
+    stopSimulation();
+
+    if (extension == "hchk") // Whole machine state, resumed with Run
+    {
+        FileErrorCode::FileErrorCode result = machine->importCheckpoint(filename);
+        machine->setRunning(false);
+        return result;
+    }
+    else if (extension == "hex")
+        return machine->importIntelHex(filename, start, end, dest);
+    else if (extension == "bin")
+        return machine->importBinary(filename, start, end, dest);
+    else
+        return machine->importMemory(filename, start, end, dest); // .mem or compact image, detected by the header
+}
+
+FileErrorCode::FileErrorCode HidraGui::exportMemoryFile(QString filename)
+{
+    QString extension = QFileInfo(filename).suffix().toLower();
+
+    if (extension == "hmem")
+        return machine->exportMemoryImage(filename); // Also keeps registers, flags and stack
+    else if (extension == "hchk")
+        return machine->exportCheckpoint(filename);
+    else if (extension == "hex")
+        return machine->exportIntelHex(filename, 0, machine->getMemorySize());
+    else if (extension == "bin")
+        return machine->exportBinary(filename, 0, machine->getMemorySize());
+    else
+        return machine->exportMemory(filename);
+}
+
+void HidraGui::on_actionExportListing_triggered()
+{
+    if (!sourceAndMemoryInSync)
+    {
+        QMessageBox::information(this, "Exportar listagem", "Monte o código antes de exportar a listagem.");
+        return;
+    }
+
+    QString filename = QFileDialog::getSaveFileName(this,
+                                                    "Exportar listagem", "",
+                                                    "Listagem (*.lst)");
+
+    if (!filename.isEmpty())
+    {
+        if (machine->exportListing(filename, codeEditor->toPlainText()) != FileErrorCode::noError)
+            QMessageBox::information(this, "Erro ao exportar listagem.", "Erro ao exportar listagem.");
+    }
+}
+
 void HidraGui::on_actionResetRegisters_triggered()
 {
-    machine->setRunning(false);
+    stopSimulation();
     machine->clearRegisters();
     machine->clearFlags();
     machine->clearCounters();
@@ -1450,15 +1717,56 @@ void HidraGui::on_actionShowCharacters_toggled(bool checked)
 
     showCharacters = checked;
 
-    ui->tableViewMemoryData->setColumnHidden(ColumnCharacter, !showCharacters);
+    ui->tableViewMemoryData->setColumnHidden(MemoryTableModel::ColumnCharacter, !showCharacters);
     updateMachineInterface(true);
 }
 
-void HidraGui::on_actionFastExecuteMode_toggled(bool checked)
+void HidraGui::on_actionPeepholeOptimization_toggled(bool checked)
+{
+    settings.setValue("peepholeOptimization", checked);
+
+    peepholeOptimization = checked;
+    machine->setPeepholeOptimizationEnabled(checked);
+}
+
+void HidraGui::executionSpeedSelected(QAction *action)
+{
+    instructionsPerSecond = action->data().toInt();
+    settings.setValue("instructionsPerSecond", instructionsPerSecond);
+
+    simulation.setInstructionsPerSecond(instructionsPerSecond);
+}
+
+void HidraGui::on_actionShowPerformance_toggled(bool checked)
+{
+    settings.setValue("showPerformance", checked);
+
+    showPerformance = checked;
+    performanceLabel->setVisible(showPerformance);
+    updatePerformanceInformation(snapshotTimer.isActive());
+}
+
+void HidraGui::on_actionShowMemoryMap_toggled(bool checked)
 {
-    settings.setValue("fastExecute", checked);
+    settings.setValue("showMemoryMap", checked);
 
-    fastExecute = checked;
+    showMemoryMap = checked;
+    memoryHeatmap->setVisible(showMemoryMap);
+    memoryHeatmap->setMemorySize(machine->getMemorySize()); // Activity while hidden isn't shown
+}
+
+void HidraGui::on_actionRecordExecution_toggled(bool checked)
+{
+    settings.setValue("recordExecution", checked);
+
+    recordExecution = checked;
+    ui->labelTimeline->setVisible(recordExecution);
+    ui->sliderTimeline->setVisible(recordExecution);
+
+    if (!recordExecution && !snapshotTimer.isActive()) // Otherwise cleared when the simulation finishes
+        trace.clear();
+
+    updateTimeline();
 }
 
 void HidraGui::on_actionFollowPCMode_toggled(bool checked)
@@ -1515,10 +1823,25 @@ void HidraGui::on_pushButtonStep_clicked()
     ui->actionStep->trigger();
 }
 
+void HidraGui::on_sliderTimeline_valueChanged(int value)
+{
+    if (snapshotTimer.isActive() || value == trace.getCurrentIndex())
+        return;
+
+    if (trace.seek(*machine, value)) // Replays the recording, nothing is executed
+    {
+        updateMachineInterface(false, true);
+        scrollToCurrentLine();
+    }
+
+    updateTimeline();
+}
+
 void HidraGui::on_tableViewMemoryInstructions_doubleClicked(const QModelIndex &index)
 {
-    if (index.column() != (int)ColumnInstructionValue)
+    if (index.column() != (int)MemoryTableModel::ColumnInstructionValue)
     {
+        stopSimulation();
         machine->setPCValue(index.row()); // Move PC on double-click
         updateMachineInterface();
     }
@@ -1568,16 +1891,32 @@ void HidraGui::on_actionDefaultValues_triggered()
     showSignedData = false;
     settings.setValue("showCharacters", false);
     showCharacters = false;
-    settings.setValue("fastExecute", false);
-    fastExecute = false;
+    settings.setValue("instructionsPerSecond", DEFAULT_INSTRUCTIONS_PER_SECOND);
+    instructionsPerSecond = DEFAULT_INSTRUCTIONS_PER_SECOND;
+    simulation.setInstructionsPerSecond(instructionsPerSecond);
     settings.setValue("followPC", true);
     followPC = true;
+    settings.setValue("showPerformance", false);
+    showPerformance = false;
+    settings.setValue("showMemoryMap", false);
+    showMemoryMap = false;
+    settings.setValue("recordExecution", false);
+    recordExecution = false;
+    settings.setValue("peepholeOptimization", false);
+    peepholeOptimization = false;
+    machine->setPeepholeOptimizationEnabled(false);
 
     ui->actionHexadecimalMode->setChecked(showHexValues);
     ui->actionSignedMode->setChecked(showSignedData);
     ui->actionShowCharacters->setChecked(showCharacters);
-    ui->actionFastExecuteMode->setChecked(fastExecute);
     ui->actionFollowPCMode->setChecked(followPC);
+    ui->actionShowPerformance->setChecked(showPerformance);
+    ui->actionShowMemoryMap->setChecked(showMemoryMap);
+    ui->actionRecordExecution->setChecked(recordExecution);
+    ui->actionPeepholeOptimization->setChecked(peepholeOptimization);
+
+    foreach (QAction *action, ui->menuExecutionSpeed->actions())
+        action->setChecked(action->data().toInt() == instructionsPerSecond);
 
     updateMachineInterface(true);
 }
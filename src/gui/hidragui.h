@@ -21,6 +21,11 @@
 #include "registerwidget.h"
 #include "findreplacedialog.h"
 #include "flagwidget.h"
+#include "memorytablemodel.h"
+#include "simulationthread.h"
+#include "performancemonitor.h"
+#include "memoryheatmapwidget.h"
+#include "core/recoveryjournal.h"
 #include "about.h"
 #include "machines/neandermachine.h"
 #include "machines/ahmesmachine.h"
@@ -40,18 +45,6 @@ class HidraGui : public QMainWindow
 {
     Q_OBJECT
 
-    enum MemoryTableColumn
-    {
-        ColumnPC,
-        ColumnAddress,
-        ColumnInstructionValue,
-        ColumnDataValue,
-        ColumnCharacter,
-        ColumnLabel,
-        ColumnInstructionString,
-        NumColumns // Last column marker
-    };
-
     enum StackTableColumn
     {
         ColumnStackSP,
@@ -73,10 +66,14 @@ public:
     void load(QString filename, bool showErrors);
 
     void step(bool refresh, bool updateInstructionStrings);
+    void initializeExecutionSpeedMenu();
+    void updatePerformanceInformation(bool newSample);
+    void updateMemoryHeatmap();
+    void updateTimeline();
+    void stopSimulation(); // Waits for the simulation thread and shows its final state
+    void finishSimulation();
     bool eventFilter(QObject *obj, QEvent *event);
 
-    void enableDataChangedSignal();
-    void disableDataChangedSignal();
     void enableStatusBarSignal();
     void disableStatusBarSignal();
 
@@ -95,7 +92,10 @@ public slots:
 
 private slots:
     void sourceCodeChanged();
-    void memoryTableDataChanged(QModelIndex topLeft, QModelIndex bottomRight);
+    void memoryValueEdited(QModelIndex index, int value);
+    void updateFromSnapshot();
+    void simulationFinished();
+    void memoryHeatmapClicked(int address);
     void statusBarMessageChanged(QString newMessage);
     void saveBackup();
 
@@ -115,15 +115,20 @@ private slots:
     void on_actionImportMemory_triggered();
     void on_actionImportMemoryPartial_triggered();
     void on_actionExportMemory_triggered();
+    void on_actionExportListing_triggered();
     void on_actionResetRegisters_triggered();
     void on_actionSetBreakpoint_triggered();
+    void on_actionPeepholeOptimization_toggled(bool checked);
 
     // View menu
     void on_actionHexadecimalMode_toggled(bool checked);
     void on_actionSignedMode_toggled(bool checked);
     void on_actionShowCharacters_toggled(bool checked);
-    void on_actionFastExecuteMode_toggled(bool checked);
+    void executionSpeedSelected(QAction *action);
     void on_actionFollowPCMode_toggled(bool checked);
+    void on_actionShowPerformance_toggled(bool checked);
+    void on_actionShowMemoryMap_toggled(bool checked);
+    void on_actionRecordExecution_toggled(bool checked);
     void on_actionBaseConversor_triggered();
 
     // Help menu
@@ -136,6 +141,7 @@ private slots:
     void on_pushButtonResetPC_clicked();
     void on_pushButtonRun_clicked();
     void on_pushButtonStep_clicked();
+    void on_sliderTimeline_valueChanged(int value);
     void on_comboBoxMachine_currentIndexChanged(const QString machineName);
     void on_tableViewMemoryInstructions_doubleClicked(const QModelIndex &index);
     void on_tableViewMemoryData_doubleClicked(const QModelIndex &index);
@@ -167,6 +173,9 @@ private:
     // Internal update methods (called by initialize/updateMachineInterface)
     void updateMachineInterfaceComponents(bool force, bool updateInstructionStrings);
     void updateMemoryTable(bool force, bool updateInstructionStrings);
+    void updateMemoryTableAfterBuild(const QVector<MemoryRange> &changedRanges);
+    void updateInstructionStringCells(bool force);
+    void updateRowHighlight();
     void updateStackTable();
     void updateRegisterWidgets();
     void updateFlagWidgets();
@@ -183,6 +192,10 @@ private:
     QString valueToString(int value, bool isHexadecimal, bool isSigned);
     QString getValueDescription(int value, bool isSigned);
 
+    // Memory files (format chosen by extension)
+    FileErrorCode::FileErrorCode importMemoryFile(QString filename, int start, int end, int dest);
+    FileErrorCode::FileErrorCode exportMemoryFile(QString filename);
+
     // Config file
     void loadConfFile();
     QSettings settings;
@@ -208,24 +221,41 @@ private:
 
     // File handling
     QString currentFilename;
-    bool modifiedFile, manuallyModifiedMemory, modifiedSinceBackup;
+    bool modifiedFile, manuallyModifiedMemory;
     bool forceSaveAs; // Set to true when Save should trigger SaveAs
     QTimer backupTimer;
+    RecoveryJournal recoveryJournal; // Written in the background (see saveBackup)
+    int backupRevision; // Document revision last handed to the recovery journal
+
+    // Simulation (see SimulationThread)
+    SimulationThread simulation;
+    QTimer snapshotTimer; // Active while the simulation thread runs
+    PerformanceMonitor performanceMonitor;
+    PerformanceStatistics performanceStatistics; // Last sample
+    QLabel *performanceLabel;
+    ExecutionTrace trace; // Recorded instructions, shown by the timeline slider
 
     // Build status
     bool sourceAndMemoryInSync, buildSuccessful; // Both turn false when code is changed
 
     // Memory table
-    QStandardItemModel memoryModel, stackModel;
-    int previousPCValue;
-    QVector<QColor> previousRowColor;    
+    MemoryTableModel memoryModel;
+    QStandardItemModel stackModel;
+    QVector<int> highlightedRows; // Rows with a highlight color, the others use the base color
+    MemoryHeatmapWidget *memoryHeatmap;
     bool advanceToNextCell = false;
     const QBrush colorGrayedOut;
 
     // View options
     bool showHexValues, showSignedData, showCharacters; // Value display modes
-    bool fastExecute; // Don't update memory table on every instruction
+    int instructionsPerSecond; // Run speed, 0 for unlimited
     bool followPC;
+    bool showPerformance;
+    bool showMemoryMap;
+    bool recordExecution; // Runs and steps are recorded in the trace (slows the simulation down)
+
+    // Build options
+    bool peepholeOptimization; // Optimize the assembled program (see PeepholeOptimizer)
 
 
     
@@ -3,29 +3,6 @@
 #define DEBUG_INT(value) qDebug(QString::number(value).toStdString().c_str());
 #define DEBUG_STRING(value) qDebug(value.toStdString().c_str());
 
-//////////////////////////////////////////////////
-// HighlightRule methods
-//////////////////////////////////////////////////
-
-HighlightRule::HighlightRule(QString pattern, QTextCharFormat format)
-{
-    this->regExp = QRegExp(pattern);
-    this->regExp.setCaseSensitivity(Qt::CaseInsensitive);
-    this->format = format;
-}
-
-QRegExp HighlightRule::getRegExp()
-{
-    return regExp;
-}
-
-QTextCharFormat HighlightRule::getFormat() const
-{
-    return format;
-}
-
-
-
 //////////////////////////////////////////////////
 // HidraHighlighter methods
 //////////////////////////////////////////////////
@@ -33,105 +10,95 @@ QTextCharFormat HighlightRule::getFormat() const
 HidraHighlighter::HidraHighlighter(QObject *parent) :
     QSyntaxHighlighter(parent)
 {
+    initializeFormats();
 }
 
 HidraHighlighter::HidraHighlighter(QTextDocument *parent) :
     QSyntaxHighlighter(parent)
 {
-
+    initializeFormats();
 }
 
-void HidraHighlighter::highlightBlock(const QString &originalText)
+void HidraHighlighter::highlightBlock(const QString &text)
 {
-    QString text = originalText;
-    text.replace("'''", "___"); // Remove literal quotes before applying rules
+    int length = text.length();
+    int index = 0;
+    bool insideString = false;
 
-    foreach (HighlightRule highlightRule, highlightRulesList)
+    while (index < length)
     {
-        QRegExp regExp = highlightRule.getRegExp();
+        int wordLength = 0, wordCharacters;
+
+        // Word (the ''' character literal counts as part of it)
+        while ((wordCharacters = getWordCharactersAt(text, index + wordLength)) > 0)
+            wordLength += wordCharacters;
 
-        int index = text.indexOf(regExp); // Search first occurrence of pattern
+        if (wordLength > 0)
+        {
+            QHash<QString, KeywordType>::const_iterator keyword = keywords.constFind(text.mid(index, wordLength).toLower());
+
+            if (keyword != keywords.constEnd())
+                setFormat(index, wordLength, (keyword.value() == KeywordInstruction) ? instructionsFormat : directivesFormat);
 
-        while (index >= 0) // While there are occurrences of pattern
+            index += wordLength;
+        }
+        else if (text[index] == '\'')
+        {
+            insideString = !insideString;
+            index++;
+        }
+        else if (text[index] == ';' && !insideString)
         {
-            int length = regExp.cap(1).length();
-            setFormat(regExp.pos(1), length, highlightRule.getFormat()); // Set text format
-            index = text.indexOf(regExp, index + regExp.matchedLength()); // Search next occurrence
+            setFormat(index, length - index, commentsFormat); // Rest of the line
+            break;
+        }
+        else
+        {
+            index++;
         }
     }
 }
 
-void HidraHighlighter::initializeInstructionHighlightRule(Machine &machine)
+int HidraHighlighter::getWordCharactersAt(const QString &text, int index)
 {
-    // Create new regular expression pattern containing instructions
-    QString instructionsPattern = "(";
-    foreach (Instruction *instructionPtr, machine.getInstructions())
-    {
-        instructionsPattern.append("\\b" + instructionPtr->getMnemonic()+"\\b|");
-    }
-    instructionsPattern.chop(1);
-    instructionsPattern.append(")");
+    if (index >= text.length())
+        return 0;
 
-    // Set corresponding format
-    QTextCharFormat instructionsFormat;
+    if (text[index].isLetterOrNumber() || text[index] == '_')
+        return 1;
 
-    instructionsFormat.setFontWeight(QFont::Bold);
-    //instructionsFormat.setForeground(Qt::darkMagenta);
-    instructionsFormat.setForeground(QColor(237, 175, 2));
+    if (text.midRef(index, 3) == QLatin1String("'''")) // Quote character literal, not a string delimiter
+        return 3;
 
-    // Append to list of rules
-    highlightRulesList.push_back(HighlightRule(instructionsPattern, instructionsFormat));
+    return 0;
 }
 
-void HidraHighlighter::initializeDirectivesHighlightRule()
+void HidraHighlighter::initializeFormats()
 {
-    // Create new regular expression pattern containing directives
-    QString directivesPattern = "(";
-
-    directivesPattern.append("\\b" + QString("org") + "\\b|");
-    directivesPattern.append("\\b" + QString("db") + "\\b|");
-    directivesPattern.append("\\b" + QString("dw") + "\\b|");
-    directivesPattern.append("\\b" + QString("dab") + "\\b|");
-    directivesPattern.append("\\b" + QString("daw") + "\\b|");
-
-    directivesPattern.chop(1);
-    directivesPattern.append(")");
-
-    // Set corresponding format
-    QTextCharFormat directivesFormat;
+    instructionsFormat.setFontWeight(QFont::Bold);
+    instructionsFormat.setForeground(QColor(237, 175, 2));
 
     directivesFormat.setFontWeight(QFont::Bold);
     directivesFormat.setForeground(QColor(68, 119, 176));
 
-    // Append to list of rules
-    highlightRulesList.push_back(HighlightRule(directivesPattern, directivesFormat));
-}
-
-void HidraHighlighter::initializeCommentsHighlightRule()
-{
-    const QString CHARS_EXCEPT_QUOTE_SEMICOLON = "[^';]*";
-    const QString STRING = "(?:'[^']*')";
-    const QString COMMENT = "(;.*)$";
-
-    // Create new regular expression pattern
-    QString commentsPattern = "^(?:" + CHARS_EXCEPT_QUOTE_SEMICOLON + STRING + "?)*" + COMMENT;
-
-    // Set corresponding format
-    QTextCharFormat commentsFormat;
-
     commentsFormat.setFontWeight(QFont::Normal);
     commentsFormat.setForeground(Qt::darkGreen);
     commentsFormat.setFontItalic(true);
-
-    // Append to list of rules
-    highlightRulesList.push_back(HighlightRule(commentsPattern, commentsFormat));
 }
 
-void HidraHighlighter::initializeHighlighter(Machine &machine)
+bool HidraHighlighter::initializeHighlighter(Machine &machine)
 {
-    highlightRulesList.clear();
+    QHash<QString, KeywordType> newKeywords;
+
+    foreach (Instruction *instruction, machine.getInstructions())
+        newKeywords.insert(instruction->getMnemonic().toLower(), KeywordInstruction);
+
+    foreach (QString directive, QStringList() << "org" << "db" << "dw" << "dab" << "daw")
+        newKeywords.insert(directive, KeywordDirective); // Directives take precedence
+
+    if (newKeywords == keywords)
+        return false;
 
-    initializeInstructionHighlightRule(machine);
-    initializeDirectivesHighlightRule();
-    initializeCommentsHighlightRule();
+    keywords = newKeywords;
+    return true;
 }
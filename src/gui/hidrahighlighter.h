@@ -2,32 +2,18 @@
 #define HIDRAHIGHLIGHTER_H
 
 #include <QSyntaxHighlighter>
+#include <QHash>
 #include "core/machine.h"
 
 
 
-//////////////////////////////////////////////////
-// HighlightRule class
-//////////////////////////////////////////////////
-
-class HighlightRule
-{
-public:
-    HighlightRule(QString pattern, QTextCharFormat format);
-    QRegExp getRegExp();
-    QTextCharFormat getFormat() const;
-
-private:
-    QRegExp regExp;
-    QTextCharFormat format;
-};
-
-
-
 //////////////////////////////////////////////////
 // HidraHighlighter class
 //////////////////////////////////////////////////
 
+/// Highlights each block in a single pass: words are looked up in a keyword table built from the
+/// machine's mnemonics and the assembler directives, and the first semicolon outside a string
+/// starts a comment.
 class HidraHighlighter : public QSyntaxHighlighter
 {
     Q_OBJECT
@@ -35,21 +21,25 @@ public:
     explicit HidraHighlighter(QObject *parent = 0);
     HidraHighlighter ( QTextDocument * parent );
 
-    void initializeHighlighter(Machine &machine);
-
-    void initializeInstructionHighlightRule(Machine &machine);
-    void initializeDirectivesHighlightRule();
-    void initializeCommentsHighlightRule();
+    bool initializeHighlighter(Machine &machine); // Returns false if the keywords didn't change, so the document needs no rehighlight
 
 signals:
 
 public slots:
-    void highlightBlock(const QString &textOriginal);
+    void highlightBlock(const QString &text);
 
 private:
-    Machine *machine;
+    enum KeywordType
+    {
+        KeywordInstruction,
+        KeywordDirective
+    };
+
+    void initializeFormats();
+    static int getWordCharactersAt(const QString &text, int index); // 0 if not part of a word
 
-    QList<HighlightRule> highlightRulesList;
+    QHash<QString, KeywordType> keywords; // Lowercase
+    QTextCharFormat instructionsFormat, directivesFormat, commentsFormat;
 };
 
 #endif // HIDRAHIGHLIGHTER_H
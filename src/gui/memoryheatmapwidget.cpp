@@ -0,0 +1,200 @@
+#include "memoryheatmapwidget.h"
+
+#include <QMouseEvent>
+#include <QPaintEvent>
+#include <QPainter>
+#include <cmath>
+
+static const int HALF_LIFE = 1000; // Milliseconds for the heat of an address to halve
+static const float MINIMUM_HEAT = 0.05f; // Below this, an address is cold
+static const int BASE_COLOR = 30; // Gray level of cold addresses
+static const float HEAT_SCALE = 4.0f; // Heat that reaches half intensity
+
+MemoryHeatmapWidget::MemoryHeatmapWidget(QWidget *parent) :
+    QWidget(parent)
+{
+    setSizePolicy(QSizePolicy::Preferred, QSizePolicy::Fixed);
+    setCursor(Qt::PointingHandCursor);
+    setToolTip("Atividade da memória: leituras (azul), escritas (vermelho) e execuções (verde).\n"
+               "Clique em um endereço para mostrá-lo nas tabelas.");
+
+    decayTimer.setInterval(DECAY_INTERVAL);
+    connect(&decayTimer, SIGNAL(timeout()), this, SLOT(decay()));
+
+    setMemorySize(0);
+}
+
+void MemoryHeatmapWidget::setMemorySize(int memorySize)
+{
+    this->memorySize = memorySize;
+
+    columns = 1;
+    while (columns * columns < memorySize)
+        columns *= 2;
+
+    int rows = (memorySize + columns - 1) / columns;
+    image = QImage(columns, qMax(rows, 1), QImage::Format_RGB32);
+    image.fill(palette().color(QPalette::Window));
+
+    for (int address = 0; address < memorySize; address++)
+        image.setPixel(address % columns, address / columns, qRgb(BASE_COLOR, BASE_COLOR, BASE_COLOR));
+
+    previousActivity = MemoryActivity();
+    readHeat.fill(0, memorySize);
+    writeHeat.fill(0, memorySize);
+    executionHeat.fill(0, memorySize);
+    isHot.fill(false, memorySize);
+    hotAddresses.clear();
+
+    decayTimer.stop();
+    update();
+}
+
+void MemoryHeatmapWidget::addActivity(const MemoryActivity &activity)
+{
+    // First update (or a different memory): only sets the reference counters
+    if (previousActivity.reads.size() == memorySize && activity.reads.size() == memorySize)
+    {
+        addHeat(readHeat, activity.reads, previousActivity.reads);
+        addHeat(writeHeat, activity.writes, previousActivity.writes);
+        addHeat(executionHeat, activity.executions, previousActivity.executions);
+        updatePixels();
+
+        if (!hotAddresses.isEmpty() && !decayTimer.isActive())
+            decayTimer.start();
+    }
+
+    previousActivity = activity; // Implicitly shared
+}
+
+QSize MemoryHeatmapWidget::sizeHint() const
+{
+    return QSize(image.width() * 4, 128); // Whole pixels per cell for 256 and 4096 bytes
+}
+
+void MemoryHeatmapWidget::addHeat(QVector<float> &heat, const QVector<quint32> &counters, const QVector<quint32> &previousCounters)
+{
+    const quint32 *current = counters.constData();
+    const quint32 *previous = previousCounters.constData();
+
+    if (current == previous) // Same data, nothing ran since the last update
+        return;
+
+    for (int address = 0; address < memorySize; address++)
+    {
+        quint32 count = current[address] - previous[address]; // Correct across wraparound
+
+        if (count > 0)
+        {
+            heat[address] += count;
+
+            if (!isHot[address])
+            {
+                isHot[address] = true;
+                hotAddresses.append(address);
+            }
+        }
+    }
+}
+
+
+
+//////////////////////////////////////////////////
+// Decay and drawing
+//////////////////////////////////////////////////
+
+void MemoryHeatmapWidget::decay()
+{
+    const float factor = std::pow(0.5f, (float)DECAY_INTERVAL / HALF_LIFE);
+
+    foreach (int address, hotAddresses)
+    {
+        readHeat[address]      = (readHeat[address]      * factor < MINIMUM_HEAT) ? 0 : readHeat[address]      * factor;
+        writeHeat[address]     = (writeHeat[address]     * factor < MINIMUM_HEAT) ? 0 : writeHeat[address]     * factor;
+        executionHeat[address] = (executionHeat[address] * factor < MINIMUM_HEAT) ? 0 : executionHeat[address] * factor;
+    }
+
+    updatePixels();
+
+    if (hotAddresses.isEmpty())
+        decayTimer.stop();
+}
+
+void MemoryHeatmapWidget::updatePixels()
+{
+    QRect dirtyRect;
+    QVector<int> stillHot;
+
+    foreach (int address, hotAddresses)
+    {
+        int x = address % columns;
+        int y = address / columns;
+        QRgb color = getColor(address);
+        QRgb *pixel = reinterpret_cast<QRgb *>(image.scanLine(y)) + x;
+
+        if (*pixel != color)
+        {
+            *pixel = color;
+            dirtyRect |= QRect(x, y, 1, 1);
+        }
+
+        if (readHeat[address] > 0 || writeHeat[address] > 0 || executionHeat[address] > 0)
+            stillHot.append(address);
+        else
+            isHot[address] = false; // Back to the base color
+    }
+
+    hotAddresses = stillHot;
+
+    if (dirtyRect.isValid())
+    {
+        // Repaint only the cells that changed
+        QRect imageRect = getImageRect();
+        double cellSize = (double)imageRect.width() / columns;
+
+        update(QRect(imageRect.x() + std::floor(dirtyRect.x() * cellSize),
+                     imageRect.y() + std::floor(dirtyRect.y() * cellSize),
+                     std::ceil(dirtyRect.width() * cellSize) + 2,
+                     std::ceil(dirtyRect.height() * cellSize) + 2));
+    }
+}
+
+QRect MemoryHeatmapWidget::getImageRect() const
+{
+    int cellSize = qMax(qMin(width() / image.width(), height() / image.height()), 1);
+    QSize size(image.width() * cellSize, image.height() * cellSize);
+
+    return QRect(QPoint((width() - size.width()) / 2, (height() - size.height()) / 2), size);
+}
+
+QRgb MemoryHeatmapWidget::getColor(int address) const
+{
+    // Each channel approaches full intensity as the heat grows
+    int red   = BASE_COLOR + (255 - BASE_COLOR) * writeHeat[address]     / (writeHeat[address]     + HEAT_SCALE);
+    int green = BASE_COLOR + (255 - BASE_COLOR) * executionHeat[address] / (executionHeat[address] + HEAT_SCALE);
+    int blue  = BASE_COLOR + (255 - BASE_COLOR) * readHeat[address]      / (readHeat[address]      + HEAT_SCALE);
+
+    return qRgb(red, green, blue);
+}
+
+void MemoryHeatmapWidget::paintEvent(QPaintEvent *event)
+{
+    QPainter painter(this);
+    painter.fillRect(event->rect(), palette().color(QPalette::Window));
+    painter.drawImage(getImageRect(), image); // Integer scale, no smoothing
+}
+
+void MemoryHeatmapWidget::mousePressEvent(QMouseEvent *event)
+{
+    QRect imageRect = getImageRect();
+
+    if (!imageRect.contains(event->pos()))
+        return;
+
+    int x = (event->pos().x() - imageRect.x()) * image.width() / imageRect.width();
+    int y = (event->pos().y() - imageRect.y()) * image.height() / imageRect.height();
+    int address = y * columns + x;
+
+    if (address < memorySize)
+        emit addressClicked(address);
+}
@@ -0,0 +1,57 @@
+#ifndef MEMORYHEATMAPWIDGET_H
+#define MEMORYHEATMAPWIDGET_H
+
+#include <QImage>
+#include <QTimer>
+#include <QVector>
+#include <QWidget>
+#include "../core/machine.h"
+
+/// Whole address space drawn as a grid with one pixel per byte, colored by recent activity:
+/// red for writes, green for executions and blue for reads.
+///
+/// Activity comes from the machine's access counters (see Machine::getMemoryActivity): each
+/// update adds the counts since the previous one to the heat of each address, which then
+/// decays over time. Pixels are written to a single image only when their color changes, and
+/// the decay timer stops once every address has cooled down.
+class MemoryHeatmapWidget : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit MemoryHeatmapWidget(QWidget *parent = 0);
+
+    void setMemorySize(int memorySize); // Clears the map
+    void addActivity(const MemoryActivity &activity); // Cumulative counters, as kept by the machine
+
+    virtual QSize sizeHint() const;
+
+    static const int DECAY_INTERVAL = 50; // Milliseconds between decay steps
+
+signals:
+    void addressClicked(int address);
+
+protected:
+    virtual void paintEvent(QPaintEvent *event);
+    virtual void mousePressEvent(QMouseEvent *event);
+
+private slots:
+    void decay();
+
+private:
+    void addHeat(QVector<float> &heat, const QVector<quint32> &counters, const QVector<quint32> &previousCounters);
+    void updatePixels(); // Hot addresses only
+    QRect getImageRect() const; // Widget area covered by the image, with square cells
+    QRgb getColor(int address) const;
+
+    int memorySize;
+    int columns; // Power of two, so each row starts at a round address
+    QImage image;
+    QTimer decayTimer;
+
+    MemoryActivity previousActivity; // Empty until the first update
+    QVector<float> readHeat, writeHeat, executionHeat;
+    QVector<int> hotAddresses; // Heat above zero or pixel not yet back to the base color
+    QVector<bool> isHot;
+};
+
+#endif // MEMORYHEATMAPWIDGET_H
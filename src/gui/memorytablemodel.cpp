@@ -0,0 +1,257 @@
+#include "memorytablemodel.h"
+
+#include <algorithm>
+
+MemoryTableModel::MemoryTableModel(QObject *parent) :
+    QAbstractTableModel(parent),
+    machine(nullptr),
+    memorySize(0),
+    showHexValues(false),
+    showSignedData(false),
+    showCharacters(false),
+    pcRow(-1)
+{
+}
+
+
+
+//////////////////////////////////////////////////
+// Machine and display state
+//////////////////////////////////////////////////
+
+void MemoryTableModel::setMachine(Machine *machine)
+{
+    beginResetModel();
+
+    this->machine = machine;
+    memorySize = (machine) ? machine->getMemorySize() : 0; // Cached, so the view never reaches a deleted machine
+    pcRow = -1;
+    rowColor = QVector<QColor>(memorySize);
+    labels = QVector<QString>(memorySize);
+    rowChanged = QVector<bool>(memorySize, false);
+    changedRows.clear();
+
+    endResetModel();
+}
+
+void MemoryTableModel::setDisplayOptions(bool hexadecimal, bool signedData, bool characters)
+{
+    showHexValues = hexadecimal;
+    showSignedData = signedData;
+    showCharacters = characters;
+
+    markAllRowsChanged();
+}
+
+void MemoryTableModel::setAddressForeground(QBrush brush)
+{
+    addressForeground = brush;
+}
+
+void MemoryTableModel::setPCRow(int row)
+{
+    if (row == pcRow)
+        return;
+
+    if (pcRow >= 0 && pcRow < memorySize)
+        markRowChanged(pcRow); // Clear last PC value's arrow
+
+    pcRow = row;
+    markRowChanged(pcRow);
+}
+
+void MemoryTableModel::setRowColor(int row, QColor color)
+{
+    if (row < 0 || row >= memorySize || rowColor[row] == color)
+        return;
+
+    rowColor[row] = color;
+    markRowChanged(row);
+}
+
+bool MemoryTableModel::updateLabels()
+{
+    QVector<int> rows(memorySize);
+
+    for (int row = 0; row < memorySize; row++)
+        rows[row] = row;
+
+    return updateLabels(rows);
+}
+
+bool MemoryTableModel::updateLabels(const QVector<int> &rows)
+{
+    bool labelsChanged = false;
+
+    foreach (int row, rows)
+    {
+        if (row < 0 || row >= memorySize)
+            continue;
+
+        QString labelName = machine->getAddressCorrespondingLabel(row);
+
+        if (labels[row] != labelName)
+        {
+            labels[row] = labelName;
+            markRowChanged(row);
+            labelsChanged = true;
+        }
+    }
+
+    return labelsChanged;
+}
+
+void MemoryTableModel::markRowChanged(int row)
+{
+    if (row < 0 || row >= memorySize || rowChanged[row])
+        return;
+
+    rowChanged[row] = true;
+    changedRows.append(row);
+}
+
+void MemoryTableModel::markAllRowsChanged()
+{
+    for (int row = 0; row < memorySize; row++)
+        markRowChanged(row);
+}
+
+// One dataChanged per run of consecutive changed rows
+void MemoryTableModel::emitChanges()
+{
+    if (changedRows.isEmpty())
+        return;
+
+    std::sort(changedRows.begin(), changedRows.end());
+
+    int start = changedRows.first();
+    for (int i = 0; i < changedRows.size(); i++)
+    {
+        int row = changedRows[i];
+        rowChanged[row] = false;
+
+        if (i == changedRows.size() - 1 || changedRows[i + 1] != row + 1)
+        {
+            emit dataChanged(index(start, 0), index(row, NumColumns - 1));
+
+            if (i < changedRows.size() - 1)
+                start = changedRows[i + 1];
+        }
+    }
+
+    changedRows.clear();
+}
+
+
+
+//////////////////////////////////////////////////
+// QAbstractTableModel
+//////////////////////////////////////////////////
+
+int MemoryTableModel::rowCount(const QModelIndex &parent) const
+{
+    return (parent.isValid()) ? 0 : memorySize;
+}
+
+int MemoryTableModel::columnCount(const QModelIndex &parent) const
+{
+    return (parent.isValid()) ? 0 : NumColumns;
+}
+
+QVariant MemoryTableModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || machine == nullptr || index.row() >= memorySize)
+        return QVariant();
+
+    int row = index.row();
+
+    switch (role)
+    {
+    case Qt::DisplayRole:
+    case Qt::EditRole:
+    {
+        int value = machine->getMemoryValue(row);
+
+        switch (index.column())
+        {
+        case ColumnPC:                return (row == pcRow) ? QString("\u2192") : QString();
+        case ColumnAddress:           return (showHexValues) ? valueToString(row, false) : QString::number(row);
+        case ColumnInstructionValue:  return valueToString(value, false);
+        case ColumnDataValue:         return valueToString(value, showSignedData);
+        case ColumnCharacter:         return (showCharacters && value >= 32 && value < 128) ? QString(QChar(value)) : QString(" ");
+        case ColumnLabel:             return labels[row];
+        case ColumnInstructionString: return machine->getInstructionString(row);
+        }
+        break;
+    }
+
+    case Qt::BackgroundRole:
+        if (rowColor[row].isValid())
+            return QBrush(rowColor[row]);
+        break;
+
+    case Qt::ForegroundRole:
+        if (index.column() == ColumnAddress)
+            return addressForeground; // Grayed out
+        break;
+
+    case Qt::StatusTipRole:
+        // On mouse-over, the byte address is sent to the statusbar (with "@" prefix)
+        // The information box then obtains the address and displays its value in dec/hex/bin
+        if (index.column() == ColumnInstructionValue)
+            return QString("@I") + QString::number(row);
+        else if (index.column() == ColumnDataValue)
+            return QString("@D") + QString::number(row);
+        break;
+    }
+
+    return QVariant();
+}
+
+QVariant MemoryTableModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+        return QAbstractTableModel::headerData(section, orientation, role);
+
+    switch (section)
+    {
+    case ColumnPC:                return " ";
+    case ColumnAddress:           return " End ";
+    case ColumnInstructionValue:  return "Valor";
+    case ColumnDataValue:         return "Dado";
+    case ColumnCharacter:         return "Car.";
+    case ColumnLabel:             return "  Label  ";
+    case ColumnInstructionString: return " Instrução ";
+    }
+
+    return QVariant();
+}
+
+Qt::ItemFlags MemoryTableModel::flags(const QModelIndex &index) const
+{
+    Qt::ItemFlags itemFlags = QAbstractTableModel::flags(index);
+
+    if (index.column() == ColumnInstructionValue || index.column() == ColumnDataValue)
+        itemFlags |= Qt::ItemIsEditable;
+
+    return itemFlags;
+}
+
+bool MemoryTableModel::setData(const QModelIndex &index, const QVariant &value, int role)
+{
+    if (!index.isValid() || role != Qt::EditRole || !(flags(index) & Qt::ItemIsEditable))
+        return false;
+
+    emit memoryValueEdited(index, value.toString().toInt(nullptr, (showHexValues) ? 16 : 10));
+    return true;
+}
+
+QString MemoryTableModel::valueToString(int value, bool isSigned) const
+{
+    if (showHexValues)
+        return QString::number(value, 16).rightJustified(2, QChar('0')).toUpper();
+    else if (isSigned)
+        return QString::number(machine->toSigned(value));
+    else
+        return QString::number(value);
+}
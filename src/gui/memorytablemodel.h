@@ -0,0 +1,72 @@
+#ifndef MEMORYTABLEMODEL_H
+#define MEMORYTABLEMODEL_H
+
+#include <QAbstractTableModel>
+#include <QBrush>
+#include <QColor>
+#include <QVector>
+#include "../core/machine.h"
+
+/// Memory view model that reads cells from the machine when the view asks for them.
+///
+/// Nothing is stored per cell: values come from the memory and instruction strings from the
+/// machine's disassembly, so rows outside the viewport cost nothing. The GUI marks
+/// rows as changed (values, PC arrow, highlight color) and emitChanges signals them as
+/// contiguous dataChanged ranges.
+class MemoryTableModel : public QAbstractTableModel
+{
+    Q_OBJECT
+public:
+    enum Column
+    {
+        ColumnPC,
+        ColumnAddress,
+        ColumnInstructionValue,
+        ColumnDataValue,
+        ColumnCharacter,
+        ColumnLabel,
+        ColumnInstructionString,
+        NumColumns // Last column marker
+    };
+
+    explicit MemoryTableModel(QObject *parent = 0);
+
+    void setMachine(Machine *machine); // Resets the model, nullptr for an empty table
+    void setDisplayOptions(bool hexadecimal, bool signedData, bool characters); // Marks every row as changed
+    void setAddressForeground(QBrush brush);
+
+    void setPCRow(int row);
+    void setRowColor(int row, QColor color); // Only marks the row if the color changed
+    bool updateLabels(); // Returns true if any label changed
+    bool updateLabels(const QVector<int> &rows); // Only checks these rows
+    void markRowChanged(int row);
+    void markAllRowsChanged();
+    void emitChanges();
+
+    virtual int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    virtual int columnCount(const QModelIndex &parent = QModelIndex()) const;
+    virtual QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+    virtual QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
+    virtual Qt::ItemFlags flags(const QModelIndex &index) const;
+    virtual bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole);
+
+signals:
+    void memoryValueEdited(QModelIndex index, int value); // Typed by the user, not yet written to memory
+
+private:
+    QString valueToString(int value, bool isSigned) const;
+
+    Machine *machine;
+    int memorySize;
+
+    bool showHexValues, showSignedData, showCharacters;
+    QBrush addressForeground;
+    int pcRow;
+    QVector<QColor> rowColor; // Invalid until the first highlight update
+    QVector<QString> labels; // Cached, so a build can tell which rows changed
+
+    QVector<bool> rowChanged;
+    QVector<int> changedRows;
+};
+
+#endif // MEMORYTABLEMODEL_H
@@ -0,0 +1,58 @@
+#include "performancemonitor.h"
+
+PerformanceMonitor::PerformanceMonitor()
+{
+    start(0, 0);
+}
+
+void PerformanceMonitor::start(qint64 instructionCount, qint64 accessCount)
+{
+    windowTimer.start();
+
+    windowInstructionCount = lastInstructionCount = instructionCount;
+    windowAccessCount = lastAccessCount = accessCount;
+    windowSimulationTime = lastSimulationTime = 0; // Counted from the start of each simulation
+
+    refreshTime = 0;
+    refreshCount = 0;
+}
+
+void PerformanceMonitor::addSnapshot(const MachineSnapshot &snapshot)
+{
+    lastInstructionCount = snapshot.instructionCount;
+    lastAccessCount = snapshot.accessCount;
+    lastSimulationTime = snapshot.simulationTime;
+}
+
+void PerformanceMonitor::addRefresh(qint64 nanoseconds)
+{
+    refreshTime += nanoseconds;
+    refreshCount++;
+}
+
+bool PerformanceMonitor::sample(PerformanceStatistics &statistics)
+{
+    qint64 elapsed = windowTimer.nsecsElapsed();
+
+    if (elapsed < SAMPLE_INTERVAL * 1000000LL)
+        return false;
+
+    double seconds = elapsed / 1e9;
+
+    statistics.instructionsPerSecond = (lastInstructionCount - windowInstructionCount) / seconds;
+    statistics.accessesPerSecond     = (lastAccessCount - windowAccessCount) / seconds;
+    statistics.simulationLoad        = (lastSimulationTime - windowSimulationTime) / (double)elapsed;
+    statistics.refreshLoad           = refreshTime / (double)elapsed;
+    statistics.refreshesPerSecond    = refreshCount / seconds;
+    statistics.engine                = SimulationThread::getEngineName();
+
+    // Next window
+    windowTimer.restart();
+    windowInstructionCount = lastInstructionCount;
+    windowAccessCount = lastAccessCount;
+    windowSimulationTime = lastSimulationTime;
+    refreshTime = 0;
+    refreshCount = 0;
+
+    return true;
+}
@@ -0,0 +1,48 @@
+#ifndef PERFORMANCEMONITOR_H
+#define PERFORMANCEMONITOR_H
+
+#include <QElapsedTimer>
+#include <QString>
+
+#include "simulationthread.h"
+
+/// Rates over the last sampling window
+struct PerformanceStatistics
+{
+    double instructionsPerSecond;
+    double accessesPerSecond;
+    double simulationLoad; // Fraction of the time the simulation thread spent executing
+    double refreshLoad; // Fraction of the time the interface spent refreshing
+    double refreshesPerSecond;
+    QString engine;
+};
+
+/// Measures a run from the counters it already keeps: machine counters and execution time come
+/// with each snapshot, refresh time is added by the interface. Nothing is measured per
+/// instruction here.
+class PerformanceMonitor
+{
+public:
+    PerformanceMonitor();
+
+    void start(qint64 instructionCount, qint64 accessCount); // Counters when the run starts
+    void addSnapshot(const MachineSnapshot &snapshot);
+    void addRefresh(qint64 nanoseconds);
+    bool sample(PerformanceStatistics &statistics); // False until a window is complete
+
+    static const int SAMPLE_INTERVAL = 500; // Milliseconds per window
+
+private:
+    QElapsedTimer windowTimer;
+
+    // Cumulative values at the window start and at the last snapshot
+    qint64 windowInstructionCount, windowAccessCount;
+    qint64 windowSimulationTime;
+    qint64 lastInstructionCount, lastAccessCount;
+    qint64 lastSimulationTime;
+
+    qint64 refreshTime;
+    int refreshCount;
+};
+
+#endif // PERFORMANCEMONITOR_H
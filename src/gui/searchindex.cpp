@@ -0,0 +1,138 @@
+#include "searchindex.h"
+#include <QRegExp>
+#include <algorithm>
+
+SearchIndex::SearchIndex()
+{
+    document = nullptr;
+    caseSensitive = false;
+    regex = false;
+}
+
+void SearchIndex::build(QTextDocument *document, QString const &text, bool caseSensitive, bool regex)
+{
+    this->document = document;
+    this->text = text;
+    this->caseSensitive = caseSensitive;
+    this->regex = regex;
+
+    starts.clear();
+    lengths.clear();
+
+    this->indexBlocks(document->firstBlock(), document->lastBlock(), starts, lengths);
+}
+
+void SearchIndex::update(int position, int charsRemoved, int charsAdded)
+{
+    if (!this->isValid()) {
+        return;
+    }
+
+    /* Blocks touched by the change. */
+    QTextBlock first = document->findBlock(position);
+    QTextBlock last = document->findBlock(position + charsAdded);
+
+    if (!first.isValid()) {
+        first = document->lastBlock();
+    }
+    if (!last.isValid()) {
+        last = document->lastBlock();
+    }
+
+    int delta = charsAdded - charsRemoved;
+    int start = first.position();
+    int oldEnd = last.position() + last.length() - delta;
+
+    /* Matches inside the old blocks are replaced, the ones after them move. */
+    int removeFrom = std::lower_bound(starts.constBegin(), starts.constEnd(), start) - starts.constBegin();
+    int removeTo = std::lower_bound(starts.constBegin(), starts.constEnd(), oldEnd) - starts.constBegin();
+
+    for (int i = removeTo; i < starts.size(); i++) {
+        starts[i] += delta;
+    }
+
+    starts.remove(removeFrom, removeTo - removeFrom);
+    lengths.remove(removeFrom, removeTo - removeFrom);
+
+    QVector<int> blockStarts;
+    QVector<int> blockLengths;
+    this->indexBlocks(first, last, blockStarts, blockLengths);
+
+    starts.insert(removeFrom, blockStarts.size(), 0);
+    lengths.insert(removeFrom, blockLengths.size(), 0);
+    std::copy(blockStarts.constBegin(), blockStarts.constEnd(), starts.begin() + removeFrom);
+    std::copy(blockLengths.constBegin(), blockLengths.constEnd(), lengths.begin() + removeFrom);
+}
+
+void SearchIndex::clear()
+{
+    document = nullptr;
+    text.clear();
+    starts.clear();
+    lengths.clear();
+}
+
+bool SearchIndex::isValid() const
+{
+    return document != nullptr;
+}
+
+bool SearchIndex::matchesSearch(QString const &text, bool caseSensitive, bool regex) const
+{
+    return this->isValid() && text == this->text && caseSensitive == this->caseSensitive && regex == this->regex;
+}
+
+bool SearchIndex::isRegex() const
+{
+    return regex;
+}
+
+QVector<int> const &SearchIndex::getStarts() const
+{
+    return starts;
+}
+
+QVector<int> const &SearchIndex::getLengths() const
+{
+    return lengths;
+}
+
+void SearchIndex::indexBlocks(QTextBlock first, QTextBlock const &last, QVector<int> &blockStarts, QVector<int> &blockLengths)
+{
+    if (text.isEmpty()) {
+        return;
+    }
+
+    Qt::CaseSensitivity caseSensitivity = (caseSensitive) ? Qt::CaseSensitive : Qt::CaseInsensitive;
+    QRegExp findRegex(text, caseSensitivity, QRegExp::RegExp2);
+
+    for (QTextBlock block = first; block.isValid(); block = block.next()) {
+        QString blockText(block.text());
+        int index = 0;
+
+        if (regex) {
+            while ((index = findRegex.indexIn(blockText, index)) >= 0) {
+                int length = findRegex.matchedLength();
+
+                /* Zero-length matches can't be selected or replaced. */
+                if (length > 0) {
+                    blockStarts.append(block.position() + index);
+                    blockLengths.append(length);
+                    index += length;
+                } else {
+                    index++;
+                }
+            }
+        } else {
+            while ((index = blockText.indexOf(text, index, caseSensitivity)) >= 0) {
+                blockStarts.append(block.position() + index);
+                blockLengths.append(text.length());
+                index += text.length();
+            }
+        }
+
+        if (block == last) {
+            break;
+        }
+    }
+}
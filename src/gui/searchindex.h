@@ -0,0 +1,47 @@
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <QString>
+#include <QTextBlock>
+#include <QTextDocument>
+#include <QVector>
+
+/*
+ * Index of every match of a search in a document, sorted by position. It is
+ * built once per search and then updated on each document change by
+ * rescanning only the changed blocks (matches never span blocks, as in
+ * QTextDocument::find), so counting is a binary search.
+ */
+class SearchIndex
+{
+public:
+    SearchIndex();
+
+    /* Indexes the whole document. Empty text gives an empty index. */
+    void build(QTextDocument *document, QString const &text, bool caseSensitive, bool regex);
+    /* Must receive every QTextDocument::contentsChange while valid. */
+    void update(int position, int charsRemoved, int charsAdded);
+    void clear();
+
+    bool isValid() const;
+    /* If the index was built for this search. */
+    bool matchesSearch(QString const &text, bool caseSensitive, bool regex) const;
+    bool isRegex() const;
+
+    QVector<int> const &getStarts() const;
+    QVector<int> const &getLengths() const;
+
+private:
+    QTextDocument *document;
+    QString text;
+    bool caseSensitive;
+    bool regex;
+
+    QVector<int> starts;
+    QVector<int> lengths;
+
+    /* Appends the matches in blocks [first, last] (zero-length ones are skipped). */
+    void indexBlocks(QTextBlock first, QTextBlock const &last, QVector<int> &blockStarts, QVector<int> &blockLengths);
+};
+
+#endif // SEARCHINDEX_H
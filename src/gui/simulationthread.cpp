@@ -0,0 +1,233 @@
+#include "simulationthread.h"
+
+#include "machines/machinefactory.h"
+
+//////////////////////////////////////////////////
+// Snapshot
+//////////////////////////////////////////////////
+
+void MachineSnapshot::capture(Machine &machine)
+{
+    memory.resize(machine.getMemorySize());
+    for (int address = 0; address < memory.size(); address++)
+        memory[address] = machine.getMemoryValue(address);
+
+    registers.resize(machine.getNumberOfRegisters());
+    for (int id = 0; id < registers.size(); id++)
+        registers[id] = machine.getRegisterValue(id);
+
+    flags.resize(machine.getNumberOfFlags());
+    for (int id = 0; id < flags.size(); id++)
+        flags[id] = machine.getFlagValue(id);
+
+    stack.resize(machine.getStackSize());
+    for (int address = 0; address < stack.size(); address++)
+        stack[address] = machine.getStackValue(address);
+
+    instructionCount = machine.getInstructionCount();
+    accessCount = machine.getAccessCount();
+    activity = machine.getMemoryActivity(); // Shared until the simulation writes to it again
+    running = machine.isRunning();
+}
+
+void MachineSnapshot::apply(Machine &machine) const
+{
+    for (int address = 0; address < memory.size(); address++)
+    {
+        if (machine.getMemoryValue(address) != memory[address])
+            machine.setMemoryValue(address, memory[address]);
+    }
+
+    for (int id = 0; id < registers.size(); id++)
+        machine.setRegisterValue(id, registers[id]);
+
+    for (int id = 0; id < flags.size(); id++)
+        machine.setFlagValue(id, flags[id]);
+
+    for (int address = 0; address < stack.size(); address++)
+        machine.setStackValue(address, stack[address]);
+
+    machine.setCounters(instructionCount, accessCount);
+    machine.setMemoryActivity(activity);
+    machine.setRunning(running);
+}
+
+
+
+//////////////////////////////////////////////////
+// Simulation thread
+//////////////////////////////////////////////////
+
+SimulationThread::SimulationThread(QObject *parent) :
+    QThread(parent),
+    simulatedMachine(nullptr),
+    trace(nullptr),
+    simulationTime(0)
+{
+}
+
+SimulationThread::~SimulationThread()
+{
+    stopSimulation();
+    delete simulatedMachine;
+}
+
+void SimulationThread::startSimulation(Machine *machine, int instructionsPerSecond, ExecutionTrace *trace)
+{
+    stopSimulation();
+
+    // Copy of the machine's state, owned by the thread
+    delete simulatedMachine;
+    simulatedMachine = MachineFactory::createMachine(machine->getIdentifier());
+
+    QByteArray checkpoint = machine->saveCheckpoint();
+    simulatedMachine->loadCheckpoint((const uchar *)checkpoint.constData(), checkpoint.size());
+    simulatedMachine->setMemoryActivity(machine->getMemoryActivity()); // Not part of checkpoints
+
+    this->trace = trace;
+    if (trace != nullptr)
+        trace->resume(*simulatedMachine);
+
+    error.clear();
+    stopRequested.storeRelease(0);
+    setInstructionsPerSecond(instructionsPerSecond);
+
+    start();
+}
+
+void SimulationThread::stopSimulation()
+{
+    stopRequested.storeRelease(1);
+    wait();
+}
+
+void SimulationThread::setInstructionsPerSecond(int instructionsPerSecond)
+{
+    this->instructionsPerSecond.storeRelease(qMax(instructionsPerSecond, 0)); // Allows realtime change
+}
+
+bool SimulationThread::takeSnapshot()
+{
+    return snapshots.take();
+}
+
+const MachineSnapshot& SimulationThread::getSnapshot() const
+{
+    return snapshots.getReadBuffer();
+}
+
+QString SimulationThread::getError() const
+{
+    return error;
+}
+
+QString SimulationThread::getEngineName()
+{
+    return "switch (thread)"; // Machine::executeInstruction, on this thread
+}
+
+void SimulationThread::run()
+{
+    const qint64 tick = SNAPSHOT_INTERVAL * 1000000LL; // Nanoseconds
+    const qint64 second = 1000000000LL;
+
+    QElapsedTimer clock;
+    clock.start();
+
+    int rate = -1;
+    qint64 rateStart = 0, executedAtRate = -1; // Pacing restarts when the rate changes, last instruction run since then
+    simulationTime = 0;
+
+    // Keep running until stopped
+    while (simulatedMachine->isRunning() && !stopRequested.loadAcquire())
+    {
+        qint64 tickStart = clock.nsecsElapsed();
+
+        if (rate != instructionsPerSecond.loadAcquire())
+        {
+            rate = instructionsPerSecond.loadAcquire();
+            rateStart = tickStart;
+            executedAtRate = -1; // The first instruction is due immediately
+        }
+
+        if (rate == 0) // Unlimited, only interrupted to publish
+        {
+            while (simulatedMachine->isRunning() && !stopRequested.loadAcquire() && clock.nsecsElapsed() - tickStart < tick)
+                runInstructions(1024);
+
+            publishSnapshot();
+            continue;
+        }
+
+        // Whole seconds hold exactly rate instructions, so the start can move forward without changing
+        // what's due, keeping the multiplication below from overflowing in long runs
+        qint64 elapsedSeconds = (tickStart - rateStart) / second;
+        rateStart += elapsedSeconds * second;
+        executedAtRate -= elapsedSeconds * rate;
+
+        // Instructions due since the rate was set (instruction i is due at i / rate)
+        qint64 due = (tickStart - rateStart) * rate / second - executedAtRate;
+
+        if (due > 0)
+        {
+            executedAtRate += due;
+            runInstructions((int)qMin(due, (qint64)rate)); // A late tick never runs more than a second's worth
+            publishSnapshot();
+        }
+
+        // Next tick, or the next instruction if it's due later
+        qint64 nextInstruction = rateStart + (executedAtRate + 1) * second / rate;
+        sleepUntil(clock, qMax(tickStart + tick, nextInstruction));
+    }
+
+    simulatedMachine->setRunning(false);
+
+    if (trace != nullptr)
+        trace->finish(*simulatedMachine);
+
+    publishSnapshot(); // Final state
+}
+
+void SimulationThread::runInstructions(int count)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int i = 0; i < count && simulatedMachine->isRunning(); i++)
+    {
+        try
+        {
+            simulatedMachine->step();
+        }
+        catch (QString error)
+        {
+            simulatedMachine->setRunning(false);
+            this->error = error;
+        }
+
+        if (trace != nullptr)
+            trace->recordStep(*simulatedMachine);
+    }
+
+    simulationTime += timer.nsecsElapsed();
+}
+
+void SimulationThread::sleepUntil(const QElapsedTimer &clock, qint64 nanoseconds)
+{
+    qint64 remaining = nanoseconds - clock.nsecsElapsed();
+
+    while (remaining > 0 && !stopRequested.loadAcquire())
+    {
+        usleep((unsigned long)qMin(remaining / 1000 + 1, SNAPSHOT_INTERVAL * 1000LL)); // At most a tick, stays responsive to stop
+        remaining = nanoseconds - clock.nsecsElapsed();
+    }
+}
+
+void SimulationThread::publishSnapshot()
+{
+    MachineSnapshot &snapshot = snapshots.getWriteBuffer();
+
+    snapshot.capture(*simulatedMachine);
+    snapshot.simulationTime = simulationTime;
+    snapshots.publish();
+}
@@ -0,0 +1,73 @@
+#ifndef SIMULATIONTHREAD_H
+#define SIMULATIONTHREAD_H
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QVector>
+
+#include "../core/executiontrace.h"
+#include "../core/machine.h"
+#include "triplebuffer.h"
+
+/// State of the simulated machine shown by the interface
+struct MachineSnapshot
+{
+    QVector<int> memory;
+    QVector<int> registers;
+    QVector<int> flags;
+    QVector<int> stack; // Empty if the machine has no stack
+    qint64 instructionCount;
+    qint64 accessCount;
+    MemoryActivity activity;
+    bool running;
+    qint64 simulationTime; // Nanoseconds spent executing instructions since the simulation started
+
+    void capture(Machine &machine);
+    void apply(Machine &machine) const; // Only writes bytes that differ, so hasByteChanged marks the rows to repaint
+};
+
+/// Runs the machine on a worker thread, without waiting for the interface.
+///
+/// The simulation runs on a copy of the machine (restored from a checkpoint), so the interface
+/// keeps reading its own machine while it runs. Execution is paced in ticks: each tick runs the
+/// instructions due at the target rate and publishes one snapshot through a triple buffer, then
+/// the thread sleeps until the next tick (or the next instruction, at rates below one per tick).
+/// At unlimited rate, instructions run back to back and a snapshot is published once per tick.
+/// An optional ExecutionTrace records every instruction; it belongs to the thread until it finishes.
+class SimulationThread : public QThread
+{
+    Q_OBJECT
+public:
+    explicit SimulationThread(QObject *parent = 0);
+    ~SimulationThread();
+
+    void startSimulation(Machine *machine, int instructionsPerSecond, ExecutionTrace *trace = nullptr); // Machine must be set to running
+    void stopSimulation(); // Blocks until the thread finishes
+    void setInstructionsPerSecond(int instructionsPerSecond); // 0 for unlimited
+
+    bool takeSnapshot(); // Returns false if no new snapshot was published
+    const MachineSnapshot& getSnapshot() const;
+    QString getError() const; // Error that stopped the simulation, valid after the thread finishes
+    static QString getEngineName(); // How instructions are executed
+
+    static const int SNAPSHOT_INTERVAL = 16; // Milliseconds per tick
+
+protected:
+    virtual void run();
+
+private:
+    void publishSnapshot();
+    void runInstructions(int count); // Stops early if the machine stops
+    void sleepUntil(const QElapsedTimer &clock, qint64 nanoseconds); // Wakes up early if stopped
+
+    Machine *simulatedMachine;
+    ExecutionTrace *trace;
+    TripleBuffer<MachineSnapshot> snapshots;
+    QAtomicInt stopRequested;
+    QAtomicInt instructionsPerSecond;
+    QString error;
+    qint64 simulationTime;
+};
+
+#endif // SIMULATIONTHREAD_H
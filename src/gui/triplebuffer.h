@@ -0,0 +1,67 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <QAtomicInt>
+
+/// Lock-free single producer, single consumer exchange of the latest value.
+///
+/// The writer fills getWriteBuffer() and publishes it; the reader takes the most recent
+/// publication and reads getReadBuffer() until the next take. Neither side ever waits: values
+/// published while the reader is busy are replaced by newer ones. Buffers are reused, so the
+/// writer must refill every field it publishes.
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() :
+        writeIndex(0),
+        pendingState(1), // Middle buffer, not fresh
+        readIndex(2)
+    {
+    }
+
+    // Writer side
+    T& getWriteBuffer()
+    {
+        return buffers[writeIndex];
+    }
+
+    void publish()
+    {
+        writeIndex = pendingState.fetchAndStoreOrdered(writeIndex | FreshBit) & IndexMask;
+    }
+
+    bool isConsumed() const // Last publication was taken by the reader
+    {
+        return (pendingState.loadAcquire() & FreshBit) == 0;
+    }
+
+    // Reader side
+    bool take() // Returns false if nothing was published since the last take
+    {
+        if (isConsumed())
+            return false;
+
+        readIndex = pendingState.fetchAndStoreOrdered(readIndex) & IndexMask;
+        return true;
+    }
+
+    const T& getReadBuffer() const
+    {
+        return buffers[readIndex];
+    }
+
+private:
+    enum
+    {
+        IndexMask = 0x3,
+        FreshBit  = 0x4
+    };
+
+    T buffers[3];
+    int writeIndex; // Only used by the writer
+    QAtomicInt pendingState; // Index of the buffer between them, FreshBit if not taken yet
+    int readIndex; // Only used by the reader
+};
+
+#endif // TRIPLEBUFFER_H
@@ -16,6 +16,7 @@ CONFIG  += \
 
 SOURCES += \
     core/baseconversor.cpp \
+    core/expressionevaluator.cpp \
     core/invalidconversorinput.cpp \
     core/pointconversor.cpp \
     gui/baseconversordialog.cpp \
@@ -24,28 +25,41 @@ SOURCES += \
     gui/hidracodeeditor.cpp \
     gui/hidragui.cpp \
     gui/hidrahighlighter.cpp \
+    gui/memorytablemodel.cpp \
+    gui/performancemonitor.cpp \
+    gui/memoryheatmapwidget.cpp \
     gui/pointconversordialog.cpp \
     gui/registerwidget.cpp \
+    gui/searchindex.cpp \
+    gui/simulationthread.cpp \
     core/byte.cpp \
+    core/controlflowgraph.cpp \
+    core/disassembler.cpp \
+    core/executiontrace.cpp \
     core/flag.cpp \
     core/instruction.cpp \
     core/machine.cpp \
     core/main.cpp \
+    core/recoveryjournal.cpp \
     core/register.cpp \
     machines/ahmesmachine.cpp \
     machines/neandermachine.cpp \
     machines/ramsesmachine.cpp \
     core/addressingmode.cpp \
+    core/assemblycache.cpp \
+    core/peepholeoptimizer.cpp \
     machines/cromagmachine.cpp \
     machines/queopsmachine.cpp \
     machines/pitagorasmachine.cpp \
     machines/voltamachine.cpp \
     machines/regmachine.cpp \
     machines/periclesmachine.cpp \
+    machines/machinefactory.cpp \
     gui/about.cpp
 
 HEADERS  += \
     core/baseconversor.h \
+    core/expressionevaluator.h \
     core/invalidconversorinput.h \
     core/pointconversor.h \
     gui/baseconversordialog.h \
@@ -54,23 +68,36 @@ HEADERS  += \
     gui/hidracodeeditor.h \
     gui/hidragui.h \
     gui/hidrahighlighter.h \
+    gui/memorytablemodel.h \
+    gui/performancemonitor.h \
+    gui/memoryheatmapwidget.h \
     gui/pointconversordialog.h \
     gui/registerwidget.h \
+    gui/searchindex.h \
+    gui/simulationthread.h \
+    gui/triplebuffer.h \
     core/byte.h \
+    core/controlflowgraph.h \
+    core/disassembler.h \
+    core/executiontrace.h \
     core/flag.h \
     core/instruction.h \
     core/machine.h \
+    core/recoveryjournal.h \
     core/register.h \
     machines/ahmesmachine.h \
     machines/neandermachine.h \
     machines/ramsesmachine.h \
     core/addressingmode.h \
+    core/assemblycache.h \
+    core/peepholeoptimizer.h \
     machines/cromagmachine.h \
     machines/queopsmachine.h \
     machines/pitagorasmachine.h \
     machines/voltamachine.h \
     machines/regmachine.h \
     machines/periclesmachine.h \
+    machines/machinefactory.h \
     gui/about.h
 
 FORMS    += \
@@ -0,0 +1,85 @@
+/********************************************************************************
+ *
+ * Copyright (C) 2014-2021 PET Computação UFRGS
+ *
+ * Este arquivo é parte do programa Hidra.
+ *
+ * Hidra é um software livre; você pode redistribuí-lo e/ou modificá-lo
+ * dentro dos termos da Licença Pública Geral GNU como publicada pela
+ * Fundação do Software Livre (FSF); na versão 3 da Licença, ou
+ * (de opção sua) qualquer versão posterior.
+ *
+ *******************************************************************************/
+
+// Command-line disassembler for .mem files:
+//   hidradisasm [--dot] arquivo.mem...
+// Prints a listing (or a DOT control-flow graph) of each file, detecting the machine from its identifier.
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFileInfo>
+#include <QHash>
+#include <QTextStream>
+
+#include "core/disassembler.h"
+#include "machines/machinefactory.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    a.setOrganizationName("PET Computação UFRGS");
+    a.setApplicationName("hidradisasm");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Desmonta arquivos .mem do Hidra seguindo o fluxo de controle a partir do endereço 0.");
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption("dot", "Gera o grafo de fluxo de controle (formato DOT) em vez da listagem."));
+    parser.addPositionalArgument("arquivos", "Arquivos .mem a desmontar.", "arquivo.mem...");
+    parser.process(a);
+
+    QStringList filenames = parser.positionalArguments();
+    if (filenames.isEmpty())
+        parser.showHelp(1);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+    out.setCodec("UTF-8");
+    err.setCodec("UTF-8");
+
+    QHash<QString, Machine*> machines; // Reused between files, by identifier
+    int exitCode = 0;
+
+    foreach (QString filename, filenames)
+    {
+        QString identifier = Machine::readMemoryFileIdentifier(filename);
+
+        if (!machines.contains(identifier))
+            machines.insert(identifier, MachineFactory::createMachine(identifier));
+
+        Machine *machine = machines.value(identifier);
+
+        if (machine == nullptr)
+        {
+            err << filename << ": identificador de máquina desconhecido.\n";
+            exitCode = 1;
+            continue;
+        }
+
+        if (machine->importMemory(filename, 0, machine->getMemorySize(), 0) != FileErrorCode::noError)
+        {
+            err << filename << ": arquivo de memória inválido.\n";
+            exitCode = 1;
+            continue;
+        }
+
+        Disassembler disassembler(*machine);
+
+        if (parser.isSet("dot"))
+            out << disassembler.generateDot(QFileInfo(filename).fileName());
+        else
+            out << "; Arquivo " << filename << "\n" << disassembler.generateListing() << "\n";
+    }
+
+    qDeleteAll(machines);
+    return exitCode;
+}
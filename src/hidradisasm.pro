@@ -0,0 +1,74 @@
+#-------------------------------------------------
+#
+# Command-line .mem disassembler
+# (qmake counterpart of the hidradisasm target in CMakeLists.txt)
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+
+TARGET = hidradisasm
+TEMPLATE = app
+
+CONFIG  += \
+    c++11 \
+    console
+CONFIG  -= app_bundle
+
+SOURCES += \
+    hidradisasm.cpp \
+    core/addressingmode.cpp \
+    core/assemblycache.cpp \
+    core/baseconversor.cpp \
+    core/byte.cpp \
+    core/controlflowgraph.cpp \
+    core/disassembler.cpp \
+    core/executiontrace.cpp \
+    core/expressionevaluator.cpp \
+    core/flag.cpp \
+    core/instruction.cpp \
+    core/invalidconversorinput.cpp \
+    core/machine.cpp \
+    core/peepholeoptimizer.cpp \
+    core/pointconversor.cpp \
+    core/recoveryjournal.cpp \
+    core/register.cpp \
+    machines/ahmesmachine.cpp \
+    machines/cromagmachine.cpp \
+    machines/machinefactory.cpp \
+    machines/neandermachine.cpp \
+    machines/periclesmachine.cpp \
+    machines/pitagorasmachine.cpp \
+    machines/queopsmachine.cpp \
+    machines/ramsesmachine.cpp \
+    machines/regmachine.cpp \
+    machines/voltamachine.cpp
+
+HEADERS  += \
+    core/addressingmode.h \
+    core/assemblycache.h \
+    core/baseconversor.h \
+    core/byte.h \
+    core/controlflowgraph.h \
+    core/disassembler.h \
+    core/executiontrace.h \
+    core/expressionevaluator.h \
+    core/flag.h \
+    core/instruction.h \
+    core/invalidconversorinput.h \
+    core/machine.h \
+    core/peepholeoptimizer.h \
+    core/pointconversor.h \
+    core/recoveryjournal.h \
+    core/register.h \
+    machines/ahmesmachine.h \
+    machines/cromagmachine.h \
+    machines/machinefactory.h \
+    machines/neandermachine.h \
+    machines/periclesmachine.h \
+    machines/pitagorasmachine.h \
+    machines/queopsmachine.h \
+    machines/ramsesmachine.h \
+    machines/regmachine.h \
+    machines/voltamachine.h
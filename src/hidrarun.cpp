@@ -0,0 +1,174 @@
+/********************************************************************************
+ *
+ * Copyright (C) 2014-2021 PET Computação UFRGS
+ *
+ * Este arquivo é parte do programa Hidra.
+ *
+ * Hidra é um software livre; você pode redistribuí-lo e/ou modificá-lo
+ * dentro dos termos da Licença Pública Geral GNU como publicada pela
+ * Fundação do Software Livre (FSF); na versão 3 da Licença, ou
+ * (de opção sua) qualquer versão posterior.
+ *
+ *******************************************************************************/
+
+// Headless simulation of a memory file, checkpoint or source file:
+//   hidrarun [--checkpoint arquivo.hchk] [--interval N] [--limit N] [--cache-dir diretório] arquivo
+// Runs until HLT (or the limit), saving a checkpoint every N instructions so the run can be resumed from it.
+// Source files are assembled first, through the assembly cache if a directory is given, so re-running
+// many unchanged sources (e.g. when grading) skips the assembler.
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QFileInfo>
+#include <QScopedPointer>
+#include <QTextStream>
+
+#include "core/assemblycache.h"
+#include "machines/machinefactory.h"
+
+// Machine identifier for a source file extension, empty if it isn't a source file
+static QString sourceFileIdentifier(QString extension)
+{
+    if (extension == "ned")
+        return "NDR";
+    else if (extension == "ahd")
+        return "AHM";
+    else if (extension == "rad")
+        return "RMS";
+    else if (extension == "cro")
+        return "CRM";
+    else if (extension == "qpd")
+        return "QPS";
+    else if (extension == "ptd")
+        return "PTG";
+    else if (extension == "prd")
+        return "PRC";
+    else if (extension == "red")
+        return "REG";
+    else if (extension == "vod")
+        return "VLT";
+
+    return "";
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    a.setOrganizationName("PET Computação UFRGS");
+    a.setApplicationName("hidrarun");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Simula um arquivo de memória (.mem, .hmem) ou de código-fonte (.ned, .rad...) ou retoma um checkpoint (.hchk) sem interface gráfica.");
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption("checkpoint", "Salva checkpoints da execução no arquivo.", "arquivo.hchk"));
+    parser.addOption(QCommandLineOption("interval", "Instruções entre checkpoints (padrão: 100000000).", "N", "100000000"));
+    parser.addOption(QCommandLineOption("limit", "Número máximo de instruções a executar (0: sem limite).", "N", "0"));
+    parser.addOption(QCommandLineOption("cache-dir", "Guarda as montagens de código-fonte no diretório e as reutiliza.", "diretório"));
+    parser.addPositionalArgument("arquivo", "Arquivo de memória, de código-fonte ou checkpoint.");
+    parser.process(a);
+
+    if (parser.positionalArguments().size() != 1)
+        parser.showHelp(1);
+
+    QString filename = parser.positionalArguments().first();
+    QString checkpointFilename = parser.value("checkpoint");
+    QString cacheDirectory = parser.value("cache-dir");
+    qint64 interval = qMax<qint64>(1, parser.value("interval").toLongLong());
+    qint64 limit = parser.value("limit").toLongLong();
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+    out.setCodec("UTF-8");
+    err.setCodec("UTF-8");
+
+    QString extension = QFileInfo(filename).suffix().toLower();
+    QString sourceIdentifier = sourceFileIdentifier(extension);
+    bool isSource = !sourceIdentifier.isEmpty();
+
+    QScopedPointer<Machine> machine(MachineFactory::createMachine((isSource) ? sourceIdentifier : Machine::readMemoryFileIdentifier(filename)));
+
+    if (machine.isNull())
+    {
+        err << filename << ": identificador de máquina desconhecido.\n";
+        return 1;
+    }
+
+    if (isSource)
+    {
+        QFile sourceFile(filename);
+
+        if (!sourceFile.open(QFile::ReadOnly))
+        {
+            err << filename << ": erro ao abrir arquivo.\n";
+            return 1;
+        }
+
+        QString sourceCode = QString::fromUtf8(sourceFile.readAll());
+
+        QObject::connect(machine.data(), &Machine::buildErrorDetected, [&err, &filename](QString error) {
+            err << filename << ": " << error << "\n";
+        });
+
+        if (cacheDirectory.isEmpty())
+        {
+            machine->assemble(sourceCode);
+        }
+        else
+        {
+            AssemblyCache cache(cacheDirectory);
+            bool cacheHit = cache.assemble(*machine, sourceCode);
+            err << filename << ": " << ((cacheHit) ? "montagem recuperada do cache." : "montado e armazenado no cache.") << "\n";
+        }
+
+        if (!machine->getBuildSuccessful())
+            return 1;
+    }
+    else
+    {
+        // Checkpoints resume the whole machine state; memory files start from PC 0
+        bool isCheckpoint = (extension == "hchk");
+        FileErrorCode::FileErrorCode result = (isCheckpoint) ? machine->importCheckpoint(filename)
+                                                             : machine->importMemory(filename, 0, machine->getMemorySize(), 0);
+
+        if (result != FileErrorCode::noError)
+        {
+            err << filename << ": arquivo inválido ou corrompido.\n";
+            return 1;
+        }
+    }
+
+    machine->setRunning(true);
+    qint64 executed = 0;
+
+    while (machine->isRunning() && (limit <= 0 || executed < limit))
+    {
+        machine->step();
+        executed++;
+
+        if (!checkpointFilename.isEmpty() && executed % interval == 0 && machine->exportCheckpoint(checkpointFilename) != FileErrorCode::noError)
+        {
+            err << checkpointFilename << ": erro ao salvar checkpoint.\n";
+            return 1;
+        }
+    }
+
+    if (!checkpointFilename.isEmpty() && machine->exportCheckpoint(checkpointFilename) != FileErrorCode::noError)
+    {
+        err << checkpointFilename << ": erro ao salvar checkpoint.\n";
+        return 1;
+    }
+
+    // Final state
+    out << "Instruções executadas: " << executed << " (total " << machine->getInstructionCount() << ")\n";
+    out << "Acessos à memória: " << machine->getAccessCount() << "\n";
+
+    for (int id = 0; id < machine->getNumberOfRegisters(); id++)
+        out << machine->getRegisterName(id) << " = " << machine->getRegisterValue(id) << "\n";
+
+    for (int id = 0; id < machine->getNumberOfFlags(); id++)
+        out << machine->getFlagName(id) << " = " << machine->getFlagValue(id) << "\n";
+
+    out << ((machine->isRunning()) ? "Limite de instruções atingido.\n" : "Execução encerrada.\n");
+    return 0;
+}
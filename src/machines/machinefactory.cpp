@@ -0,0 +1,35 @@
+#include "machinefactory.h"
+
+#include "neandermachine.h"
+#include "ahmesmachine.h"
+#include "ramsesmachine.h"
+#include "cromagmachine.h"
+#include "queopsmachine.h"
+#include "pitagorasmachine.h"
+#include "periclesmachine.h"
+#include "regmachine.h"
+#include "voltamachine.h"
+
+Machine* MachineFactory::createMachine(QString identifier)
+{
+    if (identifier == "NDR")
+        return new NeanderMachine();
+    else if (identifier == "AHM")
+        return new AhmesMachine();
+    else if (identifier == "RMS")
+        return new RamsesMachine();
+    else if (identifier == "CRM")
+        return new CromagMachine();
+    else if (identifier == "QPS")
+        return new QueopsMachine();
+    else if (identifier == "PTG")
+        return new PitagorasMachine();
+    else if (identifier == "PRC")
+        return new PericlesMachine();
+    else if (identifier == "REG")
+        return new RegMachine();
+    else if (identifier == "VLT")
+        return new VoltaMachine();
+    else
+        return nullptr;
+}
@@ -0,0 +1,12 @@
+#ifndef MACHINEFACTORY_H
+#define MACHINEFACTORY_H
+
+#include "core/machine.h"
+
+namespace MachineFactory
+{
+    ///New machine with the identifier stored in memory files (NDR, AHM, ...), nullptr if unknown
+    Machine* createMachine(QString identifier);
+}
+
+#endif // MACHINEFACTORY_H
@@ -119,6 +119,28 @@ int PericlesMachine::GetCurrentOperandAddress()
     }
 }
 
+// Addresses have two bytes
+int PericlesMachine::getOperandAddressAccessCount(AddressingMode::AddressingModeCode addressingModeCode)
+{
+    switch (addressingModeCode)
+    {
+        case AddressingMode::DIRECT:
+            return 2;
+
+        case AddressingMode::INDIRECT:
+            return 4;
+
+        case AddressingMode::IMMEDIATE:
+            return 0;
+
+        case AddressingMode::INDEXED_BY_X:
+            return 2;
+
+        default:
+            return 0;
+    }
+}
+
 void PericlesMachine::getNextOperandAddress(int &intermediateAddress, int &intermediateAddress2, int &finalOperandAddress)
 {
     int fetchedValue = getMemoryValue(PC->getValue());
@@ -160,19 +182,12 @@ void PericlesMachine::getNextOperandAddress(int &intermediateAddress, int &inter
     }
 }
 
-QString PericlesMachine::generateArgumentsString(int address, Instruction *instruction, AddressingMode::AddressingModeCode addressingModeCode, int &argumentsSize)
+QString PericlesMachine::formatArguments(const DecodedInstruction &decoded)
 {
-    QString addressingModePattern = getAddressingModePattern(addressingModeCode);
-
-    // Calculate size of argument
-    if (instruction->getNumBytes() == 0) // Instruction with variable number of bytes
-        argumentsSize = (addressingModeCode == AddressingMode::IMMEDIATE) ? 1 : 2;
-    else
-        argumentsSize = instruction->getNumBytes() - 1;
+    QString addressingModePattern = getAddressingModePattern(decoded.addressingModeCode);
 
-    // Get argument
-    int argumentValue = (argumentsSize == 2) ? getMemoryTwoByteAddress(address + 1) : getMemoryValue(address + 1);
-    QString argument = QString::number(argumentValue);
+    // Get argument (size already calculated by decodeInstructionAt)
+    QString argument = QString::number(decoded.argument);
 
     // Add addressing mode syntax
     if (addressingModePattern != AddressingMode::NO_PATTERN)
@@ -181,6 +196,19 @@ QString PericlesMachine::generateArgumentsString(int address, Instruction *instr
     return argument;
 }
 
+DecodedInstruction PericlesMachine::decodeInstructionAt(int address)
+{
+    DecodedInstruction decoded = Machine::decodeInstructionAt(address);
+
+    if (decoded.instruction && decoded.instruction->getNumBytes() == 0) // Instruction with variable number of bytes
+    {
+        decoded.size = (decoded.addressingModeCode == AddressingMode::IMMEDIATE) ? 2 : 3; // Immediate argument has only 1 byte
+        decoded.argument = (decoded.size == 3) ? getMemoryTwoByteAddress(address + 1) : getMemoryValue(address + 1);
+    }
+
+    return decoded;
+}
+
 int PericlesMachine::memoryReadTwoByteAddress(int address)
 {
     return memoryRead(address) + (memoryRead(address + 1) << 8);
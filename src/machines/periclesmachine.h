@@ -11,8 +11,10 @@ public:
     void decodeInstruction();
     virtual int calculateBytesToReserve(QString addressArgument);
     virtual int GetCurrentOperandAddress(); // increments accessCount
+    virtual int getOperandAddressAccessCount(AddressingMode::AddressingModeCode addressingModeCode);
     virtual void getNextOperandAddress(int &intermediateAddress, int &intermediateAddress2, int &finalOperandAddress);
-    virtual QString generateArgumentsString(int address, Instruction *instruction, AddressingMode::AddressingModeCode addressingModeCode, int &argumentsSize);
+    virtual QString formatArguments(const DecodedInstruction &decoded);
+    virtual DecodedInstruction decodeInstructionAt(int address);
 
     int memoryReadTwoByteAddress(int address);
     int getMemoryTwoByteAddress(int address);
@@ -45,9 +45,7 @@ RegMachine::RegMachine()
     addressingModes.append(new AddressingMode("........", AddressingMode::DIRECT, AddressingMode::NO_PATTERN)); // Used for "if r a0 a1"
 }
 
-QString RegMachine::generateArgumentsString(int address, Instruction *instruction, AddressingMode::AddressingModeCode, int &argumentsSize)
+QString RegMachine::formatArguments(const DecodedInstruction &)
 {
-    argumentsSize = instruction->getNumBytes() - 1;
-
     return QString();
 }
@@ -7,7 +7,7 @@ class RegMachine : public Machine
 {
 public:
     RegMachine();
-    virtual QString generateArgumentsString(int address, Instruction *instruction, AddressingMode::AddressingModeCode addressingModeCode, int &argumentsSize);
+    virtual QString formatArguments(const DecodedInstruction &decoded);
 };
 
 #endif // REGMACHINE_H
@@ -321,6 +321,58 @@ void VoltaMachine::skipNextInstruction()
         incrementPCValue();
 }
 
+// Stack pushes and pops count as memory accesses
+int VoltaMachine::getStaticAccessCount(const DecodedInstruction &decoded, bool branchTaken)
+{
+    int fetchCount = 1;
+
+    if (decoded.instruction == nullptr)
+        return fetchCount;
+
+    int operandAddressCount = getOperandAddressAccessCount(decoded.addressingModeCode);
+
+    switch (decoded.instruction->getInstructionCode())
+    {
+    case Instruction::VOLTA_ADD: case Instruction::VOLTA_SUB:
+    case Instruction::VOLTA_AND: case Instruction::VOLTA_OR:
+        return fetchCount + 3; // Two pops, one push
+
+    case Instruction::VOLTA_CLR:
+        return fetchCount + 1;
+
+    case Instruction::VOLTA_NOT: case Instruction::VOLTA_NEG: case Instruction::VOLTA_INC:
+    case Instruction::VOLTA_DEC: case Instruction::VOLTA_ASR: case Instruction::VOLTA_ASL:
+    case Instruction::VOLTA_ROR: case Instruction::VOLTA_ROL:
+        return fetchCount + 2; // Pop, push
+
+    case Instruction::VOLTA_SZ:  case Instruction::VOLTA_SNZ: case Instruction::VOLTA_SPL:
+    case Instruction::VOLTA_SMI: case Instruction::VOLTA_SPZ: case Instruction::VOLTA_SMZ:
+        return fetchCount + 1 + (branchTaken ? 1 : 0); // Skipping reads the next instruction
+
+    case Instruction::VOLTA_SEQ: case Instruction::VOLTA_SNE: case Instruction::VOLTA_SGR:
+    case Instruction::VOLTA_SLS: case Instruction::VOLTA_SGE: case Instruction::VOLTA_SLE:
+        return fetchCount + 2 + (branchTaken ? 1 : 0);
+
+    case Instruction::VOLTA_RTS:
+        return fetchCount + 1;
+
+    case Instruction::VOLTA_PSH:
+        return fetchCount + operandAddressCount + 2; // Operand read, push
+
+    case Instruction::VOLTA_POP:
+        return fetchCount + operandAddressCount + 2; // Pop, operand write
+
+    case Instruction::VOLTA_JMP:
+        return fetchCount + operandAddressCount;
+
+    case Instruction::VOLTA_JSR:
+        return fetchCount + operandAddressCount + 1; // Return address push
+
+    default:
+        return fetchCount;
+    }
+}
+
 void VoltaMachine::generateDescriptions()
 {
     descriptions["nop"] = "Nenhuma operação.";
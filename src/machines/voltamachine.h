@@ -10,6 +10,7 @@ public:
     
     void executeInstruction();
     void skipNextInstruction();
+    virtual int getStaticAccessCount(const DecodedInstruction &decoded, bool branchTaken);
 
     virtual void generateDescriptions();
 
@@ -0,0 +1,860 @@
+#include <QtTest>
+#include <algorithm>
+
+#include "controlflowgraph.h"
+#include "disassembler.h"
+#include "expressionevaluator.h"
+#include "ahmesmachine.h"
+#include "machinefactory.h"
+#include "neandermachine.h"
+#include "periclesmachine.h"
+#include "ramsesmachine.h"
+#include "voltamachine.h"
+#include "counterloop.h"
+
+class AssemblerTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    // Expression evaluator
+    void test_precedence();
+    void test_operators();
+    void test_labelsAndLocation();
+    void test_invalidExpressions();
+
+    // Assembly with expressions
+    void test_directiveExpressions();
+    void test_periclesHiLo();
+    void test_forwardLabelExpression();
+    void test_spacedExpressions();
+    void test_expressionErrors();
+    void test_directiveLiterals();
+    void test_rebuildClearsPreviousBuild();
+    void test_buildChangedRanges();
+    void test_buildChangedLabels();
+
+    // Peephole optimizer
+    void test_peepholeRedundantLoad();
+    void test_peepholeJumpToNext();
+    void test_peepholeNegation();
+    void test_peepholeCarryStillRead();
+    void test_peepholeNumericAddresses();
+    void test_peepholeAddressValues();
+    void test_peepholeManyRewrites();
+
+    // Static cost estimation
+    void test_staticCostBlocks();
+    void test_staticCostMatchesSimulation();
+    void test_listing();
+
+    // Streaming assembly
+    void test_assembleUtf8MatchesAssemble();
+    void test_assembleFile();
+
+    // Disassembly
+    void test_incrementalInstructionStrings();
+    void test_disassemblyRecords();
+    void test_disassembleMemoryFile();
+    void test_memoryFileImportExport();
+    void test_memoryImage();
+};
+
+void AssemblerTest::test_precedence()
+{
+    QHash<QString, int> labels;
+    ExpressionEvaluator evaluator(labels, 0);
+
+    QCOMPARE(evaluator.evaluate("2+3*4"), 14);
+    QCOMPARE(evaluator.evaluate("(2+3)*4"), 20);
+    QCOMPARE(evaluator.evaluate("10-4-3"), 3);
+    QCOMPARE(evaluator.evaluate("1<<4|1"), 17);
+    QCOMPARE(evaluator.evaluate("6&3^1"), 3);
+    QCOMPARE(evaluator.evaluate("-2*3"), -6);
+}
+
+void AssemblerTest::test_operators()
+{
+    QHash<QString, int> labels;
+    ExpressionEvaluator evaluator(labels, 0);
+
+    QCOMPARE(evaluator.evaluate("7/2"), 3);
+    QCOMPARE(evaluator.evaluate("7%2"), 1);
+    QCOMPARE(evaluator.evaluate("h80>>3"), 16);
+    QCOMPARE(evaluator.evaluate("hi(h1234)"), 0x12);
+    QCOMPARE(evaluator.evaluate("LO(h1234)"), 0x34);
+    QCOMPARE(evaluator.evaluate("'A'+1"), 66);
+    QCOMPARE(evaluator.evaluate("~0&hFF"), 255);
+}
+
+void AssemblerTest::test_labelsAndLocation()
+{
+    QHash<QString, int> labels;
+    labels.insert("tabela", 100);
+    labels.insert("hff", 7); // Labels take precedence over hexadecimal values
+
+    ExpressionEvaluator evaluator(labels, 20);
+
+    QCOMPARE(evaluator.evaluate("TABELA+2*3"), 106);
+    QCOMPARE(evaluator.evaluate("hff"), 7);
+    QCOMPARE(evaluator.evaluate("$+2"), 22);
+    QCOMPARE(evaluator.evaluate("tabela-$"), 80);
+}
+
+void AssemblerTest::test_invalidExpressions()
+{
+    QHash<QString, int> labels;
+    ExpressionEvaluator evaluator(labels, 0);
+
+    QVERIFY_EXCEPTION_THROWN(evaluator.evaluate("1/0"), Machine::ErrorCode);
+    QVERIFY_EXCEPTION_THROWN(evaluator.evaluate("(1+2"), Machine::ErrorCode);
+    QVERIFY_EXCEPTION_THROWN(evaluator.evaluate("1+"), Machine::ErrorCode);
+    QVERIFY_EXCEPTION_THROWN(evaluator.evaluate("inexistente"), Machine::ErrorCode);
+    QVERIFY_EXCEPTION_THROWN(evaluator.evaluate(""), Machine::ErrorCode);
+}
+
+void AssemblerTest::test_directiveExpressions()
+{
+    NeanderMachine machine;
+
+    machine.assemble("LDA tabela+2\n"
+                     "HLT\n"
+                     "ORG 16\n"
+                     "tabela: DAB 1, 2*8, (1+2)*3, -1, $\n"
+                     "fim: DB fim-tabela\n");
+
+    QVERIFY(machine.getBuildSuccessful());
+    QCOMPARE(machine.getMemoryValue(1), 18);
+    QCOMPARE(machine.getMemoryValue(16), 1);
+    QCOMPARE(machine.getMemoryValue(17), 16);
+    QCOMPARE(machine.getMemoryValue(18), 9);
+    QCOMPARE(machine.getMemoryValue(19), 255);
+    QCOMPARE(machine.getMemoryValue(20), 16); // $ is the address of the statement
+    QCOMPARE(machine.getMemoryValue(21), 5);
+}
+
+void AssemblerTest::test_periclesHiLo()
+{
+    PericlesMachine machine;
+
+    machine.assemble("LDR A #hi(tabela)\n"
+                     "LDR B #lo(tabela)\n"
+                     "LDR X tabela+h100\n"
+                     "ORG h234\n"
+                     "tabela: DB 0\n");
+
+    QVERIFY(machine.getBuildSuccessful());
+    QCOMPARE(machine.getMemoryValue(1), 0x02);
+    QCOMPARE(machine.getMemoryValue(3), 0x34);
+    QCOMPARE(machine.getMemoryValue(5), 0x34); // Little-endian address
+    QCOMPARE(machine.getMemoryValue(6), 0x03);
+}
+
+void AssemblerTest::test_forwardLabelExpression()
+{
+    NeanderMachine machine;
+
+    machine.assemble("JMP fim-1\n"
+                     "NOP\n"
+                     "NOP\n"
+                     "fim: HLT\n");
+
+    QVERIFY(machine.getBuildSuccessful());
+    QCOMPARE(machine.getMemoryValue(1), 3);
+}
+
+void AssemblerTest::test_spacedExpressions()
+{
+    NeanderMachine neander;
+
+    neander.assemble("LDA tabela + 2\n"
+                     "base: HLT\n"
+                     "ORG base + 14\n"
+                     "tabela: DAB 1, 2 * 8, ( 1 + 2 ) * 3, - 1, 'a b'\n"
+                     "fim: DB fim - tabela\n");
+
+    QVERIFY(neander.getBuildSuccessful());
+    QCOMPARE(neander.getMemoryValue(1), 18);
+    QCOMPARE(neander.getMemoryValue(16), 1);
+    QCOMPARE(neander.getMemoryValue(17), 16);
+    QCOMPARE(neander.getMemoryValue(18), 9);
+    QCOMPARE(neander.getMemoryValue(19), 255);
+    QCOMPARE(neander.getMemoryValue(20), 'a'); // Strings keep their spaces
+    QCOMPARE(neander.getMemoryValue(21), ' ');
+    QCOMPARE(neander.getMemoryValue(22), 'b');
+    QCOMPARE(neander.getMemoryValue(23), 7);
+
+    // Same memory as without spaces, including a variable size instruction and addressing modes
+    RamsesMachine spacedRamses, ramses;
+    spacedRamses.assemble("LDR A tabela + 1,X\nLDR B #2 * 3\nSTR B (tabela << 1) >> 1,I\nHLT\ntabela: DAB 1, 2\n");
+    ramses.assemble("LDR A tabela+1,X\nLDR B #2*3\nSTR B (tabela<<1)>>1,I\nHLT\ntabela: DAB 1, 2\n");
+
+    PericlesMachine spacedPericles, pericles;
+    spacedPericles.assemble("LDR A #hi( tabela )\nLDR X tabela + h100\nLDR B #lo(tabela) + 1\nORG h234\ntabela: DB 0\n");
+    pericles.assemble("LDR A #hi(tabela)\nLDR X tabela+h100\nLDR B #lo(tabela)+1\nORG h234\ntabela: DB 0\n");
+
+    QVERIFY(spacedRamses.getBuildSuccessful() && ramses.getBuildSuccessful());
+    QVERIFY(spacedPericles.getBuildSuccessful() && pericles.getBuildSuccessful());
+
+    for (int address = 0; address < 32; address++)
+    {
+        QCOMPARE(spacedRamses.getMemoryValue(address), ramses.getMemoryValue(address));
+        QCOMPARE(spacedPericles.getMemoryValue(address), pericles.getMemoryValue(address));
+    }
+
+    // A sign directly before an operand starts a new argument
+    neander.assemble("LDA tabela -2\ntabela: HLT\n");
+    QVERIFY(!neander.getBuildSuccessful());
+}
+
+void AssemblerTest::test_expressionErrors()
+{
+    NeanderMachine machine;
+
+    machine.assemble("DB 1/0\n");
+    QVERIFY(!machine.getBuildSuccessful());
+
+    machine.assemble("DB 200+100\n"); // Out of range
+    QVERIFY(!machine.getBuildSuccessful());
+
+    machine.assemble("ORG fim\nfim: HLT\n"); // ORG can't use forward labels
+    QVERIFY(!machine.getBuildSuccessful());
+}
+
+void AssemblerTest::test_directiveLiterals()
+{
+    NeanderMachine machine;
+
+    machine.assemble("DAB 1, h1F,-2 'a b'3\n"
+                     "hff: DB hff\n" // Label, not a hexadecimal value
+                     "DAB [2]\n"
+                     "DB 255\n");
+
+    QVERIFY(machine.getBuildSuccessful());
+    QCOMPARE(machine.getMemoryValue(0), 1);
+    QCOMPARE(machine.getMemoryValue(1), 31);
+    QCOMPARE(machine.getMemoryValue(2), 254);
+    QCOMPARE(machine.getMemoryValue(3), 'a');
+    QCOMPARE(machine.getMemoryValue(4), ' ');
+    QCOMPARE(machine.getMemoryValue(5), 'b');
+    QCOMPARE(machine.getMemoryValue(6), 3);
+    QCOMPARE(machine.getMemoryValue(7), 7);
+    QCOMPARE(machine.getMemoryValue(10), 255);
+
+    machine.assemble("DB 1\nDB 256\n");
+    QVERIFY(!machine.getBuildSuccessful());
+    QCOMPARE(machine.getFirstErrorLine(), 1);
+
+    machine.assemble("DB 1 2\n");
+    QVERIFY(!machine.getBuildSuccessful());
+
+    machine.assemble("DAB 1, 'a\n");
+    QVERIFY(!machine.getBuildSuccessful());
+}
+
+void AssemblerTest::test_rebuildClearsPreviousBuild()
+{
+    NeanderMachine machine;
+
+    machine.assemble("ORG 100\n"
+                     "dado: DB 5\n");
+    QVERIFY(machine.getBuildSuccessful());
+    QCOMPARE(machine.getAddressCorrespondingSourceLine(100), 1);
+
+    machine.assemble("DB 1\n"
+                     "ORG 99\n"
+                     "DAB [2]\n"); // Reserves 100 again, without writing it
+    QVERIFY(machine.getBuildSuccessful());
+    QCOMPARE(machine.getMemoryValue(100), 0);
+    QCOMPARE(machine.getAddressCorrespondingSourceLine(100), 2);
+    QCOMPARE(machine.getAddressCorrespondingSourceLine(101), -1);
+    QCOMPARE(machine.getAddressCorrespondingLabel(100), QString(""));
+
+    machine.assemble("DB 1\n"
+                     "ORG 0\n"
+                     "DB 2\n");
+    QVERIFY(!machine.getBuildSuccessful()); // Overlap
+
+    machine.assemble("DB 1\n");
+    QVERIFY(machine.getBuildSuccessful());
+    QCOMPARE(machine.getAddressCorrespondingSourceLine(0), 0);
+    QCOMPARE(machine.getAddressCorrespondingSourceLine(100), -1);
+}
+
+void AssemblerTest::test_buildChangedRanges()
+{
+    NeanderMachine machine;
+
+    machine.assemble("DAB 1, 2, 3\n"
+                     "ORG 200\n"
+                     "DB 4\n");
+    QVector<MemoryRange> ranges = machine.takeChangedRanges();
+
+    QCOMPARE(ranges.size(), 2);
+    QCOMPARE(ranges[0].start, 0);
+    QCOMPARE(ranges[0].end, 3);
+    QCOMPARE(ranges[1].start, 200);
+    QCOMPARE(ranges[1].end, 201);
+    QVERIFY(machine.takeChangedRanges().isEmpty());
+
+    machine.assemble("DAB 1, 5, 3\n"); // Address 200 is cleared
+    machine.assemble("DAB 1, 5, 6\n"); // Not taken in between, ranges are merged
+    ranges = machine.takeChangedRanges();
+
+    QCOMPARE(ranges.size(), 2);
+    QCOMPARE(ranges[0].start, 1);
+    QCOMPARE(ranges[0].end, 3);
+    QCOMPARE(ranges[1].start, 200);
+    QCOMPARE(machine.getMemoryValue(200), 0);
+
+    machine.assemble("DAB 1, 5, 6\n");
+    QVERIFY(machine.takeChangedRanges().isEmpty());
+}
+
+void AssemblerTest::test_buildChangedLabels()
+{
+    NeanderMachine machine;
+
+    machine.assemble("inicio: NOP\n"
+                     "fim: HLT\n");
+    QVector<int> addresses = machine.takeChangedLabels();
+    std::sort(addresses.begin(), addresses.end());
+
+    QCOMPARE(addresses, QVector<int>({0, 1}));
+    QVERIFY(machine.takeChangedLabels().isEmpty());
+
+    machine.assemble("inicio: NOP\n"
+                     "NOP\n"
+                     "fim: HLT\n"); // Only fim moved
+    addresses = machine.takeChangedLabels();
+    std::sort(addresses.begin(), addresses.end());
+
+    QCOMPARE(addresses, QVector<int>({1, 2}));
+
+    machine.assemble("inicio: XYZ\n"); // Failed builds show no labels
+    addresses = machine.takeChangedLabels();
+    std::sort(addresses.begin(), addresses.end());
+
+    QCOMPARE(addresses, QVector<int>({0, 2}));
+}
+
+void AssemblerTest::test_peepholeRedundantLoad()
+{
+    NeanderMachine machine;
+    QString sourceCode = "LDA x\n"
+                         "ADD y\n"
+                         "STA z\n"
+                         "LDA z\n"
+                         "HLT\n"
+                         "ORG 128\n"
+                         "x: DB 1\n"
+                         "y: DB 2\n"
+                         "z: DB 0\n";
+
+    machine.assemble(sourceCode);
+    QCOMPARE(machine.getSourceLineCorrespondingAddress(4), 8);
+    QVERIFY(machine.getOptimizationReport().isEmpty()); // Disabled by default
+
+    machine.setPeepholeOptimizationEnabled(true);
+    machine.assemble(sourceCode);
+
+    QVERIFY(machine.getBuildSuccessful());
+    QCOMPARE(machine.getMemoryValue(6), 0xF0); // HLT moved up
+    QCOMPARE(machine.getSourceLineCorrespondingAddress(4), 6);
+    QCOMPARE(machine.getAddressCorrespondingSourceLine(6), 4);
+    QCOMPARE(machine.getOptimizationReport().size(), 1);
+    QCOMPARE(machine.getOptimizationBytesSaved(), 2);
+    QCOMPARE(machine.getOptimizationInstructionsRemoved(), 1);
+}
+
+void AssemblerTest::test_peepholeJumpToNext()
+{
+    RamsesMachine machine;
+    machine.setPeepholeOptimizationEnabled(true);
+
+    machine.assemble("JMP proximo\n"
+                     "proximo: LDR A #5\n"
+                     "HLT\n");
+
+    QVERIFY(machine.getBuildSuccessful());
+    QCOMPARE(machine.getMemoryValue(0), 0x22); // LDR A #
+    QCOMPARE(machine.getMemoryValue(1), 5);
+    QCOMPARE(machine.getMemoryValue(2), 0xF0);
+    QCOMPARE(machine.getAddressCorrespondingLabel(0), QString("proximo"));
+    QCOMPARE(machine.getOptimizationBytesSaved(), 2);
+}
+
+void AssemblerTest::test_peepholeNegation()
+{
+    RamsesMachine machine;
+    machine.setPeepholeOptimizationEnabled(true);
+
+    machine.assemble("LDR A valor\n"
+                     "NOT A\n"
+                     "ADD A #1\n"
+                     "STR A resultado\n"
+                     "HLT\n"
+                     "valor: DB 5\n"
+                     "resultado: DB 0\n");
+
+    QVERIFY(machine.getBuildSuccessful());
+    QCOMPARE(machine.getMemoryValue(1), 6); // Labels follow the moved code
+    QCOMPARE(machine.getMemoryValue(2), 0xD0); // NEG A
+    QCOMPARE(machine.getMemoryValue(4), 7);
+    QCOMPARE(machine.getSourceLineCorrespondingAddress(2), 3); // Removed line maps to the next statement
+    QCOMPARE(machine.getOptimizationBytesSaved(), 2);
+}
+
+void AssemblerTest::test_peepholeCarryStillRead()
+{
+    RamsesMachine machine;
+    machine.setPeepholeOptimizationEnabled(true);
+
+    machine.assemble("NOT A\n"
+                     "ADD A #1\n"
+                     "JC zero\n"
+                     "HLT\n"
+                     "zero: HLT\n");
+
+    QVERIFY(machine.getBuildSuccessful());
+    QCOMPARE(machine.getMemoryValue(0), 0x60); // NOT A kept
+    QVERIFY(machine.getOptimizationReport().isEmpty());
+}
+
+void AssemblerTest::test_peepholeNumericAddresses()
+{
+    NeanderMachine machine;
+    machine.setPeepholeOptimizationEnabled(true);
+
+    machine.assemble("STA 128\n"
+                     "LDA 128\n"
+                     "JMP 7\n" // Numeric address into code that would move
+                     "NOP\n"
+                     "NOP\n"
+                     "HLT\n");
+
+    QVERIFY(machine.getBuildSuccessful());
+    QCOMPARE(machine.getMemoryValue(2), 0x20); // LDA kept
+    QVERIFY(machine.getOptimizationReport().isEmpty());
+}
+
+void AssemblerTest::test_peepholeAddressValues()
+{
+    RamsesMachine machine;
+    machine.setPeepholeOptimizationEnabled(true);
+
+    // Label that would move, used as an immediate value
+    machine.assemble("NOT A\n"
+                     "ADD A #1\n"
+                     "LDR B #valor\n"
+                     "HLT\n"
+                     "valor: DB 5\n");
+
+    QVERIFY(machine.getBuildSuccessful());
+    QCOMPARE(machine.getMemoryValue(0), 0x60); // NOT A kept
+    QVERIFY(machine.getOptimizationReport().isEmpty());
+
+    // Label that would move, stored as data
+    machine.assemble("NOT A\n"
+                     "ADD A #1\n"
+                     "HLT\n"
+                     "ponteiro: DB valor\n"
+                     "valor: DB 5\n");
+
+    QVERIFY(machine.getBuildSuccessful());
+    QCOMPARE(machine.getMemoryValue(0), 0x60);
+    QVERIFY(machine.getOptimizationReport().isEmpty());
+
+    // Label before the rewrite doesn't move
+    machine.assemble("inicio: NOT A\n"
+                     "ADD A #1\n"
+                     "LDR B #inicio\n"
+                     "HLT\n");
+
+    QVERIFY(machine.getBuildSuccessful());
+    QCOMPARE(machine.getMemoryValue(0), 0xD0); // NEG A
+    QCOMPARE(machine.getMemoryValue(2), 0); // LDR B #inicio
+    QCOMPARE(machine.getOptimizationReport().size(), 1);
+}
+
+void AssemblerTest::test_peepholeManyRewrites()
+{
+    NeanderMachine machine;
+    machine.setPeepholeOptimizationEnabled(true);
+
+    // Loads before the label can't be removed, as its address is stored as data
+    QString sourceCode;
+    for (int i = 0; i < 10; i++)
+        sourceCode += "STA x\nLDA x\n";
+    sourceCode += "marcador: NOP\n";
+    for (int i = 0; i < 10; i++)
+        sourceCode += "STA x\nLDA x\n";
+    sourceCode += "HLT\n"
+                  "ponteiro: DB marcador\n"
+                  "ORG 128\n"
+                  "x: DB 0\n";
+
+    machine.assemble(sourceCode);
+
+    QVERIFY(machine.getBuildSuccessful());
+    QCOMPARE(machine.getOptimizationReport().size(), 10);
+    QCOMPARE(machine.getOptimizationBytesSaved(), 20);
+    QCOMPARE(machine.getAddressCorrespondingLabel(40), QString("marcador"));
+    QCOMPARE(machine.getMemoryValue(61), 0xF0); // HLT
+    QCOMPARE(machine.getMemoryValue(62), 40);
+
+    // Trial builds don't reach memory, so an identical build changes nothing
+    machine.takeChangedRanges();
+    machine.assemble(sourceCode);
+    QVERIFY(machine.takeChangedRanges().isEmpty());
+}
+
+void AssemblerTest::test_staticCostBlocks()
+{
+    NeanderMachine machine;
+    machine.assemble(COUNTER_LOOP);
+    QVERIFY(machine.getBuildSuccessful());
+
+    ControlFlowGraph graph(machine);
+    const QVector<ControlFlowGraph::BasicBlock> &blocks = graph.getBlocks();
+
+    QCOMPARE(blocks.size(), 3);
+    QCOMPARE(blocks[0].instructionCount, 4);
+    QCOMPARE(blocks[0].accessCount, 10);
+    QCOMPARE(blocks[0].takenAccessCount, 11); // JN reads its address when jumping
+    QCOMPARE(graph.getBlockAt(8), 1);
+    QCOMPARE(graph.getBlockAt(10), 2);
+    QVERIFY(blocks[2].successors.isEmpty()); // HLT
+
+    QCOMPARE(graph.getLoops().size(), 1);
+    QCOMPARE(graph.getLoops().first().header, 0);
+    QCOMPARE(graph.getLoops().first().minInstructions, 5);
+    QCOMPARE(graph.getLoops().first().maxAccesses, 12);
+}
+
+void AssemblerTest::test_staticCostMatchesSimulation()
+{
+    NeanderMachine machine;
+    machine.assemble(COUNTER_LOOP);
+
+    ControlFlowGraph graph(machine);
+    const ControlFlowGraph::Loop &loop = graph.getLoops().first();
+
+    for (int i = 0; i < loop.minInstructions; i++)
+        machine.step();
+
+    QCOMPARE(machine.getPCValue(), 0); // One iteration
+    QCOMPARE(machine.getAccessCount(), (qint64)loop.minAccesses);
+}
+
+void AssemblerTest::test_listing()
+{
+    NeanderMachine machine;
+    machine.assemble(COUNTER_LOOP);
+
+    QString listing = machine.generateListing(COUNTER_LOOP);
+
+    QVERIFY(listing.contains("; Bloco 0: 4 instruções, 10 acessos (11 se desviar), segue para 1, 2"));
+    QVERIFY(listing.contains("; Laço (2 blocos): 5 instruções e 12 acessos por iteração"));
+    QVERIFY(listing.contains("inicio: LDA contador"));
+
+    machine.assemble("LDA x\nxx"); // Failed build
+    QVERIFY(machine.generateListing("LDA x\nxx").isEmpty());
+}
+
+static QByteArray generateTableProgram()
+{
+    QByteArray source = "; Gerado\r\n"
+                        "inicio: LDR A tabela,X ; Percorre a tabela\r\n"
+                        "HLT\r\n"
+                        "tabela:\r\n";
+
+    for (int row = 0; row < 200; row++)
+    {
+        source += "DAB";
+        for (int column = 0; column < 16; column++)
+            source += " " + QByteArray::number((row * 16 + column) % 256) + ",";
+        source += " 'a' ; Último\r\n";
+    }
+
+    source += "fim: DW inicio ; Sem quebra de linha no final";
+    return source;
+}
+
+void AssemblerTest::test_assembleUtf8MatchesAssemble()
+{
+    QByteArray source = generateTableProgram();
+
+    PericlesMachine expected;
+    expected.assemble(QString::fromUtf8(source));
+    QVERIFY(expected.getBuildSuccessful());
+
+    PericlesMachine machine;
+    machine.assembleUtf8(source.constData(), source.size());
+    QVERIFY(machine.getBuildSuccessful());
+
+    for (int address = 0; address < machine.getMemorySize(); address++)
+    {
+        QCOMPARE(machine.getMemoryValue(address), expected.getMemoryValue(address));
+        QCOMPARE(machine.getAddressCorrespondingSourceLine(address), expected.getAddressCorrespondingSourceLine(address));
+    }
+
+    QCOMPARE(machine.getAddressCorrespondingLabel(4), QString("tabela"));
+    QCOMPARE(machine.getSourceLineCorrespondingAddress(204), expected.getSourceLineCorrespondingAddress(204));
+}
+
+void AssemblerTest::test_assembleFile()
+{
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    file.write("LDA x\n\nxx\n"); // Error on the third line
+    file.close();
+
+    NeanderMachine machine;
+    QSignalSpy errors(&machine, SIGNAL(buildErrorDetected(QString)));
+
+    QCOMPARE(machine.assembleFile(file.fileName()), FileErrorCode::noError);
+    QVERIFY(!machine.getBuildSuccessful());
+    QCOMPARE(machine.getFirstErrorLine(), 2);
+    QVERIFY(errors.count() >= 1);
+
+    QCOMPARE(machine.assembleFile(file.fileName() + ".inexistente"), FileErrorCode::inputOutput);
+
+    QVERIFY(file.open());
+    file.resize(0);
+    file.close();
+
+    QCOMPARE(machine.assembleFile(file.fileName()), FileErrorCode::noError);
+    QVERIFY(machine.getBuildSuccessful());
+}
+
+static void compareWithFullDisassembly(PericlesMachine &machine)
+{
+    PericlesMachine reference;
+
+    for (int address = 0; address < machine.getMemorySize(); address++)
+        reference.setMemoryValue(address, machine.getMemoryValue(address));
+
+    reference.setPCValue(machine.getPCValue());
+    reference.updateInstructionStrings();
+    machine.updateInstructionStrings();
+
+    for (int address = 0; address < machine.getMemorySize(); address++)
+        QCOMPARE(machine.getInstructionString(address), reference.getInstructionString(address));
+}
+
+void AssemblerTest::test_incrementalInstructionStrings()
+{
+    PericlesMachine machine;
+
+    machine.assemble("LDR A 100\n"
+                     "LDR B #5\n"
+                     "ADD A 101\n"
+                     "STR A 102\n"
+                     "JMP 0\n"
+                     "HLT\n");
+    QVERIFY(machine.getBuildSuccessful());
+
+    compareWithFullDisassembly(machine);
+    QCOMPARE(machine.getInstructionString(0), QString("LDR A 100"));
+
+    machine.setMemoryValue(3, machine.getMemoryValue(0)); // Immediate LDR becomes a 3-byte LDR
+    compareWithFullDisassembly(machine);
+
+    machine.setPCValue(1); // Realign in the middle of an instruction
+    compareWithFullDisassembly(machine);
+
+    machine.setMemoryValue(2, 7); // Argument shown by the instruction at PC
+    compareWithFullDisassembly(machine);
+
+    machine.setPCValue(5);
+    machine.setMemoryValue(4094, machine.getMemoryValue(0)); // Arguments past the end of memory
+    compareWithFullDisassembly(machine);
+}
+
+void AssemblerTest::test_disassemblyRecords()
+{
+    PericlesMachine machine;
+
+    machine.assemble("LDR A 300\n"
+                     "LDR B #5\n"
+                     "HLT\n");
+    machine.updateInstructionStrings();
+    machine.takeChangedInstructionStrings();
+
+    const DecodedInstruction &load = machine.getDisassembledInstruction(0);
+    QCOMPARE(load.instruction->getInstructionCode(), Instruction::LDR);
+    QCOMPARE(load.registerId, 0);
+    QCOMPARE(load.addressingModeCode, AddressingMode::DIRECT);
+    QCOMPARE(load.argument, 300);
+    QCOMPARE(load.size, 3);
+    QCOMPARE(machine.getDisassembledInstruction(1).size, 0); // Argument byte
+    QCOMPARE(machine.getInstructionString(3), QString("LDR B #"));
+
+    // Changing an argument only changes the instruction that shows it
+    machine.setMemoryValue(1, 10);
+    machine.updateInstructionStrings();
+
+    QVector<MemoryRange> changed = machine.takeChangedInstructionStrings();
+    QCOMPARE(changed.size(), 1);
+    QCOMPARE(changed[0].start, 0);
+    QCOMPARE(changed[0].end, 1);
+    QCOMPARE(machine.getInstructionString(0), QString("LDR A 266"));
+}
+
+void AssemblerTest::test_disassembleMemoryFile()
+{
+    NeanderMachine source;
+    source.assemble(COUNTER_LOOP);
+    QVERIFY(source.getBuildSuccessful());
+
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    file.close();
+    QCOMPARE(source.exportMemory(file.fileName()), FileErrorCode::noError);
+
+    QCOMPARE(Machine::readMemoryFileIdentifier(file.fileName()), QString("NDR"));
+
+    NeanderMachine machine;
+    QCOMPARE(machine.importMemory(file.fileName(), 0, machine.getMemorySize(), 0), FileErrorCode::noError);
+
+    // Code reached from address 0, variables shown as data
+    Disassembler disassembler(machine);
+    QVERIFY(disassembler.isCode(0) && disassembler.isCode(1) && disassembler.isCode(10));
+    QVERIFY(disassembler.isInstructionStart(8) && !disassembler.isInstructionStart(9));
+    QVERIFY(!disassembler.isCode(11) && !disassembler.isCode(129));
+    QCOMPARE(disassembler.formatInstructionAt(6), QString("JN 10"));
+
+    QString listing = disassembler.generateListing();
+    QVERIFY(listing.contains("; Bloco 0: 4 instruções, segue para 1, 2 (início de laço com 2 blocos)"));
+    QVERIFY(listing.contains("    0  20 80         LDA 128"));
+    QVERIFY(listing.contains("   10  F0            HLT"));
+    QVERIFY(listing.contains("   11  00 00 00 00 ...  DAB [118]"));
+    QVERIFY(listing.contains("  129  01            DB 1"));
+
+    QString dot = disassembler.generateDot();
+    QVERIFY(dot.contains("b0 [label=\"0: LDA 128\\l2: ADD 129\\l4: STA 128\\l6: JN 10\\l\", style=bold, peripheries=2];"));
+    QVERIFY(dot.contains("b0 -> b1;"));
+    QVERIFY(dot.contains("b0 -> b2 [style=dashed];"));
+    QVERIFY(dot.contains("b1 -> b0 [style=dashed];"));
+
+    // Register and addressing mode syntax
+    RamsesMachine ramses;
+    ramses.assemble("LDR A #5\nJMP 0,I\n");
+    QVERIFY(ramses.getBuildSuccessful());
+
+    Disassembler ramsesDisassembler(ramses);
+    QCOMPARE(ramsesDisassembler.formatInstructionAt(0), QString("LDR A #5"));
+    QCOMPARE(ramsesDisassembler.formatInstructionAt(2), QString("JMP 0,I"));
+    QVERIFY(ramsesDisassembler.generateDot().contains("b0 -> desconhecido [style=dotted];"));
+}
+
+void AssemblerTest::test_memoryFileImportExport()
+{
+    NeanderMachine source;
+    source.assemble(COUNTER_LOOP);
+    QVERIFY(source.getBuildSuccessful());
+    source.setMemoryValue(255, 0xAB);
+
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    file.close();
+    QCOMPARE(source.exportMemory(file.fileName()), FileErrorCode::noError);
+
+    // Header and interleaved image
+    QVERIFY(file.open());
+    QByteArray contents = file.readAll();
+    file.close();
+    QCOMPARE(contents.size(), 1 + 3 + 256 * 2);
+    QCOMPARE(contents.left(4), QByteArray("\x03NDR"));
+    QCOMPARE((uchar) contents[4], (uchar) 0x20); // LDA
+    QCOMPARE((uchar) contents[5], (uchar) 0);
+    QCOMPARE((uchar) contents[4 + 2 * 255], (uchar) 0xAB);
+
+    NeanderMachine machine;
+    QCOMPARE(machine.importMemory(file.fileName(), 0, machine.getMemorySize(), 0), FileErrorCode::noError);
+    for (int address = 0; address < machine.getMemorySize(); address++)
+        QCOMPARE(machine.getMemoryValue(address), source.getMemoryValue(address));
+
+    // Partial import: [start, end) copied to dest, truncated at the end of memory
+    NeanderMachine partial;
+    QCOMPARE(partial.importMemory(file.fileName(), 128, 130, 200), FileErrorCode::noError);
+    QCOMPARE(partial.getMemoryValue(199), 0);
+    QCOMPARE(partial.getMemoryValue(200), 0);
+    QCOMPARE(partial.getMemoryValue(201), 1);
+    QCOMPARE(partial.getMemoryValue(202), 0);
+
+    QCOMPARE(partial.importMemory(file.fileName(), 0, 4, 254), FileErrorCode::noError);
+    QCOMPARE(partial.getMemoryValue(254), 0x20);
+    QCOMPARE(partial.getMemoryValue(255), 128);
+    QCOMPARE(partial.getMemoryValue(0), 0);
+
+    // Errors
+    QCOMPARE(partial.importMemory(file.fileName(), 0, 257, 0), FileErrorCode::invalidAddress);
+    QCOMPARE(partial.importMemory(file.fileName() + ".inexistente", 0, 256, 0), FileErrorCode::incorrectSize);
+
+    AhmesMachine ahmes; // Same memory size, different identifier
+    QCOMPARE(ahmes.importMemory(file.fileName(), 0, 256, 0), FileErrorCode::invalidIdentifier);
+}
+
+void AssemblerTest::test_memoryImage()
+{
+    PericlesMachine source;
+    source.assemble("LDR A #5\nSTR A 4000\nHLT\nORG 2000\nDAB 1, 2, 3\n");
+    QVERIFY(source.getBuildSuccessful());
+    source.setRegisterValue("A", 42);
+    source.setPCValue(3);
+    source.setFlagValue(Flag::CARRY, 1);
+
+    // Mostly empty memory compresses well; raw payload keeps one byte per address
+    QByteArray compressed = source.saveMemoryImage(true, true);
+    QByteArray raw = source.saveMemoryImage(false, false);
+    QVERIFY(compressed.size() < 200);
+    QVERIFY(raw.size() > source.getMemorySize() && raw.size() < source.getMemorySize() + 64);
+
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    file.close();
+    QCOMPARE(source.exportMemoryImage(file.fileName()), FileErrorCode::noError);
+    QCOMPARE(Machine::readMemoryFileIdentifier(file.fileName()), QString("PRC"));
+
+    // Auto-detected by importMemory, state included
+    PericlesMachine machine;
+    QCOMPARE(machine.importMemory(file.fileName(), 0, machine.getMemorySize(), 0), FileErrorCode::noError);
+    for (int address = 0; address < machine.getMemorySize(); address++)
+        QCOMPARE(machine.getMemoryValue(address), source.getMemoryValue(address));
+    QCOMPARE(machine.getRegisterValue("A"), 42);
+    QCOMPARE(machine.getPCValue(), 3);
+    QCOMPARE(machine.getFlagValue("C"), 1);
+
+    // Partial loads only copy memory
+    PericlesMachine partial;
+    QCOMPARE(partial.loadMemoryImage((const uchar *)raw.constData(), raw.size(), 2000, 2003, 10), FileErrorCode::noError);
+    QCOMPARE(partial.getMemoryValue(10), 1);
+    QCOMPARE(partial.getMemoryValue(12), 3);
+    QCOMPARE(partial.getMemoryValue(13), 0);
+    QCOMPARE(partial.getRegisterValue("A"), 0);
+
+    // Damaged or foreign images leave the machine untouched
+    QByteArray damaged = compressed;
+    damaged[damaged.size() / 2] = damaged[damaged.size() / 2] ^ 1;
+    QCOMPARE(partial.loadMemoryImage((const uchar *)damaged.constData(), damaged.size(), 0, 4096, 0), FileErrorCode::invalidChecksum);
+    QCOMPARE(partial.getMemoryValue(0), 0);
+
+    NeanderMachine neander;
+    QCOMPARE(neander.loadMemoryImage((const uchar *)compressed.constData(), compressed.size(), 0, 256, 0), FileErrorCode::invalidIdentifier);
+
+    // Stack
+    VoltaMachine volta;
+    volta.setStackValue(3, 77);
+    volta.setMemoryValue(255, 9);
+    QByteArray voltaImage = volta.saveMemoryImage(true, true);
+
+    VoltaMachine restored;
+    QCOMPARE(restored.loadMemoryImage((const uchar *)voltaImage.constData(), voltaImage.size(), 0, 256, 0), FileErrorCode::noError);
+    QCOMPARE(restored.getStackValue(3), 77);
+    QCOMPARE(restored.getMemoryValue(255), 9);
+}
+
+#include "tst_assemblertest.moc"
+QTEST_APPLESS_MAIN(AssemblerTest)
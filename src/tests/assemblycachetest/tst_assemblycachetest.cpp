@@ -0,0 +1,79 @@
+#include <QtTest>
+#include <QTemporaryDir>
+
+#include "assemblycache.h"
+#include "neandermachine.h"
+#include "ramsesmachine.h"
+
+class AssemblyCacheTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void test_missThenHit();
+    void test_keyDependsOnMachine();
+    void test_failedBuildNotCached();
+
+private:
+    static const QString sourceCode;
+};
+
+const QString AssemblyCacheTest::sourceCode =
+        "inicio: LDA valor ; comment\n"
+        "        ADD um\n"
+        "        STA valor\n"
+        "        HLT\n"
+        "ORG 128\n"
+        "valor:  DB 5\n"
+        "um:     DB 1\n";
+
+void AssemblyCacheTest::test_missThenHit()
+{
+    QTemporaryDir cacheDirectory;
+    AssemblyCache cache(cacheDirectory.path());
+
+    NeanderMachine assembled, cached;
+
+    QCOMPARE(cache.assemble(assembled, sourceCode), false); // Miss
+    QVERIFY(assembled.getBuildSuccessful());
+    QCOMPARE(cache.assemble(cached, sourceCode), true); // Hit
+    QVERIFY(cached.getBuildSuccessful());
+
+    for (int address = 0; address < assembled.getMemorySize(); address++)
+    {
+        QCOMPARE(cached.getMemoryValue(address), assembled.getMemoryValue(address));
+        QCOMPARE(cached.getAddressCorrespondingSourceLine(address), assembled.getAddressCorrespondingSourceLine(address));
+        QCOMPARE(cached.getAddressCorrespondingLabel(address), assembled.getAddressCorrespondingLabel(address));
+    }
+
+    for (int line = 0; line < sourceCode.count("\n"); line++)
+        QCOMPARE(cached.getSourceLineCorrespondingAddress(line), assembled.getSourceLineCorrespondingAddress(line));
+
+    QCOMPARE(cached.getPCValue(), 0);
+}
+
+void AssemblyCacheTest::test_keyDependsOnMachine()
+{
+    AssemblyCache cache(QDir::tempPath());
+    NeanderMachine neander;
+    RamsesMachine ramses;
+
+    QVERIFY(cache.getKey(neander, sourceCode) != cache.getKey(ramses, sourceCode));
+    QVERIFY(cache.getKey(neander, sourceCode) != cache.getKey(neander, sourceCode + " "));
+    QCOMPARE(cache.getKey(neander, sourceCode), cache.getKey(neander, sourceCode));
+}
+
+void AssemblyCacheTest::test_failedBuildNotCached()
+{
+    QTemporaryDir cacheDirectory;
+    AssemblyCache cache(cacheDirectory.path());
+    NeanderMachine machine;
+
+    QCOMPARE(cache.assemble(machine, "LDA label_inexistente\n"), false);
+    QVERIFY(!machine.getBuildSuccessful());
+    QCOMPARE(cache.assemble(machine, "LDA label_inexistente\n"), false);
+    QVERIFY(!QFile::exists(cache.getEntryPath(cache.getKey(machine, "LDA label_inexistente\n"))));
+}
+
+#include "tst_assemblycachetest.moc"
+QTEST_APPLESS_MAIN(AssemblyCacheTest)
@@ -0,0 +1,68 @@
+#include <QtTest>
+#include <QScopedPointer>
+#include <QTemporaryDir>
+
+#include "machinefactory.h"
+#include "neandermachine.h"
+#include "counterloop.h"
+
+class CheckpointTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void test_checkpointResume();
+};
+
+void CheckpointTest::test_checkpointResume()
+{
+    NeanderMachine original;
+    original.assemble(COUNTER_LOOP);
+    QVERIFY(original.getBuildSuccessful());
+
+    original.setRunning(true);
+    for (int i = 0; i < 50; i++)
+        original.step();
+
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    QString filename = directory.filePath("execucao.hchk");
+    QCOMPARE(original.exportCheckpoint(filename), FileErrorCode::noError);
+    QCOMPARE(Machine::readMemoryFileIdentifier(filename), QString("NDR"));
+
+    // Resumed run ends in the same state as the uninterrupted one
+    QScopedPointer<Machine> resumed(MachineFactory::createMachine("NDR"));
+    QVERIFY(!resumed.isNull());
+    QCOMPARE(resumed->importCheckpoint(filename), FileErrorCode::noError);
+    QCOMPARE(resumed->getInstructionCount(), (qint64)50);
+    QCOMPARE(resumed->getPCValue(), original.getPCValue());
+
+    runUntilHalt(original);
+    runUntilHalt(*resumed);
+
+    QCOMPARE(resumed->getInstructionCount(), original.getInstructionCount());
+    QCOMPARE(resumed->getAccessCount(), original.getAccessCount());
+    QCOMPARE(resumed->getRegisterValue("AC"), original.getRegisterValue("AC"));
+    QCOMPARE(resumed->getFlagValue("N"), original.getFlagValue("N"));
+    QCOMPARE(resumed->getMemoryValue(128), original.getMemoryValue(128));
+
+    // Damaged checkpoints are rejected without touching the machine
+    QByteArray checkpoint = original.saveCheckpoint();
+    checkpoint[10] = checkpoint[10] ^ 1;
+
+    NeanderMachine untouched;
+    QCOMPARE(untouched.loadCheckpoint((const uchar *)checkpoint.constData(), checkpoint.size()), FileErrorCode::invalidChecksum);
+    QCOMPARE(untouched.getInstructionCount(), (qint64)0);
+
+    // Counters past 32 bits survive a checkpoint
+    original.setCounters(5000000000LL, 12000000000LL);
+    checkpoint = original.saveCheckpoint();
+    QCOMPARE(untouched.loadCheckpoint((const uchar *)checkpoint.constData(), checkpoint.size()), FileErrorCode::noError);
+    QCOMPARE(untouched.getInstructionCount(), 5000000000LL);
+    QCOMPARE(untouched.getAccessCount(), 12000000000LL);
+
+    QVERIFY(MachineFactory::createMachine("XYZ") == nullptr);
+}
+
+#include "tst_checkpointtest.moc"
+QTEST_APPLESS_MAIN(CheckpointTest)
@@ -0,0 +1,91 @@
+#include <QtTest>
+
+#include "executiontrace.h"
+#include "neandermachine.h"
+#include "counterloop.h"
+
+class ExecutionTraceTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void test_executionTrace();
+};
+
+void ExecutionTraceTest::test_executionTrace()
+{
+    NeanderMachine machine;
+    machine.assemble(COUNTER_LOOP);
+    QVERIFY(machine.getBuildSuccessful());
+
+    ExecutionTrace trace(16);
+    trace.resume(machine);
+    machine.setRunning(true);
+    while (machine.isRunning())
+    {
+        machine.step();
+        trace.recordStep(machine);
+    }
+    trace.finish(machine);
+
+    QCOMPARE((qint64)trace.getLength(), machine.getInstructionCount());
+    QCOMPARE(trace.getCurrentIndex(), trace.getLength());
+
+    // Every sought state matches a run stopped at the same instruction
+    QList<int> indexes;
+    indexes << 0 << 1 << 15 << 16 << 17 << 50 << 333 << trace.getLength();
+
+    foreach (int index, indexes)
+    {
+        NeanderMachine reference;
+        reference.assemble(COUNTER_LOOP);
+        reference.setRunning(true);
+        for (int i = 0; i < index; i++)
+            reference.step();
+
+        QVERIFY(trace.seek(machine, index));
+        QCOMPARE(machine.getInstructionCount(), reference.getInstructionCount());
+        QCOMPARE(machine.getAccessCount(), reference.getAccessCount());
+        QCOMPARE(machine.getPCValue(), reference.getPCValue());
+        QCOMPARE(machine.getRegisterValue("AC"), reference.getRegisterValue("AC"));
+        QCOMPARE(machine.getFlagValue("N"), reference.getFlagValue("N"));
+        QCOMPARE(machine.getMemoryValue(128), reference.getMemoryValue(128));
+        QVERIFY(!machine.isRunning());
+    }
+
+    QVERIFY(!trace.seek(machine, trace.getLength() + 1));
+
+    // Executing from a sought state discards the instructions after it
+    QVERIFY(trace.seek(machine, 50));
+    trace.resume(machine);
+    machine.step();
+    trace.recordStep(machine);
+    trace.finish(machine);
+    QCOMPARE(trace.getLength(), 51);
+
+    // Any other change starts a new recording
+    machine.setMemoryValue(128, 0);
+    trace.resume(machine);
+    QCOMPARE(trace.getLength(), 0);
+    QCOMPARE(trace.getFirstInstructionCount(), (qint64)51);
+
+    // Recording stops at the memory budget
+    NeanderMachine limitedMachine;
+    limitedMachine.assemble(COUNTER_LOOP);
+
+    ExecutionTrace limitedTrace(16, ExecutionTrace::DEFAULT_MAXIMUM_LENGTH, 1024);
+    limitedTrace.resume(limitedMachine);
+    limitedMachine.setRunning(true);
+    while (limitedMachine.isRunning())
+    {
+        limitedMachine.step();
+        limitedTrace.recordStep(limitedMachine);
+    }
+    limitedTrace.finish(limitedMachine);
+
+    QVERIFY(limitedTrace.isTruncated());
+    QVERIFY(limitedTrace.getLength() < limitedMachine.getInstructionCount());
+}
+
+#include "tst_executiontracetest.moc"
+QTEST_APPLESS_MAIN(ExecutionTraceTest)
@@ -0,0 +1,134 @@
+#include <QtTest>
+#include <QScopedPointer>
+#include <QTextBlock>
+#include <QTextDocument>
+#include <QTextLayout>
+
+#include "hidrahighlighter.h"
+#include "machinefactory.h"
+
+// Category of each highlighted character: instruction, directive, comment or none
+static const QChar INSTRUCTION = 'i', DIRECTIVE = 'd', COMMENT = 'c', NONE = ' ';
+
+static const char *SOURCE_CODE = "inicio: LDA valor ; comentário\n"
+                                 "        add um;sem espaço\n"
+                                 "        STR A 'a;b' ; string com ponto e vírgula\n"
+                                 "        DB ''', 'x' ; literal de aspas\n"
+                                 "        DB 'a'''b', ''''; aspas dentro de strings\n"
+                                 "        DAB 'lda jmp' ; mnemônicos em string\n"
+                                 "jmp_x:  JMP inicio\n"
+                                 "        LDA''' ; literal colado\n"
+                                 "        ORG 128\n"
+                                 "        dw 5 ; org db\n"
+                                 "        ldax lda2 _lda lda.add lda-add hlt\n"
+                                 "        'não fechada ; texto\n"
+                                 "        ÇLDA lda Ç NOT\n"
+                                 "        PUSH POP JSR RTS SHR SHL ROR ROL NEG OR AND\n"
+                                 "; linha de comentário\n"
+                                 "\n"
+                                 "        DaW 1, 2 ;;; fim\n";
+
+class HighlighterTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void test_matchesRegexRules_data();
+    void test_matchesRegexRules();
+    void test_keywordsUnchanged();
+};
+
+// The rules used before the single-pass scanner: one regex per category, applied in order
+static QString getRegexCategories(const QString &originalText, Machine &machine)
+{
+    QString text = originalText;
+    text.replace("'''", "___"); // Remove literal quotes before applying rules
+
+    QString instructionsPattern = "(";
+    foreach (Instruction *instruction, machine.getInstructions())
+        instructionsPattern.append("\\b" + instruction->getMnemonic() + "\\b|");
+    instructionsPattern.chop(1);
+    instructionsPattern.append(")");
+
+    QString directivesPattern = "(\\borg\\b|\\bdb\\b|\\bdw\\b|\\bdab\\b|\\bdaw\\b)";
+    QString commentsPattern = "^(?:[^';]*(?:'[^']*')?)*(;.*)$";
+
+    QList<QPair<QString, QChar>> rules;
+    rules << qMakePair(instructionsPattern, INSTRUCTION)
+          << qMakePair(directivesPattern, DIRECTIVE)
+          << qMakePair(commentsPattern, COMMENT);
+
+    QString categories(text.length(), NONE);
+
+    for (int rule = 0; rule < rules.size(); rule++)
+    {
+        QRegExp regExp(rules[rule].first, Qt::CaseInsensitive);
+        int index = text.indexOf(regExp);
+
+        while (index >= 0)
+        {
+            for (int i = regExp.pos(1); i < regExp.pos(1) + regExp.cap(1).length(); i++)
+                categories[i] = rules[rule].second;
+
+            index = text.indexOf(regExp, index + regExp.matchedLength());
+        }
+    }
+
+    return categories;
+}
+
+static QString getHighlightedCategories(const QTextBlock &block)
+{
+    QString categories(block.text().length(), NONE);
+
+    foreach (const QTextLayout::FormatRange &range, block.layout()->formats())
+    {
+        QColor color = range.format.foreground().color();
+        QChar category = (color == QColor(237, 175, 2))  ? INSTRUCTION
+                       : (color == QColor(68, 119, 176)) ? DIRECTIVE
+                       : (color == QColor(Qt::darkGreen)) ? COMMENT : '?';
+
+        for (int i = range.start; i < range.start + range.length; i++)
+            categories[i] = category;
+    }
+
+    return categories;
+}
+
+void HighlighterTest::test_matchesRegexRules_data()
+{
+    QTest::addColumn<QString>("identifier");
+
+    foreach (QString identifier, QStringList() << "NDR" << "AHM" << "RMS" << "CRM" << "QPS" << "PTG" << "PRC" << "REG" << "VLT")
+        QTest::newRow(identifier.toLatin1().constData()) << identifier;
+}
+
+void HighlighterTest::test_matchesRegexRules()
+{
+    QFETCH(QString, identifier);
+
+    QScopedPointer<Machine> machine(MachineFactory::createMachine(identifier));
+    QVERIFY(!machine.isNull());
+
+    QTextDocument document(QString::fromUtf8(SOURCE_CODE));
+    HidraHighlighter highlighter(&document);
+    highlighter.initializeHighlighter(*machine);
+    highlighter.rehighlight();
+
+    for (QTextBlock block = document.firstBlock(); block.isValid(); block = block.next())
+        QCOMPARE(getHighlightedCategories(block), getRegexCategories(block.text(), *machine));
+}
+
+void HighlighterTest::test_keywordsUnchanged()
+{
+    QScopedPointer<Machine> neander(MachineFactory::createMachine("NDR"));
+    QScopedPointer<Machine> ramses(MachineFactory::createMachine("RMS"));
+    HidraHighlighter highlighter((QObject *)nullptr);
+
+    QVERIFY(highlighter.initializeHighlighter(*neander));
+    QVERIFY(!highlighter.initializeHighlighter(*neander)); // Same keywords, no rehighlight needed
+    QVERIFY(highlighter.initializeHighlighter(*ramses));
+}
+
+#include "tst_highlightertest.moc"
+QTEST_MAIN(HighlighterTest)
@@ -0,0 +1,48 @@
+#include <QtTest>
+
+#include "neandermachine.h"
+#include "counterloop.h"
+
+class MemoryActivityTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void test_memoryActivity();
+};
+
+void MemoryActivityTest::test_memoryActivity()
+{
+    NeanderMachine machine;
+    machine.assemble(COUNTER_LOOP);
+    QVERIFY(machine.getBuildSuccessful());
+    runUntilHalt(machine);
+
+    const MemoryActivity &activity = machine.getMemoryActivity();
+    QCOMPARE(activity.executions.size(), machine.getMemorySize());
+
+    // The loop body runs 128 times until contador turns negative
+    QCOMPARE(activity.executions[0], 128u); // LDA contador
+    QCOMPARE(activity.executions[1], 0u); // Operand
+    QCOMPARE(activity.executions[8], 127u); // JMP inicio
+    QCOMPARE(activity.executions[10], 1u); // HLT
+
+    quint32 executions = 0;
+    foreach (quint32 count, activity.executions)
+        executions += count;
+    QCOMPARE(executions, (quint32)machine.getInstructionCount());
+
+    QCOMPARE(activity.reads[128], 128u);
+    QCOMPARE(activity.writes[128], 128u);
+    QCOMPARE(activity.reads[129], 128u);
+    QCOMPARE(activity.writes[129], 0u);
+    QCOMPARE(activity.reads[1], 128u); // Operand fetches
+
+    // Mirrored machines show the same activity
+    NeanderMachine mirror;
+    mirror.setMemoryActivity(activity);
+    QCOMPARE(mirror.getMemoryActivity().writes[128], 128u);
+}
+
+#include "tst_memoryactivitytest.moc"
+QTEST_APPLESS_MAIN(MemoryActivityTest)
@@ -0,0 +1,67 @@
+#include <QtTest>
+#include <QTemporaryDir>
+
+#include "neandermachine.h"
+#include "counterloop.h"
+
+class MemoryFileTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void test_intelHexAndBinary();
+};
+
+void MemoryFileTest::test_intelHexAndBinary()
+{
+    NeanderMachine source;
+    source.assemble(COUNTER_LOOP);
+    QVERIFY(source.getBuildSuccessful());
+
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    QString hexFilename = directory.filePath("memoria.hex");
+    QString binaryFilename = directory.filePath("memoria.bin");
+
+    // Intel HEX: 16-byte data records and an end-of-file record
+    QCOMPARE(source.exportIntelHex(hexFilename, 0, 20), FileErrorCode::noError);
+
+    QFile hexFile(hexFilename);
+    QVERIFY(hexFile.open(QFile::ReadOnly | QFile::Text));
+    QList<QByteArray> records = hexFile.readAll().split('\n');
+    hexFile.close();
+    QCOMPARE(records[0], QByteArray(":10000000208030811080900A8000F0000000000005"));
+    QCOMPARE(records[2], QByteArray(":00000001FF"));
+
+    NeanderMachine machine;
+    QCOMPARE(machine.importIntelHex(hexFilename, 0, 256, 0), FileErrorCode::noError);
+    for (int address = 0; address < 20; address++)
+        QCOMPARE(machine.getMemoryValue(address), source.getMemoryValue(address));
+
+    QCOMPARE(machine.importIntelHex(hexFilename, 2, 4, 100), FileErrorCode::noError); // ADD um
+    QCOMPARE(machine.getMemoryValue(100), 0x30);
+    QCOMPARE(machine.getMemoryValue(101), 129);
+    QCOMPARE(machine.getMemoryValue(102), 0);
+
+    // Bad checksum: nothing is loaded
+    QVERIFY(hexFile.open(QFile::WriteOnly | QFile::Text));
+    hexFile.write(":0100C8002A0E\n:00000001FF\n");
+    hexFile.close();
+    QCOMPARE(machine.importIntelHex(hexFilename, 0, 256, 0), FileErrorCode::invalidChecksum);
+    QCOMPARE(machine.getMemoryValue(200), 0);
+
+    // Raw binary: one byte per address, may be shorter than the memory
+    QCOMPARE(source.exportBinary(binaryFilename, 128, 130), FileErrorCode::noError);
+    QCOMPARE(QFileInfo(binaryFilename).size(), 2);
+
+    QCOMPARE(machine.importBinary(binaryFilename, 0, 256, 254), FileErrorCode::noError);
+    QCOMPARE(machine.getMemoryValue(254), 0);
+    QCOMPARE(machine.getMemoryValue(255), 1);
+
+    QCOMPARE(machine.importBinary(binaryFilename, 1, 2, 50), FileErrorCode::noError);
+    QCOMPARE(machine.getMemoryValue(50), 1);
+    QCOMPARE(machine.importBinary(binaryFilename, 0, 257, 0), FileErrorCode::invalidAddress);
+}
+
+#include "tst_memoryfiletest.moc"
+QTEST_APPLESS_MAIN(MemoryFileTest)
@@ -0,0 +1,103 @@
+#include <QtTest>
+#include <QTemporaryDir>
+
+#include "recoveryjournal.h"
+
+class RecoveryJournalTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void test_recoveryJournal();
+};
+
+static const char *SAMPLE_TEXT = "Primeira linha do texto\n"
+                                 "Segunda linha\n"
+                                 "Terceira linha, com acentuação\n";
+
+void RecoveryJournalTest::test_recoveryJournal()
+{
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    QString filename;
+    QString text;
+
+    QString source = QString::fromUtf8(SAMPLE_TEXT);
+
+    {
+        RecoveryJournal journal(directory.path());
+        filename = journal.getFilename();
+
+        QVERIFY(!RecoveryJournal::recover(filename, text));
+        QVERIFY(!journal.adoptOrphan(text));
+
+        journal.save(source);
+        journal.flush();
+        QVERIFY(RecoveryJournal::recover(filename, text));
+        QCOMPARE(text, source);
+
+        // Edits are appended as diffs
+        qint64 snapshotSize = QFileInfo(filename).size();
+        source.replace("Segunda linha", "Segunda linha, já editada");
+        journal.save(source);
+        journal.flush();
+
+        QVERIFY(QFileInfo(filename).size() < snapshotSize * 2);
+        QVERIFY(RecoveryJournal::recover(filename, text));
+        QCOMPARE(text, source);
+
+        // Characters outside the BMP that differ only in their low surrogate
+        source.append(QString("Emoji: ") + QChar(0xD83D) + QChar(0xDE00) + "\n");
+        journal.save(source);
+        journal.flush(); // Written separately, so the second save is a diff
+        source[source.size() - 2] = QChar(0xDE01);
+        journal.save(source);
+        journal.flush();
+
+        QVERIFY(RecoveryJournal::recover(filename, text));
+        QCOMPARE(text, source);
+
+        // Many edits are compacted into a snapshot
+        for (int i = 0; i < 6000; i++)
+        {
+            source.insert(i % source.size(), QString::number(i % 10));
+            journal.save(source);
+            if (i % 500 == 0)
+                journal.flush();
+        }
+        journal.flush();
+
+        QVERIFY(QFileInfo(filename).size() < RecoveryJournal::MINIMUM_COMPACTION_SIZE + source.toUtf8().size() * 2);
+    } // Destroyed with the file left behind, as after a crash
+
+    QVERIFY(RecoveryJournal::recover(filename, text));
+    QCOMPARE(text, source);
+
+    // A torn record at the end is ignored
+    QFile file(filename);
+    QVERIFY(file.open(QFile::Append));
+    file.write(QByteArray("\x01\x40\x00\x00\x00\x12", 6));
+    file.close();
+
+    QVERIFY(RecoveryJournal::recover(filename, text));
+    QCOMPARE(text, source);
+
+    // Taken over by the next instance, but not while its own instance runs
+    RecoveryJournal journal(directory.path());
+    RecoveryJournal otherJournal(directory.path());
+
+    QVERIFY(journal.adoptOrphan(text));
+    QCOMPARE(text, source);
+    QVERIFY(!QFile::exists(filename));
+    QVERIFY(QFile::exists(journal.getFilename()));
+    QVERIFY(!otherJournal.adoptOrphan(text));
+
+    // Discarded after saving elsewhere
+    journal.save(source);
+    journal.discard();
+    journal.flush();
+    QVERIFY(!QFile::exists(journal.getFilename()));
+}
+
+#include "tst_recoveryjournaltest.moc"
+QTEST_APPLESS_MAIN(RecoveryJournalTest)
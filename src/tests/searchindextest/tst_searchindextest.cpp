@@ -0,0 +1,137 @@
+#include <QtTest>
+#include <QTextCursor>
+#include <QTextDocument>
+
+#include "searchindex.h"
+
+static const char *SOURCE_CODE = "inicio: LDA valor ; lda\n"
+                                 "        ADD um\n"
+                                 "        STA valor\n"
+                                 "        JMP inicio\n"
+                                 "valor:  DB 0 ; LdA lda\n"
+                                 "um:     DB 1\n";
+
+class SearchIndexTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void test_updateMatchesBuild_data();
+    void test_updateMatchesBuild();
+    void test_matchesSearch();
+};
+
+// Replaces charsRemoved characters at position with text, as typing or pasting would
+static void applyEdit(QTextDocument &document, int position, int charsRemoved, const QString &text)
+{
+    QTextCursor cursor(&document);
+    cursor.setPosition(position);
+    cursor.setPosition(position + charsRemoved, QTextCursor::KeepAnchor);
+    cursor.insertText(text);
+}
+
+static void compareWithBuild(QTextDocument &document, const SearchIndex &index, const QString &text, bool caseSensitive, bool regex)
+{
+    SearchIndex fresh;
+    fresh.build(&document, text, caseSensitive, regex);
+
+    QCOMPARE(index.getStarts(), fresh.getStarts());
+    QCOMPARE(index.getLengths(), fresh.getLengths());
+}
+
+void SearchIndexTest::test_updateMatchesBuild_data()
+{
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<bool>("caseSensitive");
+    QTest::addColumn<bool>("regex");
+
+    QTest::newRow("plain") << "lda" << false << false;
+    QTest::newRow("plain case sensitive") << "LDA" << true << false;
+    QTest::newRow("plain repeated") << "aa" << false << false;
+    QTest::newRow("regex") << "\\b(lda|sta)\\b" << false << true;
+    QTest::newRow("regex variable length") << "v\\w*" << true << true;
+    QTest::newRow("regex zero length") << "x*" << false << true;
+}
+
+void SearchIndexTest::test_updateMatchesBuild()
+{
+    QFETCH(QString, text);
+    QFETCH(bool, caseSensitive);
+    QFETCH(bool, regex);
+
+    QTextDocument document(SOURCE_CODE);
+    SearchIndex index;
+    index.build(&document, text, caseSensitive, regex);
+    connect(&document, &QTextDocument::contentsChange, [&index](int position, int charsRemoved, int charsAdded) {
+        index.update(position, charsRemoved, charsAdded);
+    });
+
+    compareWithBuild(document, index, text, caseSensitive, regex);
+
+    // Inside a block, creating, splitting and joining matches
+    applyEdit(document, 8, 0, "lda ");
+    compareWithBuild(document, index, text, caseSensitive, regex);
+    applyEdit(document, 9, 1, "");
+    compareWithBuild(document, index, text, caseSensitive, regex);
+    applyEdit(document, 9, 0, "a");
+    compareWithBuild(document, index, text, caseSensitive, regex);
+    applyEdit(document, 0, 0, "aaaa");
+    compareWithBuild(document, index, text, caseSensitive, regex);
+
+    // Multi-block inserts
+    applyEdit(document, 20, 0, "\nLDA lda\nvalor STA\n");
+    compareWithBuild(document, index, text, caseSensitive, regex);
+    applyEdit(document, 0, 0, "\n\n");
+    compareWithBuild(document, index, text, caseSensitive, regex);
+    applyEdit(document, document.characterCount() - 1, 0, "\nsta lda\nLDA");
+    compareWithBuild(document, index, text, caseSensitive, regex);
+
+    // Removals across blocks, joining a line's end with another's start
+    applyEdit(document, 10, 25, "");
+    compareWithBuild(document, index, text, caseSensitive, regex);
+    applyEdit(document, 30, 20, "l\nd");
+    compareWithBuild(document, index, text, caseSensitive, regex);
+    applyEdit(document, document.characterCount() - 6, 5, "");
+    compareWithBuild(document, index, text, caseSensitive, regex);
+
+    // Single edit block with several changes, as replace all does
+    QTextCursor cursor(&document);
+    cursor.beginEditBlock();
+    cursor.setPosition(40);
+    cursor.insertText("sta\nLDA");
+    cursor.setPosition(3);
+    cursor.setPosition(12, QTextCursor::KeepAnchor);
+    cursor.insertText("lda");
+    cursor.endEditBlock();
+    compareWithBuild(document, index, text, caseSensitive, regex);
+
+    // Everything replaced
+    applyEdit(document, 0, document.characterCount() - 1, "lda\nLDA valor\n");
+    compareWithBuild(document, index, text, caseSensitive, regex);
+    applyEdit(document, 0, document.characterCount() - 1, "");
+    compareWithBuild(document, index, text, caseSensitive, regex);
+}
+
+void SearchIndexTest::test_matchesSearch()
+{
+    QTextDocument document(SOURCE_CODE);
+    SearchIndex index;
+
+    QVERIFY(!index.isValid());
+    QVERIFY(!index.matchesSearch("", false, false));
+
+    index.build(&document, "lda", false, false);
+    QVERIFY(index.isValid());
+    QVERIFY(index.matchesSearch("lda", false, false));
+    QVERIFY(!index.matchesSearch("lda", true, false));
+    QVERIFY(!index.matchesSearch("lda", false, true));
+    QVERIFY(!index.matchesSearch("sta", false, false));
+    QCOMPARE(index.getStarts().size(), 4);
+
+    index.clear();
+    QVERIFY(!index.isValid());
+    QVERIFY(index.getStarts().isEmpty());
+}
+
+#include "tst_searchindextest.moc"
+QTEST_MAIN(SearchIndexTest)
@@ -0,0 +1,24 @@
+#ifndef COUNTERLOOP_H
+#define COUNTERLOOP_H
+
+#include "machine.h"
+
+// Neander program that counts until the counter turns negative, then halts
+static const char * const COUNTER_LOOP = "inicio: LDA contador\n"
+                                         "ADD um\n"
+                                         "STA contador\n"
+                                         "JN fim\n"
+                                         "JMP inicio\n"
+                                         "fim: HLT\n"
+                                         "ORG 128\n"
+                                         "contador: DB 0\n"
+                                         "um: DB 1\n";
+
+static inline void runUntilHalt(Machine &machine)
+{
+    machine.setRunning(true);
+    for (int i = 0; i < 100000 && machine.isRunning(); i++)
+        machine.step();
+}
+
+#endif // COUNTERLOOP_H
@@ -0,0 +1,129 @@
+#include <QtTest>
+#include <QThread>
+#include <QVector>
+
+#include "triplebuffer.h"
+
+static const int SAMPLE_SIZE = 256;
+
+/// Published value whose fields must always agree with each other
+struct Sample
+{
+    Sample() : sequence(0) {}
+
+    int sequence;
+    QVector<int> values; // Every element equals sequence
+};
+
+class SampleWriter : public QThread
+{
+public:
+    SampleWriter(TripleBuffer<Sample> &buffer, int count) :
+        buffer(buffer),
+        count(count)
+    {
+    }
+
+protected:
+    virtual void run()
+    {
+        for (int sequence = 1; sequence <= count; sequence++)
+        {
+            Sample &sample = buffer.getWriteBuffer();
+            sample.sequence = sequence;
+            sample.values.fill(sequence, SAMPLE_SIZE); // Reused buffer, rewritten in place
+            buffer.publish();
+        }
+    }
+
+private:
+    TripleBuffer<Sample> &buffer;
+    int count;
+};
+
+class TripleBufferTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void test_takeLatest();
+    void test_twoThreads();
+};
+
+void TripleBufferTest::test_takeLatest()
+{
+    TripleBuffer<Sample> buffer;
+    QVERIFY(buffer.isConsumed());
+    QVERIFY(!buffer.take());
+
+    buffer.getWriteBuffer().sequence = 1;
+    buffer.publish();
+    QVERIFY(!buffer.isConsumed());
+    QVERIFY(buffer.take());
+    QCOMPARE(buffer.getReadBuffer().sequence, 1);
+    QVERIFY(buffer.isConsumed());
+    QVERIFY(!buffer.take());
+    QCOMPARE(buffer.getReadBuffer().sequence, 1); // Still readable until the next take
+
+    // Publications the reader missed are replaced by newer ones
+    for (int sequence = 2; sequence <= 5; sequence++)
+    {
+        buffer.getWriteBuffer().sequence = sequence;
+        buffer.publish();
+    }
+
+    QVERIFY(buffer.take());
+    QCOMPARE(buffer.getReadBuffer().sequence, 5);
+    QVERIFY(!buffer.take());
+
+    // The writer never gets the buffer being read
+    buffer.getWriteBuffer().sequence = 6;
+    QCOMPARE(buffer.getReadBuffer().sequence, 5);
+}
+
+void TripleBufferTest::test_twoThreads()
+{
+    const int COUNT = 200000;
+
+    TripleBuffer<Sample> buffer;
+    SampleWriter writer(buffer, COUNT);
+
+    int lastSequence = 0, taken = 0;
+    bool ordered = true, consistent = true;
+
+    writer.start();
+
+    // Failures are only recorded here, the writer must be waited for before returning
+    while (!writer.isFinished() || !buffer.isConsumed())
+    {
+        if (!buffer.take())
+            continue;
+
+        const Sample &sample = buffer.getReadBuffer();
+
+        if (sample.sequence <= lastSequence)
+            ordered = false;
+
+        if (sample.values.size() != SAMPLE_SIZE)
+            consistent = false;
+
+        for (int i = 0; i < sample.values.size(); i++)
+        {
+            if (sample.values[i] != sample.sequence)
+                consistent = false;
+        }
+
+        lastSequence = sample.sequence;
+        taken++;
+    }
+
+    writer.wait();
+
+    QVERIFY(ordered);
+    QVERIFY(consistent); // Never a buffer the writer was filling
+    QCOMPARE(lastSequence, COUNT); // The last publication is always delivered
+    QVERIFY(taken > 0 && taken <= COUNT);
+}
+
+#include "tst_triplebuffertest.moc"
+QTEST_APPLESS_MAIN(TripleBufferTest)